@@ -0,0 +1,127 @@
+#include <Arduino.h>
+
+#include "bench.h"
+#include "comms.h"
+#include "drawing.h"
+#include "telemetry.h"
+
+typedef void (*Primitive)(const Message&, Adafruit_GFX&);
+
+typedef struct {
+  const char* name;
+  Primitive draw;
+  bool has_radius;
+} PrimitiveCase;
+
+typedef struct {
+  const char* name;
+  const char* input;
+} ParserCase;
+
+static const PrimitiveCase PRIMITIVES[] = {
+  {"draw", draw, false},
+  {"single", single, false},
+  {"fill", fill, false},
+  {"brightfield", brightfield, true},
+  {"darkfield", darkfield, true},
+  {"phaseTop", phaseTop, true},
+  {"phaseBottom", phaseBottom, true},
+  {"phaseRight", phaseRight, true},
+  {"phaseLeft", phaseLeft, true},
+  {"ring", ring, true},
+  {"rings", rings, true},
+};
+
+static const int RADII[] = {1, 4, 8, 16};
+
+static const ParserCase PARSER_INPUTS[] = {
+  {"parse.draw", "draw 16 16 100\n"},
+  {"parse.brightfield", "brightfield 16 16 8 100\n"},
+  {"parse.rings", "rings 16 16 2 3 4 100\n"},
+  {"parse.at", "at 1000000 single 16 16 100\n"},
+  {"parse.preload", "preload fill 50\n"},
+  {"parse.status", "status\n"},
+};
+
+const float CYCLES_PER_US = F_CPU / 1000000.0;
+
+typedef struct {
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint64_t total_cycles;
+} Timing;
+
+static void timingRecord(Timing& timing, uint32_t cycles, bool first) {
+  if (first || cycles < timing.min_cycles) {
+    timing.min_cycles = cycles;
+  }
+  if (first || cycles > timing.max_cycles) {
+    timing.max_cycles = cycles;
+  }
+  timing.total_cycles = first ? cycles : timing.total_cycles + cycles;
+}
+
+static void printResult(const char* name, int r, unsigned int iterations, const Timing& timing) {
+  Serial.print(F("bench "));
+  Serial.print(name);
+  Serial.print(' ');
+  Serial.print(r);
+  Serial.print(' ');
+  Serial.print(iterations);
+  Serial.print(' ');
+  Serial.print(timing.min_cycles / CYCLES_PER_US, 2);
+  Serial.print(' ');
+  Serial.print(timing.total_cycles / CYCLES_PER_US / iterations, 2);
+  Serial.print(' ');
+  Serial.println(timing.max_cycles / CYCLES_PER_US, 2);
+}
+
+// Sets the radius arguments such that the outer radius of the pattern is r.
+static void setRadius(Message& msg, const char* name, int r) {
+  msg.r = r;
+  msg.r_out = r;
+  msg.count = 1;
+  if (strcmp(name, "ring") == 0) {
+    msg.r = r / 2;
+  } else if (strcmp(name, "rings") == 0) {
+    // Annuli of width 1 with gaps of width 1, the innermost one at r % 2 and the outermost at r
+    msg.r = r % 2;
+    msg.r_out = r % 2;
+    msg.count = r / 2 + 1;
+  }
+}
+
+void benchRun(unsigned int iterations, Adafruit_GFX& canvas) {
+  Message msg;
+  messageInit(msg);
+  msg.x = canvas.width() / 2;
+  msg.y = canvas.height() / 2;
+  msg.state = 100;
+
+  Timing timing;
+  for (const PrimitiveCase& primitive : PRIMITIVES) {
+    size_t numRadii = primitive.has_radius ? sizeof(RADII) / sizeof(RADII[0]) : 1;
+    for (size_t i = 0; i < numRadii; i++) {
+      int r = primitive.has_radius ? RADII[i] : 0;
+      setRadius(msg, primitive.name, r);
+      for (unsigned int n = 0; n < iterations; n++) {
+        uint32_t start = cycleCount();
+        primitive.draw(msg, canvas);
+        timingRecord(timing, cycleCount() - start, n == 0);
+      }
+      printResult(primitive.name, r, iterations, timing);
+    }
+  }
+
+  String input;
+  input.reserve(CHAR_LIMIT);
+  for (const ParserCase& parser : PARSER_INPUTS) {
+    input = parser.input;
+    for (unsigned int n = 0; n < iterations; n++) {
+      uint32_t start = cycleCount();
+      parseMessage(input, msg);
+      timingRecord(timing, cycleCount() - start, n == 0);
+    }
+    printResult(parser.name, 0, iterations, timing);
+  }
+}
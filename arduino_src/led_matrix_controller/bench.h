@@ -0,0 +1,21 @@
+/// Self-benchmark of the drawing primitives and the parser.
+///
+/// The `bench` command times every drawing primitive at several radii and the parser on canned
+/// inputs directly on the board, so that their cost can be compared across firmware versions
+/// without an oscilloscope. The benchmark blocks the main loop while it runs.
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <Adafruit_GFX.h>
+
+// The largest number of iterations per case.
+const unsigned int BENCH_MAX_ITERATIONS = 10000;
+
+// Runs each case `iterations` times on the canvas and prints one line per case to Serial.
+//
+// Each line has the format "bench <case> <r> <iterations> <min_us> <mean_us> <max_us>", where r is
+// the outer radius of the pattern, or 0 for cases without a radius. Parser cases are named
+// "parse.<verb>". The canvas holds the last benchmarked pattern afterwards.
+void benchRun(unsigned int iterations, Adafruit_GFX& canvas);
+
+#endif // #BENCH_H
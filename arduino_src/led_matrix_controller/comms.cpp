@@ -1,6 +1,10 @@
 #include <Arduino.h>
 
+#include "bench.h"
 #include "comms.h"
+#include "dither.h"
+#include "macros.h"
+#include "rxbuffer.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 /// Serial communications
@@ -10,12 +14,19 @@ void messageInit(Message& msg) {
   msg.x = 0;
   msg.y = 0;
   msg.r = 0;
+  msg.r_out = 0;
+  msg.count = 0;
   msg.state = 0;
+  msg.t_us = 0;
+  msg.slot = 0;
+  msg.deferral = Deferral::none;
+  msg.sync_mode = SyncMode::off;
   msg.is_valid = false;
   msg.error_msg = "";
 }
 
-// Read from Serial until until_c char found or char limit read or timeout reached.
+// Read from the serial receive buffer until until_c char found or char limit read or timeout
+// reached.
 // 
 // The function returns true when until_c is found or the input is length limited. Otherwise false
 // is returned. until_c, if found, is returned as last char in String.
@@ -28,15 +39,16 @@ bool readStringUntil(String& input, char until_c, size_t char_limit) {
   static unsigned long timerStart;
   static const unsigned long timeout_ms = 1000; // 1 sec; set to 0 for no timeout
 
-  while (Serial.available()) {
+  char c;
+  while (rxRead(c)) {
     timerRunning = false;
 
-    char c = Serial.read();
     input += c;
     if (c == until_c) {
       return true;
     }
     if (char_limit && (input.length() >= char_limit)) {
+      rxLineTruncated();
       return true;
     }
     // Restart timer running if the timeout is non-zero.
@@ -79,9 +91,22 @@ void parseMessage(const String& input, Message& msg) {
 
   // Parse the verb part of the command
   msg.is_valid = true;
-  if (verbStr.equalsIgnoreCase("draw")) {
+  msg.deferral = Deferral::none;
+  if (verbStr.equalsIgnoreCase("at")) {
+    parseAtArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("preload")) {
+    parsePreloadArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("def")) {
+    parseDefArgs(argStr, msg);
+  } else if (verbStr.startsWith("@")) {
+    msg.cmd = Command::recall;
+    parseSlotArgs(verbStr.substring(1), msg);
+  } else if (verbStr.equalsIgnoreCase("draw")) {
     msg.cmd = Command::draw;
     parseDrawArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("single")) {
+    msg.cmd = Command::single;
+    parseDrawArgs(argStr, msg);
   } else if (verbStr.equalsIgnoreCase("fill")) {
     msg.cmd = Command::fill;
     parseFillArgs(argStr, msg);
@@ -103,6 +128,58 @@ void parseMessage(const String& input, Message& msg) {
   } else if (verbStr.equalsIgnoreCase("phaseLeft")) {
     msg.cmd = Command::phaseLeft;
     parsePhaseLeftArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("ring")) {
+    msg.cmd = Command::ring;
+    parseRingArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("rings")) {
+    msg.cmd = Command::rings;
+    parseRingsArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("play")) {
+    msg.cmd = Command::play;
+    parsePlayArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("stop")) {
+    msg.cmd = Command::stop;
+  } else if (verbStr.equalsIgnoreCase("status")) {
+    msg.cmd = Command::status;
+  } else if (verbStr.equalsIgnoreCase("clearSchedule")) {
+    msg.cmd = Command::clearSchedule;
+  } else if (verbStr.equalsIgnoreCase("stats")) {
+    msg.cmd = Command::stats;
+  } else if (verbStr.equalsIgnoreCase("geometry")) {
+    msg.cmd = Command::geometry;
+    parseGeometryArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("sync")) {
+    msg.cmd = Command::sync;
+    parseSyncArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("advance")) {
+    msg.cmd = Command::advance;
+  } else if (verbStr.equalsIgnoreCase("skew")) {
+    msg.cmd = Command::skew;
+  } else if (verbStr.equalsIgnoreCase("clearPreload")) {
+    msg.cmd = Command::clearPreload;
+  } else if (verbStr.equalsIgnoreCase("cyclePreload")) {
+    msg.cmd = Command::cyclePreload;
+    parseCycleArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("dither")) {
+    msg.cmd = Command::dither;
+    parseDitherArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("trace")) {
+    msg.cmd = Command::trace;
+  } else if (verbStr.equalsIgnoreCase("bench")) {
+    msg.cmd = Command::bench;
+    parseBenchArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("version")) {
+    msg.cmd = Command::version;
+  } else if (verbStr.equalsIgnoreCase("undef")) {
+    msg.cmd = Command::undef;
+    parseSlotArgs(argStr, msg);
+  } else if (verbStr.equalsIgnoreCase("save")) {
+    msg.cmd = Command::save;
+  } else if (verbStr.equalsIgnoreCase("macros")) {
+    msg.cmd = Command::macros;
+  } else if (verbStr.equalsIgnoreCase("boot")) {
+    msg.cmd = Command::boot;
+    parseSlotArgs(argStr, msg);
   } else if (verbStr.equalsIgnoreCase("help")) {
     msg.cmd = Command::help;
   } else {
@@ -113,6 +190,184 @@ void parseMessage(const String& input, Message& msg) {
   }
 }
 
+// Returns true if the command draws a pattern on the LED matrix.
+bool isDrawingCommand(Command cmd) {
+  switch (cmd) {
+    case Command::draw:
+    case Command::fill:
+    case Command::brightfield:
+    case Command::darkfield:
+    case Command::phaseTop:
+    case Command::phaseBottom:
+    case Command::phaseRight:
+    case Command::phaseLeft:
+    case Command::ring:
+    case Command::rings:
+    case Command::single:
+    case Command::recall:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Parse a drawing command that is executed later rather than immediately.
+static void parseDeferred(const String& input, Message& msg) {
+  parseMessage(input, msg);
+  if (!msg.is_valid) {
+    return;
+  }
+  if (msg.deferral != Deferral::none || !isDrawingCommand(msg.cmd)) {
+    msg.is_valid = false;
+    msg.error_msg = "Only drawing commands can be deferred";
+  }
+}
+
+// Parse the arguments for the at command, which defers another command to the schedule.
+//
+// The arguments are a timestamp in microseconds followed by a complete drawing command, e.g.
+// "at 250000 draw 10 17 100". The drawing command is parsed into msg, which is then marked as
+// deferred.
+void parseAtArgs(const String& args, Message& msg) {
+  unsigned long t_us;
+  int consumed = 0;
+  int n = sscanf(args.c_str(), "%lu %n", &t_us, &consumed);
+  if (n != 1 || consumed == 0) {
+    msg.is_valid = false;
+    return;
+  }
+
+  parseDeferred(args.substring(consumed), msg);
+  if (msg.is_valid) {
+    msg.t_us = t_us;
+    msg.deferral = Deferral::schedule;
+  }
+}
+
+// Parse the arguments for the preload command, which defers another command to the next sync edge.
+//
+// The argument is a complete drawing command, e.g. "preload draw 10 17 100".
+void parsePreloadArgs(const String& args, Message& msg) {
+  parseDeferred(args, msg);
+  if (msg.is_valid) {
+    msg.deferral = Deferral::preload;
+  }
+}
+
+// Parse the arguments for the sync command
+void parseSyncArgs(const String& args, Message& msg) {
+  String mode = args.substring(0, args.length() - 1);
+  if (mode.equalsIgnoreCase("off")) {
+    msg.sync_mode = SyncMode::off;
+  } else if (mode.equalsIgnoreCase("leader")) {
+    msg.sync_mode = SyncMode::leader;
+  } else if (mode.equalsIgnoreCase("follower")) {
+    msg.sync_mode = SyncMode::follower;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the cyclePreload command
+void parseCycleArgs(const String& args, Message& msg) {
+  String state = args.substring(0, args.length() - 1);
+  if (state.equalsIgnoreCase("on")) {
+    msg.count = 1;
+  } else if (state.equalsIgnoreCase("off")) {
+    msg.count = 0;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the play command
+void parsePlayArgs(const String& args, Message& msg) {
+  unsigned long period_us;
+  int cycles;
+  int n = sscanf(args.c_str(), "%lu %d", &period_us, &cycles);
+  if (n == 2 && period_us > 0 && cycles >= 0) {
+    msg.t_us = period_us;
+    msg.count = cycles;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the geometry command.
+//
+// x and y hold the number of panels in each direction and count is 1 for a serpentine layout.
+void parseGeometryArgs(const String& args, Message& msg) {
+  int panels_x, panels_y, serpentine;
+  int n = sscanf(args.c_str(), "%d %d %d", &panels_x, &panels_y, &serpentine);
+  if (n == 3 && panels_x > 0 && panels_y > 0 && (serpentine == 0 || serpentine == 1)) {
+    msg.x = panels_x;
+    msg.y = panels_y;
+    msg.count = serpentine;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the def command, which appends another command to a macro.
+//
+// The arguments are a macro slot followed by a complete drawing command, e.g.
+// "def 3 brightfield 16 16 4 100".
+void parseDefArgs(const String& args, Message& msg) {
+  int slot;
+  int consumed = 0;
+  int n = sscanf(args.c_str(), "%d %n", &slot, &consumed);
+  if (n != 1 || consumed == 0 || slot < 0 || (size_t)slot >= MACRO_SLOTS) {
+    msg.is_valid = false;
+    return;
+  }
+
+  parseDeferred(args.substring(consumed), msg);
+  if (msg.is_valid) {
+    msg.slot = slot;
+    msg.deferral = Deferral::macro;
+  }
+}
+
+// Parse a macro slot. boot also accepts -1 for no boot macro.
+void parseSlotArgs(const String& args, Message& msg) {
+  int slot;
+  int n = sscanf(args.c_str(), "%d", &slot);
+  int min_slot = msg.cmd == Command::boot ? -1 : 0;
+  if (n == 1 && slot >= min_slot && slot < (int)MACRO_SLOTS) {
+    msg.slot = slot;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the bench command. count holds the number of iterations.
+void parseBenchArgs(const String& args, Message& msg) {
+  int iterations;
+  int n = sscanf(args.c_str(), "%d", &iterations);
+  if (n == 1 && iterations >= 1 && iterations <= (int)BENCH_MAX_ITERATIONS) {
+    msg.count = iterations;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+// Parse the arguments for the dither command. count holds the number of extra bits.
+void parseDitherArgs(const String& args, Message& msg) {
+  int extra_bits;
+  unsigned long subframe_us = 0;
+  int n = sscanf(args.c_str(), "%d %lu", &extra_bits, &subframe_us);
+  if (n >= 1 && extra_bits > (int)DITHER_MAX_BITS) {
+    // The action takes the bits as a uint8_t, which would wrap larger values around
+    msg.is_valid = false;
+    msg.error_msg = "Cannot dither with more than " + String(DITHER_MAX_BITS) + " extra bits";
+  } else if (n >= 1 && extra_bits >= 0) {
+    msg.count = extra_bits;
+    msg.t_us = subframe_us;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
 // Parse the arguments for the draw command
 void parseDrawArgs(const String& args, Message& msg) {
   int x, y, state;
@@ -215,3 +470,32 @@ void parsePhaseLeftArgs(const String& args, Message& msg) {
     msg.is_valid = false;
   }
 }
+
+void parseRingArgs(const String& args, Message& msg) {
+  int x, y, r_in, r_out, state;
+  int n = sscanf(args.c_str(), "%d %d %d %d %d", &x, &y, &r_in, &r_out, &state);
+  if (n == 5 && r_in >= 0 && r_out >= r_in) {
+    msg.x = x;
+    msg.y = y;
+    msg.r = r_in;
+    msg.r_out = r_out;
+    msg.state = state;
+  } else {
+    msg.is_valid = false;
+  }
+}
+
+void parseRingsArgs(const String& args, Message& msg) {
+  int x, y, r_in, r_out, count, state;
+  int n = sscanf(args.c_str(), "%d %d %d %d %d %d", &x, &y, &r_in, &r_out, &count, &state);
+  if (n == 6 && r_in >= 0 && r_out >= r_in && count > 0) {
+    msg.x = x;
+    msg.y = y;
+    msg.r = r_in;
+    msg.r_out = r_out;
+    msg.count = count;
+    msg.state = state;
+  } else {
+    msg.is_valid = false;
+  }
+}
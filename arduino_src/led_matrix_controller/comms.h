@@ -6,7 +6,7 @@
 #define COMMS_H
 
 // The maximum number of characters that can be read from Serial.
-const size_t CHAR_LIMIT    = 25;
+const size_t CHAR_LIMIT    = 48;
 
 // The line terminator character for Serial input.
 //
@@ -14,7 +14,18 @@ const size_t CHAR_LIMIT    = 25;
 const char LINE_TERMINATOR = '\n';
 
 // The set of possible commands that can be sent to the LED matrix.
-enum class Command {draw, fill, brightfield, darkfield, phaseTop, phaseBottom, phaseRight, phaseLeft, help};
+enum class Command {
+  draw, fill, brightfield, darkfield, phaseTop, phaseBottom, phaseRight, phaseLeft, ring, rings,
+  single, recall,
+  play, stop, status, clearSchedule, stats, geometry, sync, advance, skew, clearPreload,
+  cyclePreload, dither, trace, bench, version, def, undef, save, macros, boot, help
+};
+
+// Where a message goes instead of being executed immediately.
+enum class Deferral {none, schedule, preload, macro};
+
+// The roles of a controller in a group of synchronized controllers.
+enum class SyncMode {off, leader, follower};
 
 // Message data after parsing the serial input.
 // Each LED matrix command uses a non-exclusive subset of the fields.
@@ -23,7 +34,13 @@ typedef struct {
   int x;
   int y;
   int r;
+  int r_out;
+  int count;
   int state; // percentage
+  unsigned long t_us; // schedule timestamp or playback period
+  int slot; // macro slot
+  Deferral deferral;
+  SyncMode sync_mode;
   bool is_valid;
   String error_msg;
 } Message;
@@ -31,7 +48,8 @@ typedef struct {
 // Initialize a Message struct with default values.
 void messageInit(Message& msg);
 
-// Read from Serial until until_c char found or char limit read or timeout reached.
+// Read from the serial receive buffer until until_c char found or char limit read or timeout
+// reached.
 // 
 // The function returns true when until_c is found or the input is length limited. Otherwise false
 // is returned. until_c, if found, is returned as last char in String.
@@ -44,6 +62,39 @@ bool readStringUntil(String& input, char until_c, size_t char_limit);
 // Parse the string and convert it to a known message format.
 void parseMessage(const String& input, Message& msg);
 
+// Returns true if the command draws a pattern on the LED matrix.
+bool isDrawingCommand(Command cmd);
+
+// Parse the arguments for the at command, which defers another command to the schedule
+void parseAtArgs(const String& args, Message& msg);
+
+// Parse the arguments for the preload command, which defers another command to the next sync edge
+void parsePreloadArgs(const String& args, Message& msg);
+
+// Parse the arguments for the def command, which appends another command to a macro
+void parseDefArgs(const String& args, Message& msg);
+
+// Parse the macro slot of the recall, undef and boot commands
+void parseSlotArgs(const String& args, Message& msg);
+
+// Parse the arguments for the sync command
+void parseSyncArgs(const String& args, Message& msg);
+
+// Parse the arguments for the cyclePreload command
+void parseCycleArgs(const String& args, Message& msg);
+
+// Parse the arguments for the play command
+void parsePlayArgs(const String& args, Message& msg);
+
+// Parse the arguments for the geometry command
+void parseGeometryArgs(const String& args, Message& msg);
+
+// Parse the arguments for the dither command
+void parseDitherArgs(const String& args, Message& msg);
+
+// Parse the arguments for the bench command
+void parseBenchArgs(const String& args, Message& msg);
+
 // Parse the arguments for the draw command
 void parseDrawArgs(const String& args, Message& msg);
 
@@ -68,4 +119,10 @@ void parsePhaseRightArgs(const String& args, Message& msg);
 // Parse the arguments for the phaseLeft command
 void parsePhaseLeftArgs(const String& args, Message& msg);
 
+// Parse the arguments for the ring command
+void parseRingArgs(const String& args, Message& msg);
+
+// Parse the arguments for the rings command
+void parseRingsArgs(const String& args, Message& msg);
+
 #endif // #COMMS_H
@@ -0,0 +1,105 @@
+#include <Arduino.h>
+
+#include "dither.h"
+#include "drawing.h"
+#include "telemetry.h"
+
+static GFXcanvas16* levels = nullptr;
+static uint8_t extraBits = 0;
+static uint8_t subframe = 0;
+static unsigned long lastSubframe = 0;
+static unsigned long subframeSetting = 0;
+static unsigned long subframeCostUs = 0; // the duration of the last subframe
+
+// Reverses the order of the lowest `bits` bits of value.
+//
+// Using the bit-reversed subframe index as threshold spreads the subframes in which a pixel is
+// brighter evenly over the cycle, which keeps the flicker frequency high.
+static uint8_t reverseBits(uint8_t value, uint8_t bits) {
+  uint8_t result = 0;
+  for (uint8_t i = 0; i < bits; i++) {
+    result = (result << 1) | ((value >> i) & 1);
+  }
+  return result;
+}
+
+bool ditherSetBits(uint8_t extra_bits, Adafruit_GFX& layout, unsigned long subframe_us) {
+  delete levels;
+  levels = nullptr;
+  extraBits = 0;
+  subframe = 0;
+  subframeSetting = 0;
+  subframeCostUs = 0;
+  setMaxLevel(MAX_BRIGHTNESS);
+  layout.fillScreen(0);
+
+  if (extra_bits > DITHER_MAX_BITS) {
+    return false;
+  }
+  if (subframe_us != 0 && subframe_us < DITHER_MIN_SUBFRAME_US) {
+    return false;
+  }
+  if (extra_bits == 0) {
+    return true;
+  }
+
+  levels = new GFXcanvas16(layout.width(), layout.height());
+  if (levels->getBuffer() == nullptr) {
+    delete levels;
+    levels = nullptr;
+    return false;
+  }
+  levels->fillScreen(0);
+  extraBits = extra_bits;
+  subframeSetting = subframe_us;
+  setMaxLevel(((1 << BIT_DEPTH) - 1) << extraBits);
+  return true;
+}
+
+uint8_t ditherBits() {
+  return extraBits;
+}
+
+Adafruit_GFX* ditherCanvas() {
+  return levels;
+}
+
+unsigned long ditherSubframeSetting() {
+  return subframeSetting;
+}
+
+unsigned long ditherSubframeUs() {
+  if (subframeSetting != 0) {
+    return subframeSetting;
+  }
+  return max(DITHER_MIN_SUBFRAME_US, DITHER_LOAD_FACTOR * subframeCostUs);
+}
+
+bool ditherPoll() {
+  return levels != nullptr && micros() - lastSubframe >= ditherSubframeUs();
+}
+
+void ditherShow(Adafruit_GFX& layout, Adafruit_Protomatter& matrix) {
+  uint32_t start = cycleCount();
+  lastSubframe = micros();
+
+  const uint16_t mask = (1 << extraBits) - 1;
+  const uint16_t* buffer = levels->getBuffer();
+  const int16_t width = levels->width();
+  const int16_t height = levels->height();
+  for (int16_t y = 0; y < height; y++) {
+    for (int16_t x = 0; x < width; x++) {
+      uint16_t level = buffer[y * width + x];
+      // Offset the subframe index per pixel so that neighbouring pixels do not all switch to the
+      // higher level in the same subframe. Every pixel still sees each index once per cycle.
+      uint8_t threshold = reverseBits((subframe + x + y) & mask, extraBits);
+      uint16_t hw_level = (level >> extraBits) + ((level & mask) > threshold);
+      layout.drawPixel(x, y, hw_level << (5 - BIT_DEPTH));
+    }
+  }
+  matrix.show();
+
+  subframe = (subframe + 1) & mask;
+  subframeCostUs = micros() - lastSubframe;
+  telemetryRecord(Stage::dither, cycleCount() - start);
+}
@@ -0,0 +1,57 @@
+/// Extended bit depth by temporal dithering.
+///
+/// The panels display 2^BIT_DEPTH brightness levels. In dithering mode, patterns are drawn onto a
+/// level canvas with extra_bits more bits of precision. The main loop displays the canvas as a
+/// sequence of 2^extra_bits subframes. In each subframe every pixel shows either the hardware
+/// level just below its target or the one just above, such that the average over a full cycle of
+/// subframes equals the target exactly. Camera exposures should span a whole number of cycles, or
+/// be long compared to a cycle.
+///
+/// A subframe redraws every pixel and calls matrix.show(), which is costly on the SAMD21. While a
+/// subframe is drawn, the main loop cannot parse commands or serve the sync and schedule, so each
+/// subframe delays them by up to its cost. By default the subframe period follows the measured cost
+/// of the subframes, such that dithering takes at most 1 / DITHER_LOAD_FACTOR of the main loop's
+/// time. The cost is also recorded as the dither stage of the telemetry.
+#ifndef DITHER_H
+#define DITHER_H
+
+#include <Adafruit_GFX.h>
+#include <Adafruit_Protomatter.h>
+
+// The maximum number of extra bits. The cycle length grows as 2^extra_bits subframes.
+const uint8_t DITHER_MAX_BITS = 4;
+
+// The shortest time between two subframes.
+const unsigned long DITHER_MIN_SUBFRAME_US = 1000;
+
+// The ratio of the automatic subframe period to the measured cost of a subframe.
+const unsigned long DITHER_LOAD_FACTOR = 4;
+
+// Set the number of extra bits of precision. 0 switches dithering off.
+//
+// subframe_us is the time between two subframes, or 0 to derive it from the measured cost of the
+// subframes. The level canvas is allocated with the size of the layout and starts out blank. Call
+// this again after changing the size of the layout. Returns false if extra_bits is too large,
+// subframe_us is shorter than DITHER_MIN_SUBFRAME_US or the level canvas cannot be allocated, in
+// which case dithering is switched off.
+bool ditherSetBits(uint8_t extra_bits, Adafruit_GFX& layout, unsigned long subframe_us = 0);
+
+// The current number of extra bits.
+uint8_t ditherBits();
+
+// The configured time between two subframes, or 0 if it follows the measured cost.
+unsigned long ditherSubframeSetting();
+
+// The current time between two subframes.
+unsigned long ditherSubframeUs();
+
+// The level canvas to draw on, or nullptr if dithering is off.
+Adafruit_GFX* ditherCanvas();
+
+// Returns true if dithering is on and the next subframe is due.
+bool ditherPoll();
+
+// Draw the next subframe of the level canvas onto the layout and display it.
+void ditherShow(Adafruit_GFX& layout, Adafruit_Protomatter& matrix);
+
+#endif // #DITHER_H
@@ -1,50 +1,120 @@
-#include <Adafruit_Protomatter.h>
+#include <Adafruit_GFX.h>
 #include <Arduino.h>
 
 #include "comms.h"
 #include "drawing.h"
 
-void draw(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.drawPixel(msg.x, msg.y, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.show();
+static uint16_t maxLevel = MAX_BRIGHTNESS;
+
+void setMaxLevel(uint16_t max_level) {
+  maxLevel = max_level;
+}
+
+uint16_t level(int state) {
+  return state * maxLevel * 0.01;
+}
+
+void draw(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.drawPixel(msg.x, msg.y, level(msg.state));
+}
+
+void single(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillScreen(0 * MAX_BRIGHTNESS);
+  canvas.drawPixel(msg.x, msg.y, level(msg.state));
+}
+
+void fill(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillScreen(level(msg.state));
+}
+
+void brightfield(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillCircle(msg.x, msg.y, msg.r, level(msg.state));
+}
+
+void darkfield(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillScreen(level(msg.state));
+  canvas.fillCircle(msg.x, msg.y, msg.r, 0 * MAX_BRIGHTNESS);
+}
+
+void phaseTop(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillCircle(msg.x, msg.y, msg.r, level(msg.state));
+  canvas.fillRect(msg.x - msg.r, msg.y, msg.r * 2 + 1, msg.r + 1, 0 * MAX_BRIGHTNESS);
 }
 
-void fill(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillScreen(msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.show();
+void phaseBottom(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillCircle(msg.x, msg.y, msg.r, level(msg.state));
+  canvas.fillRect(msg.x - msg.r, msg.y - msg.r, msg.r * 2 + 1, msg.r + 1, 0 * MAX_BRIGHTNESS);
 }
 
-void brightfield(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillCircle(msg.x, msg.y, msg.r, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.show();
+void phaseRight(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillCircle(msg.x, msg.y, msg.r, level(msg.state));
+  canvas.fillRect(msg.x - msg.r, msg.y - msg.r, msg.r + 1, msg.r * 2 + 1, 0 * MAX_BRIGHTNESS);
 }
 
-void darkfield(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillScreen(msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.fillCircle(msg.x, msg.y, msg.r, 0 * MAX_BRIGHTNESS);
-  matrix.show();
+void phaseLeft(const Message& msg, Adafruit_GFX& canvas) {
+  canvas.fillCircle(msg.x, msg.y, msg.r, level(msg.state));
+  canvas.fillRect(msg.x, msg.y - msg.r, msg.r + 1, msg.r * 2 + 1, 0 * MAX_BRIGHTNESS);
 }
 
-void phaseTop(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillCircle(msg.x, msg.y, msg.r, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.fillRect(msg.x - msg.r, msg.y, msg.r * 2 + 1, msg.r + 1, 0 * MAX_BRIGHTNESS);
-  matrix.show();
+// Draws an annulus without calling show(). Pixels with a distance below r_in are switched off.
+static void fillAnnulus(int16_t x, int16_t y, int16_t r_in, int16_t r_out, uint16_t color,
+                        Adafruit_GFX& canvas) {
+  canvas.fillCircle(x, y, r_out, color);
+  if (r_in > 0) {
+    canvas.fillCircle(x, y, r_in - 1, 0 * MAX_BRIGHTNESS);
+  }
 }
 
-void phaseBottom(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillCircle(msg.x, msg.y, msg.r, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.fillRect(msg.x - msg.r, msg.y - msg.r, msg.r * 2 + 1, msg.r + 1, 0 * MAX_BRIGHTNESS);
-  matrix.show();
+void ring(const Message& msg, Adafruit_GFX& canvas) {
+  fillAnnulus(msg.x, msg.y, msg.r, msg.r_out, level(msg.state), canvas);
 }
 
-void phaseRight(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillCircle(msg.x, msg.y, msg.r, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.fillRect(msg.x - msg.r, msg.y - msg.r, msg.r + 1, msg.r * 2 + 1, 0 * MAX_BRIGHTNESS);
-  matrix.show();
+void rings(const Message& msg, Adafruit_GFX& canvas) {
+  const int width = msg.r_out - msg.r + 1;
+  // Draw from the outside in so that clearing the inside of an annulus does not erase the
+  // annuli that have already been drawn.
+  for (int i = msg.count - 1; i >= 0; i--) {
+    int r_in = msg.r + 2 * i * width;
+    fillAnnulus(msg.x, msg.y, r_in, r_in + width - 1, level(msg.state), canvas);
+  }
 }
 
-void phaseLeft(const Message& msg, Adafruit_Protomatter& matrix) {
-  matrix.fillCircle(msg.x, msg.y, msg.r, msg.state * MAX_BRIGHTNESS * 0.01);
-  matrix.fillRect(msg.x, msg.y - msg.r, msg.r + 1, msg.r * 2 + 1, 0 * MAX_BRIGHTNESS);
-  matrix.show();
+void drawPattern(const Message& msg, Adafruit_GFX& canvas) {
+  switch (msg.cmd) {
+    case Command::draw:
+      draw(msg, canvas);
+      break;
+    case Command::single:
+      single(msg, canvas);
+      break;
+    case Command::fill:
+      fill(msg, canvas);
+      break;
+    case Command::brightfield:
+      brightfield(msg, canvas);
+      break;
+    case Command::darkfield:
+      darkfield(msg, canvas);
+      break;
+    case Command::phaseTop:
+      phaseTop(msg, canvas);
+      break;
+    case Command::phaseBottom:
+      phaseBottom(msg, canvas);
+      break;
+    case Command::phaseRight:
+      phaseRight(msg, canvas);
+      break;
+    case Command::phaseLeft:
+      phaseLeft(msg, canvas);
+      break;
+    case Command::ring:
+      ring(msg, canvas);
+      break;
+    case Command::rings:
+      rings(msg, canvas);
+      break;
+    default:
+      break;
+  }
 }
@@ -1,36 +1,73 @@
-/// Configuration and commands for the LED matrix.
+/// Configuration and commands for the LED canvas.
+///
+/// The drawing functions only modify the frame buffer. Call `matrix.show()` afterwards to display
+/// the result, or draw through `render()`, which does both.
 #ifndef DRAWING_H
 #define DRAWING_H
 
-#include <Adafruit_Protomatter.h>
+#include <Adafruit_GFX.h>
 
 #include "comms.h"
 #include "drawing.h"
 
+// The LEDs are driven by the 5 bit blue channel of the RGB565 colors. Protomatter keeps the
+// BIT_DEPTH most significant bits of each channel, so BIT_DEPTH may be at most 5 even though
+// Protomatter itself supports up to 6.
+const uint8_t BIT_DEPTH = 4;
 const uint16_t MAX_BRIGHTNESS = 31;
 
-// Draw a single pixel on the LED matrix.
-void draw(const Message& msg, Adafruit_Protomatter& matrix);
+static_assert(BIT_DEPTH >= 1 && BIT_DEPTH <= 5, "BIT_DEPTH must be between 1 and 5");
+
+// Set the value that a brightness of 100% is drawn with. Defaults to MAX_BRIGHTNESS.
+//
+// The dithering mode draws onto a canvas with more levels than the hardware supports.
+void setMaxLevel(uint16_t max_level);
+
+// Convert a brightness in percent into the value drawn onto the canvas.
+uint16_t level(int state);
+
+// Draw a single pixel on the LED canvas.
+void draw(const Message& msg, Adafruit_GFX& canvas);
+
+// Switch off all pixels except a single one on the LED canvas.
+//
+// Unlike draw, this replaces the whole pattern, so a sequence of single LEDs can be preloaded or
+// scheduled without clearing the canvas in between.
+void single(const Message& msg, Adafruit_GFX& canvas);
 
 // Fill the LED matrix with a single value.
-void fill(const Message& msg, Adafruit_Protomatter& matrix);
+void fill(const Message& msg, Adafruit_GFX& canvas);
+
+// Draw a circle of pixels on the LED canvas.
+void brightfield(const Message& msg, Adafruit_GFX& canvas);
+
+// Draw a circle of dark pixels on bright background on the LED canvas.
+void darkfield(const Message& msg, Adafruit_GFX& canvas);
+
+// Draw a top half-circle of pixels on the LED canvas.
+void phaseTop(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a circle of pixels on the LED matrix.
-void brightfield(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw a bottom half-circle of pixels on the LED canvas.
+void phaseBottom(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a circle of dark pixels on bright background on the LED matrix.
-void darkfield(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw a right half-circle of pixels on the LED canvas.
+void phaseRight(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a top half-circle of pixels on the LED matrix.
-void phaseTop(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw a left half-circle of pixels on the LED canvas.
+void phaseLeft(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a bottom half-circle of pixels on the LED matrix.
-void phaseBottom(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw an annulus of pixels with inner radius r and outer radius r_out on the LED canvas.
+//
+// Pixels inside the inner radius are switched off.
+void ring(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a right half-circle of pixels on the LED matrix.
-void phaseRight(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw the pattern of any drawing command except recall on the LED canvas.
+void drawPattern(const Message& msg, Adafruit_GFX& canvas);
 
-// Draw a left half-circle of pixels on the LED matrix.
-void phaseLeft(const Message& msg, Adafruit_Protomatter& matrix);
+// Draw count concentric annuli on the LED canvas.
+//
+// The innermost annulus spans r to r_out. Each following annulus has the same width and is
+// separated from the previous one by a gap of that width.
+void rings(const Message& msg, Adafruit_GFX& canvas);
 
 #endif // #DRAWING_H
@@ -1,16 +1,31 @@
 #include <Adafruit_Protomatter.h>
 
+#include "bench.h"
 #include "comms.h"
+#include "dither.h"
 #include "drawing.h"
+#include "macros.h"
+#include "panels.h"
+#include "rxbuffer.h"
+#include "schedule.h"
+#include "sync.h"
+#include "telemetry.h"
+#include "trace.h"
 
 /// Communications configuration
 const uint32_t BAUD = 9600;
 const uint8_t OK    = 0;
 const uint8_t ERROR = 1;
 
+/// The firmware version that the `version` command reports together with the build time.
+///
+/// Keep it in sync with the version of the leb-ptycho package in pyproject.toml.
+const char* const FIRMWARE_VERSION = "3.0.0";
+
 /// LED matrix configuration and commands
-const uint8_t MATRIX_SIZE = 32;
-const uint8_t BIT_DEPTH = 4;
+///
+/// The panel size and the number of chained panels are set in panels.h and the bit depth in
+/// drawing.h.
 
 uint8_t rgbPins[]  = {2, 3, 4, 5, 6, 7};
 uint8_t addrPins[] = {A0, A1, A2, A3};
@@ -24,6 +39,7 @@ uint8_t oePin      = 9;
 void printHelp() {
   Serial.println(F("Available commands:"));
   Serial.println(F("  draw <x> <y> (0 - 100)\\n"));
+  Serial.println(F("  single <x> <y> (0 - 100)\\n"));
   Serial.println(F("  fill (0 - 100)\\n"));
   Serial.println(F("  brightfield <x> <y> <r> (0 - 100)\\n"));
   Serial.println(F("  darkfield <x> <y> <r> (0 - 100)\\n"));
@@ -31,13 +47,39 @@ void printHelp() {
   Serial.println(F("  phaseBottom <x> <y> <r> (0 - 100)\\n"));
   Serial.println(F("  phaseRight <x> <y> <r> (0 - 100)\\n"));
   Serial.println(F("  phaseLeft <x> <y> <r> (0 - 100)\\n"));
+  Serial.println(F("  ring <x> <y> <r_in> <r_out> (0 - 100)\\n"));
+  Serial.println(F("  rings <x> <y> <r_in> <r_out> <count> (0 - 100)\\n"));
+  Serial.println(F("  at <t_us> <drawing command>\\n"));
+  Serial.println(F("  play <period_us> <cycles>\\n"));
+  Serial.println(F("  stop\\n"));
+  Serial.println(F("  status\\n"));
+  Serial.println(F("  clearSchedule\\n"));
+  Serial.println(F("  stats\\n"));
+  Serial.println(F("  geometry <panels_x> <panels_y> (0 - 1)\\n"));
+  Serial.println(F("  sync (off | leader | follower)\\n"));
+  Serial.println(F("  preload <drawing command>\\n"));
+  Serial.println(F("  advance\\n"));
+  Serial.println(F("  skew\\n"));
+  Serial.println(F("  clearPreload\\n"));
+  Serial.println(F("  cyclePreload (on | off)\\n"));
+  Serial.println(F("  dither (0 - 4) [subframe_us]\\n"));
+  Serial.println(F("  trace\\n"));
+  Serial.println(F("  bench <iterations>\\n"));
+  Serial.println(F("  version\\n"));
+  Serial.println(F("  def <slot> <drawing command>\\n"));
+  Serial.println(F("  undef <slot>\\n"));
+  Serial.println(F("  @<slot>\\n"));
+  Serial.println(F("  boot (-1 - 15)\\n"));
+  Serial.println(F("  save\\n"));
+  Serial.println(F("  macros\\n"));
   Serial.println(F("  help\\n"));
   Serial.println(F(""));
   Serial.println("Note: commands must be terminated with a \\n character.");
 }
 
 /// Main program
-Adafruit_Protomatter matrix(MATRIX_SIZE, BIT_DEPTH, 1, rgbPins, 4, addrPins, clockPin, latchPin, oePin, false);
+Adafruit_Protomatter matrix(PANEL_SIZE * CHAIN_LENGTH, BIT_DEPTH, 1, rgbPins, 4, addrPins, clockPin, latchPin, oePin, false);
+PanelLayout canvas(matrix);
 String input;
 Message msg;
 
@@ -45,6 +87,10 @@ void setup() {
   Serial.begin(BAUD);
 
   messageInit(msg);
+  input.reserve(CHAR_LIMIT);
+  rxInit();
+  scheduleInit();
+  syncInit();
 
   // Initialize LED matrix
   ProtomatterStatus status = matrix.begin();
@@ -53,14 +99,52 @@ void setup() {
   if(status != PROTOMATTER_OK) {
     for(;;);
   }
+
+  // Display the boot macro, if any, so that the matrix is ready without a host.
+  int bootSlot = macroInit();
+  if (bootSlot >= 0) {
+    msg.cmd = Command::recall;
+    msg.slot = bootSlot;
+    render(msg, matrix, TraceSource::command);
+  }
 }
 
 void loop() {
+  // Render synchronized and scheduled patterns before anything else to keep their latency low.
+  const Message* entry;
+  if (syncPoll(entry)) {
+    render(*entry, matrix, TraceSource::sync);
+    syncRendered();
+  }
+  if (schedulePoll(entry)) {
+    render(*entry, matrix, TraceSource::schedule);
+  }
+  if (ditherPoll()) {
+    ditherShow(canvas, matrix);
+  }
+
   if (readStringUntil(input, LINE_TERMINATOR, CHAR_LIMIT)) {
+    uint32_t start = cycleCount();
     parseMessage(input, msg);
+    telemetryRecord(Stage::parse, cycleCount() - start);
+
     if (msg.is_valid) {
-      doAction(msg, matrix);
-      Serial.print(String(OK) + LINE_TERMINATOR);
+      bool ok;
+      switch (msg.deferral) {
+        case Deferral::schedule:
+          ok = addToSchedule(msg);
+          break;
+        case Deferral::preload:
+          ok = addToPreload(msg);
+          break;
+        case Deferral::macro:
+          ok = addToMacro(msg);
+          break;
+        default:
+          ok = doAction(msg, matrix);
+          break;
+      }
+      Serial.print(String(ok ? OK : ERROR) + LINE_TERMINATOR);
     } else {
       Serial.println(msg.error_msg);
       printHelp();
@@ -72,31 +156,205 @@ void loop() {
   }
 }
 
-void doAction(const Message& msg, Adafruit_Protomatter& matrix) {
+// Prints the state of the schedule on a single line.
+void printStatus() {
+  ScheduleStatus status;
+  scheduleGetStatus(status);
+  Serial.print(F("running="));
+  Serial.print(status.running);
+  Serial.print(F(" entries="));
+  Serial.print(status.num_entries);
+  Serial.print(F(" next="));
+  Serial.print(status.next);
+  Serial.print(F(" cycle="));
+  Serial.print(status.cycle);
+  Serial.print(F(" underruns="));
+  Serial.println(status.underruns);
+}
+
+// Appends a deferred message to the schedule. Returns false and prints the reason on failure.
+bool addToSchedule(const Message& msg) {
+  if (!scheduleAdd(msg)) {
+    Serial.println(F("Cannot add to schedule: running, full, or timestamp out of order"));
+    return false;
+  }
+  return true;
+}
+
+// Appends a deferred message to the preload queue. Returns false and prints the reason on failure.
+bool addToPreload(const Message& msg) {
+  if (!syncPreload(msg)) {
+    Serial.println(F("Cannot preload: the queue is full"));
+    return false;
+  }
+  return true;
+}
+
+// Appends a deferred message to a macro. Returns false and prints the reason on failure.
+bool addToMacro(const Message& msg) {
+  if (!macroAppend(msg.slot, msg)) {
+    Serial.println(F("Cannot define: the macro is full or the command is a recall"));
+    return false;
+  }
+  return true;
+}
+
+// Prints the sync latency statistics on a single line and resets them.
+void printSkew() {
+  SyncStats stats;
+  syncGetStats(stats);
+  Serial.print(F("edges="));
+  Serial.print(stats.edges);
+  Serial.print(F(" rendered="));
+  Serial.print(stats.rendered);
+  Serial.print(F(" missed="));
+  Serial.print(stats.missed);
+  Serial.print(F(" empty="));
+  Serial.print(stats.empty);
+  Serial.print(F(" last_us="));
+  Serial.print(stats.last_us);
+  Serial.print(F(" min_us="));
+  Serial.print(stats.min_us);
+  Serial.print(F(" mean_us="));
+  Serial.print(stats.rendered ? stats.total_us / stats.rendered : 0);
+  Serial.print(F(" max_us="));
+  Serial.println(stats.max_us);
+}
+
+// Prints the serial receive statistics on a single line and resets them.
+void printRxStats() {
+  RxStats stats;
+  rxGetStats(stats);
+  Serial.print(F("rx_bytes="));
+  Serial.print(stats.bytes);
+  Serial.print(F(" rx_overflows="));
+  Serial.print(stats.overflows);
+  Serial.print(F(" rx_truncated="));
+  Serial.print(stats.truncated);
+  Serial.print(F(" rx_high_water="));
+  Serial.println(stats.high_water);
+}
+
+// Draws the pattern in the message in global LED coordinates, displays it and records it in the
+// trace.
+void render(const Message& msg, Adafruit_Protomatter& matrix, TraceSource source) {
+  uint32_t start = cycleCount();
+  // In dithering mode, patterns are drawn onto the level canvas instead.
+  Adafruit_GFX* dithered = ditherCanvas();
+  Adafruit_GFX& target = dithered ? *dithered : canvas;
+  if (msg.cmd == Command::recall) {
+    macroDraw(msg.slot, target);
+  } else {
+    drawPattern(msg, target);
+  }
+  uint32_t rendered = cycleCount();
+  telemetryRecord(Stage::render, rendered - start);
+
+  if (dithered) {
+    ditherShow(canvas, matrix);
+  } else {
+    matrix.show();
+  }
+  telemetryRecord(Stage::show, cycleCount() - rendered);
+  traceRecord(msg, source);
+}
+
+// Executes the command in the message. Returns false and prints the reason on failure.
+bool doAction(const Message& msg, Adafruit_Protomatter& matrix) {
+  if (msg.cmd == Command::recall && macroLength(msg.slot) == 0) {
+    Serial.println(F("The macro is empty"));
+    return false;
+  }
+  if (isDrawingCommand(msg.cmd)) {
+    render(msg, matrix, TraceSource::command);
+    return true;
+  }
+
   switch (msg.cmd) {
-    case Command::draw:
-      draw(msg, matrix);
+    case Command::play:
+      if (!scheduleStart(msg.t_us, msg.count)) {
+        Serial.println(F("Cannot play: running, empty, or entries do not fit in the period"));
+        return false;
+      }
+      break;
+    case Command::stop:
+      scheduleStop();
+      break;
+    case Command::status:
+      printStatus();
+      break;
+    case Command::clearSchedule:
+      if (!scheduleClear()) {
+        Serial.println(F("Cannot clear the schedule while it is running"));
+        return false;
+      }
+      break;
+    case Command::stats:
+      telemetryPrint();
+      printRxStats();
+      break;
+    case Command::geometry:
+      if (!canvas.setGeometry(msg.x, msg.y, msg.count)) {
+        Serial.println(F("The geometry needs more panels than there are in the chain"));
+        return false;
+      }
+      // The level canvas follows the size of the layout.
+      if (ditherBits() > 0) {
+        ditherSetBits(ditherBits(), canvas, ditherSubframeSetting());
+      }
+      break;
+    case Command::sync:
+      syncSetMode(msg.sync_mode);
+      break;
+    case Command::advance:
+      if (!syncAdvance()) {
+        Serial.println(F("Only the sync leader can advance"));
+        return false;
+      }
+      break;
+    case Command::skew:
+      printSkew();
+      break;
+    case Command::clearPreload:
+      syncClearPreload();
+      break;
+    case Command::cyclePreload:
+      syncSetCycle(msg.count != 0);
+      break;
+    case Command::dither:
+      if (!ditherSetBits(msg.count, canvas, msg.t_us)) {
+        matrix.show();
+        Serial.println(F("Cannot dither: too many extra bits, too short subframes or no memory"));
+        return false;
+      }
+      matrix.show();
       break;
-    case Command::fill:
-      fill(msg, matrix);
+    case Command::trace:
+      tracePrint();
       break;
-    case Command::brightfield:
-      brightfield(msg, matrix);
+    case Command::bench:
+      benchRun(msg.count, canvas);
+      // Clear the benchmark patterns from the frame buffer.
+      canvas.fillScreen(0);
+      matrix.show();
       break;
-    case Command::darkfield:
-      darkfield(msg, matrix);
+    case Command::version:
+      Serial.print(F("version "));
+      Serial.print(FIRMWARE_VERSION);
+      Serial.print(' ');
+      Serial.println(F(__DATE__ " " __TIME__));
       break;
-    case Command::phaseTop:
-      phaseTop(msg, matrix);
+    case Command::undef:
+      macroClear(msg.slot);
       break;
-    case Command::phaseBottom:
-      phaseBottom(msg, matrix);
+    case Command::save:
+      macroSave();
       break;
-    case Command::phaseRight:
-      phaseRight(msg, matrix);
+    case Command::macros:
+      macroPrint();
       break;
-    case Command::phaseLeft:
-      phaseLeft(msg, matrix);
+    case Command::boot:
+      macroSetBoot(msg.slot);
       break;
     case Command::help:
       printHelp();
@@ -104,4 +362,5 @@ void doAction(const Message& msg, Adafruit_Protomatter& matrix) {
     default:
       break;
   }
+  return true;
 }
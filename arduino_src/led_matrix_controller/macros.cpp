@@ -0,0 +1,115 @@
+#include <Arduino.h>
+#include <FlashStorage.h>
+
+#include "drawing.h"
+#include "macros.h"
+
+// Tells a saved table from erased flash. Change it when the layout of MacroTable changes.
+const uint32_t MACRO_MAGIC = 0x4d414331; // "MAC1"
+
+// A parsed drawing command in the compact form in which it is stored.
+typedef struct {
+  uint8_t cmd;
+  uint8_t r;
+  uint8_t r_out;
+  uint8_t count;
+  uint8_t state;
+  int16_t x;
+  int16_t y;
+} MacroStep;
+
+typedef struct {
+  uint32_t magic;
+  int8_t boot_slot;
+  uint8_t lengths[MACRO_SLOTS];
+  MacroStep steps[MACRO_SLOTS][MACRO_LENGTH];
+} MacroTable;
+
+FlashStorage(macroStore, MacroTable);
+
+static MacroTable table;
+
+static bool validSlot(int slot) {
+  return slot >= 0 && (size_t)slot < MACRO_SLOTS;
+}
+
+int macroInit() {
+  table = macroStore.read();
+  if (table.magic != MACRO_MAGIC) {
+    memset(&table, 0, sizeof(table));
+    table.magic = MACRO_MAGIC;
+    table.boot_slot = -1;
+  }
+  return table.boot_slot;
+}
+
+bool macroAppend(int slot, const Message& msg) {
+  if (!validSlot(slot) || table.lengths[slot] == MACRO_LENGTH) {
+    return false;
+  }
+  if (!isDrawingCommand(msg.cmd) || msg.cmd == Command::recall) {
+    return false;
+  }
+
+  MacroStep& step = table.steps[slot][table.lengths[slot]++];
+  step.cmd = (uint8_t)msg.cmd;
+  step.r = msg.r;
+  step.r_out = msg.r_out;
+  step.count = msg.count;
+  step.state = msg.state;
+  step.x = msg.x;
+  step.y = msg.y;
+  return true;
+}
+
+bool macroClear(int slot) {
+  if (!validSlot(slot)) {
+    return false;
+  }
+  table.lengths[slot] = 0;
+  return true;
+}
+
+size_t macroLength(int slot) {
+  return validSlot(slot) ? table.lengths[slot] : 0;
+}
+
+bool macroSetBoot(int slot) {
+  if (slot != -1 && !validSlot(slot)) {
+    return false;
+  }
+  table.boot_slot = slot;
+  return true;
+}
+
+void macroSave() {
+  macroStore.write(table);
+}
+
+void macroDraw(int slot, Adafruit_GFX& canvas) {
+  static Message msg;
+  for (size_t i = 0; i < macroLength(slot); i++) {
+    const MacroStep& step = table.steps[slot][i];
+    msg.cmd = (Command)step.cmd;
+    msg.x = step.x;
+    msg.y = step.y;
+    msg.r = step.r;
+    msg.r_out = step.r_out;
+    msg.count = step.count;
+    msg.state = step.state;
+    drawPattern(msg, canvas);
+  }
+}
+
+void macroPrint() {
+  Serial.print(F("boot "));
+  Serial.println(table.boot_slot);
+  for (size_t slot = 0; slot < MACRO_SLOTS; slot++) {
+    if (table.lengths[slot] > 0) {
+      Serial.print(F("macro "));
+      Serial.print(slot);
+      Serial.print(' ');
+      Serial.println(table.lengths[slot]);
+    }
+  }
+}
@@ -0,0 +1,57 @@
+/// Pattern macros stored in flash.
+///
+/// A macro is a short sequence of drawing commands in one of MACRO_SLOTS slots. The commands are
+/// stored parsed, so recalling a macro with `@<slot>` costs no more parsing than a three character
+/// command, however long the commands were. Macros can be preloaded and scheduled like any other
+/// drawing command. `save` writes all macros and the boot macro to flash, from where they are
+/// loaded again at startup. Uploading a new sketch erases them.
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <Adafruit_GFX.h>
+
+#include "comms.h"
+
+// The number of macro slots.
+const size_t MACRO_SLOTS = 16;
+
+// The maximum number of drawing commands per macro.
+const size_t MACRO_LENGTH = 8;
+
+// Load the macros from flash. Slots are empty if nothing has been saved yet.
+//
+// Returns the slot of the boot macro, or -1 if there is none.
+int macroInit();
+
+// Append a drawing command to the macro in a slot.
+//
+// Returns false if the slot does not exist or is full, or if the command is not a drawing command
+// or is itself a recall.
+bool macroAppend(int slot, const Message& msg);
+
+// Remove all commands from the macro in a slot. Returns false if the slot does not exist.
+bool macroClear(int slot);
+
+// The number of commands in the macro in a slot, or 0 if the slot does not exist.
+size_t macroLength(int slot);
+
+// Set the macro that is displayed at startup. -1 displays none. Returns false if the slot does not
+// exist.
+bool macroSetBoot(int slot);
+
+// Write all macros and the boot macro to flash.
+//
+// Writing erases and rewrites whole flash rows and takes tens of milliseconds. The flash endures
+// about 10000 writes, so save after defining macros rather than per acquisition.
+void macroSave();
+
+// Draw the commands of the macro in a slot on the LED canvas, in the order they were defined.
+void macroDraw(int slot, Adafruit_GFX& canvas);
+
+// Prints the boot macro and the length of every non-empty macro to Serial.
+//
+// The first line has the format "boot <slot>", followed by one line "macro <slot> <length>" per
+// non-empty slot.
+void macroPrint();
+
+#endif // #MACROS_H
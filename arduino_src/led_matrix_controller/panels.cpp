@@ -0,0 +1,49 @@
+#include <Adafruit_GFX.h>
+#include <Adafruit_Protomatter.h>
+
+#include "panels.h"
+
+PanelLayout::PanelLayout(Adafruit_Protomatter& matrix)
+    : Adafruit_GFX(PANEL_SIZE * CHAIN_LENGTH, PANEL_SIZE),
+      matrix(matrix),
+      panels_x(CHAIN_LENGTH),
+      panels_y(1),
+      serpentine(false) {}
+
+bool PanelLayout::setGeometry(uint8_t panels_x, uint8_t panels_y, bool serpentine) {
+  if (panels_x == 0 || panels_y == 0 || panels_x * panels_y > CHAIN_LENGTH) {
+    return false;
+  }
+  this->panels_x = panels_x;
+  this->panels_y = panels_y;
+  this->serpentine = serpentine;
+  _width = panels_x * PANEL_SIZE;
+  _height = panels_y * PANEL_SIZE;
+  return true;
+}
+
+void PanelLayout::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) {
+    return;
+  }
+
+  uint8_t tile_x = x / PANEL_SIZE;
+  uint8_t tile_y = y / PANEL_SIZE;
+  int16_t local_x = x % PANEL_SIZE;
+  int16_t local_y = y % PANEL_SIZE;
+
+  if (serpentine && (tile_y % 2)) {
+    tile_x = panels_x - 1 - tile_x;
+    local_x = PANEL_SIZE - 1 - local_x;
+    local_y = PANEL_SIZE - 1 - local_y;
+  }
+
+  uint8_t panel = tile_y * panels_x + tile_x;
+  matrix.drawPixel(panel * PANEL_SIZE + local_x, local_y, color);
+}
+
+void PanelLayout::fillScreen(uint16_t color) {
+  // Every panel in the chain is covered by the tiling or unused, so filling the whole chain is
+  // equivalent and much faster than filling pixel by pixel.
+  matrix.fillScreen(color);
+}
@@ -0,0 +1,45 @@
+/// Geometry of chained LED matrix panels.
+///
+/// Several panels can be daisy-chained on a single Protomatter output. Protomatter treats the
+/// chain as one long, PANEL_SIZE pixel tall matrix. This module arranges the panels of the chain
+/// into a rectangular tiling and maps global LED coordinates onto the chain, so that drawing
+/// commands work in global coordinates regardless of how the panels are wired.
+#ifndef PANELS_H
+#define PANELS_H
+
+#include <Adafruit_GFX.h>
+#include <Adafruit_Protomatter.h>
+
+// The number of LEDs along each side of a single, square panel.
+const uint8_t PANEL_SIZE = 32;
+
+// The number of panels in the chain. Protomatter is set up for the full chain length, so this
+// determines the RAM used by the frame buffer.
+const uint8_t CHAIN_LENGTH = 1;
+
+// A canvas in global LED coordinates that draws onto a chain of panels.
+//
+// Panels are numbered in chain order starting from the one closest to the controller. Panel i
+// covers tile (i % panels_x, i / panels_x) of the tiling. In a serpentine layout, every odd row of
+// tiles runs from right to left instead, and its panels are rotated by 180 degrees. This is how
+// tiles are usually wired to keep the ribbon cables short.
+class PanelLayout : public Adafruit_GFX {
+ public:
+  PanelLayout(Adafruit_Protomatter& matrix);
+
+  // Arrange the chain into panels_x by panels_y tiles.
+  //
+  // Returns false if the tiling needs more panels than there are in the chain.
+  bool setGeometry(uint8_t panels_x, uint8_t panels_y, bool serpentine);
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void fillScreen(uint16_t color) override;
+
+ private:
+  Adafruit_Protomatter& matrix;
+  uint8_t panels_x;
+  uint8_t panels_y;
+  bool serpentine;
+};
+
+#endif // #PANELS_H
@@ -0,0 +1,108 @@
+#include <Arduino.h>
+
+#include "rxbuffer.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Ring buffer
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// The interrupt handler only writes head and the main loop only writes tail. Both indexes grow
+// without bound and are reduced modulo the buffer size, so head - tail is the fill level.
+static char buffer[RX_BUFFER_SIZE];
+static volatile uint32_t head = 0;
+static volatile uint32_t tail = 0;
+
+static volatile RxStats stats;
+
+// Move the bytes that are waiting in Serial into the ring buffer. Runs in interrupt context.
+//
+// When the ring buffer is full, the remaining bytes stay in the USB buffers, whose NAKs hold the
+// host back until the main loop has made room.
+static void rxPump() {
+  while (Serial.available()) {
+    uint32_t fill = head - tail;
+    if (fill >= RX_BUFFER_SIZE) {
+      stats.overflows = stats.overflows + 1;
+      break;
+    }
+    buffer[head % RX_BUFFER_SIZE] = Serial.read();
+    head = head + 1;
+    stats.bytes = stats.bytes + 1;
+    if (fill + 1 > stats.high_water) {
+      stats.high_water = fill + 1;
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Hardware timer
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TC5 runs from the 48 MHz GCLK0 with a prescaler of 64 and fires periodically at RX_PUMP_HZ.
+static void timerSync() {
+  while (TC5->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+static void timerBegin() {
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TC4_TC5;
+  while (GCLK->STATUS.bit.SYNCBUSY);
+
+  TC5->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  timerSync();
+  while (TC5->COUNT16.CTRLA.bit.SWRST);
+
+  TC5->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV64;
+  timerSync();
+  TC5->COUNT16.CC[0].reg = F_CPU / 64 / RX_PUMP_HZ - 1;
+  timerSync();
+  TC5->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+  // Lowest priority: the USB interrupt that feeds Serial, the matrix refresh and the schedule
+  // timer all preempt the pump.
+  NVIC_SetPriority(TC5_IRQn, 3);
+  NVIC_EnableIRQ(TC5_IRQn);
+
+  TC5->COUNT16.CTRLA.bit.ENABLE = 1;
+  timerSync();
+}
+
+void TC5_Handler() {
+  TC5->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  rxPump();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Public interface
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void rxInit() {
+  RxStats discard;
+  rxGetStats(discard);
+  timerBegin();
+}
+
+bool rxRead(char& c) {
+  if (head == tail) {
+    return false;
+  }
+  c = buffer[tail % RX_BUFFER_SIZE];
+  tail = tail + 1;
+  return true;
+}
+
+void rxLineTruncated() {
+  noInterrupts();
+  stats.truncated = stats.truncated + 1;
+  interrupts();
+}
+
+void rxGetStats(RxStats& out) {
+  noInterrupts();
+  out.bytes = stats.bytes;
+  out.overflows = stats.overflows;
+  out.truncated = stats.truncated;
+  out.high_water = stats.high_water;
+
+  stats.bytes = 0;
+  stats.overflows = 0;
+  stats.truncated = 0;
+  stats.high_water = head - tail;
+  interrupts();
+}
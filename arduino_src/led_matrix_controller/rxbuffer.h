@@ -0,0 +1,43 @@
+/// Interrupt-driven serial receive buffer.
+///
+/// A timer interrupt moves incoming bytes from Serial into a lock-free single-producer/
+/// single-consumer ring buffer. Reception therefore continues while the main loop renders patterns
+/// or prints long messages, and the main loop parses complete lines from the buffer.
+#ifndef RXBUFFER_H
+#define RXBUFFER_H
+
+#include <Arduino.h>
+
+// The capacity of the ring buffer in bytes. Must be a power of two.
+const size_t RX_BUFFER_SIZE = 256;
+
+// The rate at which the timer interrupt drains Serial. Serial is the native USB CDC port, so BAUD
+// has no effect on the link. The host sends 64-byte full-speed bulk packets, and the USB core NAKs
+// further packets while its two packet buffers are full, so no byte is lost before the pump. At
+// 2 kHz the pump empties both buffers every 500 us. That caps reception at 256 kB/s and delays a
+// line by at most 500 us before the main loop can parse it. While the ring buffer is full, the
+// pump leaves the bytes in the USB buffers, so the NAKs throttle the host instead of input being
+// lost. Such stalls are counted in RxStats::overflows.
+const uint32_t RX_PUMP_HZ = 2000;
+
+// Receive statistics.
+typedef struct {
+  unsigned long bytes;      // bytes moved into the ring buffer
+  unsigned long overflows;  // pump calls that left input in Serial because the ring buffer was full
+  unsigned long truncated;  // lines that were cut off at the character limit
+  size_t high_water;        // the maximum number of bytes held by the ring buffer
+} RxStats;
+
+// Initialize the ring buffer and start the timer interrupt that fills it.
+void rxInit();
+
+// Remove one byte from the ring buffer. Returns false if the buffer is empty.
+bool rxRead(char& c);
+
+// Record that a line was cut off at the character limit.
+void rxLineTruncated();
+
+// Get the receive statistics and reset them.
+void rxGetStats(RxStats& stats);
+
+#endif // #RXBUFFER_H
@@ -0,0 +1,195 @@
+#include <Arduino.h>
+
+#include "comms.h"
+#include "schedule.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Schedule state
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Entries are only modified while playback is stopped, so the interrupt handler can read them
+// without locking.
+static Message entries[SCHEDULE_SIZE];
+static size_t numEntries = 0;
+
+static volatile bool running = false;
+static volatile size_t next = 0;
+static volatile unsigned long cycle = 0;
+static volatile unsigned long underruns = 0;
+static volatile int pending = -1; // index of the entry that is due but not yet rendered
+
+static unsigned long periodUs = 0;
+static unsigned long numCycles = 0;
+static unsigned long cycleStart = 0;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Hardware timer
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TC3 is used because Protomatter drives the matrix refresh from TC4 on the SAMD21. It runs from
+// the 48 MHz GCLK0 with a prescaler of 16, i.e. at 3 ticks per microsecond. The longest delay
+// that fits into the 16-bit counter is about 21 ms; longer delays re-arm the timer from the
+// interrupt handler until the entry is due.
+const uint32_t TICKS_PER_US = 3;
+const uint32_t MAX_TICKS    = 0xFFFF;
+
+static void timerSync() {
+  while (TC3->COUNT16.STATUS.bit.SYNCBUSY);
+}
+
+static void timerBegin() {
+  GCLK->CLKCTRL.reg = GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_ID_TCC2_TC3;
+  while (GCLK->STATUS.bit.SYNCBUSY);
+
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+  timerSync();
+  while (TC3->COUNT16.CTRLA.bit.SWRST);
+
+  TC3->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_WAVEGEN_MFRQ | TC_CTRLA_PRESCALER_DIV16;
+  timerSync();
+  TC3->COUNT16.INTENSET.reg = TC_INTENSET_MC0;
+
+  // Stay below the priority of the Protomatter refresh so that the display never flickers.
+  NVIC_SetPriority(TC3_IRQn, 2);
+  NVIC_EnableIRQ(TC3_IRQn);
+}
+
+static void timerStop() {
+  TC3->COUNT16.CTRLA.bit.ENABLE = 0;
+  timerSync();
+}
+
+// Fire the timer interrupt once, delay_us microseconds from now.
+static void timerArm(unsigned long delay_us) {
+  uint32_t ticks = delay_us * TICKS_PER_US;
+  if (delay_us > MAX_TICKS / TICKS_PER_US) {
+    ticks = MAX_TICKS;
+  } else if (ticks == 0) {
+    ticks = 1;
+  }
+
+  timerStop();
+  TC3->COUNT16.COUNT.reg = 0;
+  timerSync();
+  TC3->COUNT16.CC[0].reg = ticks;
+  timerSync();
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  TC3->COUNT16.CTRLA.bit.ENABLE = 1;
+  timerSync();
+}
+
+// Mark every entry whose timestamp has passed as due, then re-arm the timer for the next one.
+static void scheduleTick() {
+  while (running) {
+    long elapsed = (long)(micros() - cycleStart);
+
+    if (next == numEntries) {
+      // End of the cycle
+      cycle = cycle + 1;
+      if (numCycles && cycle >= numCycles) {
+        running = false;
+        return;
+      }
+      cycleStart += periodUs;
+      next = 0;
+      continue;
+    }
+
+    long remaining = (long)entries[next].t_us - elapsed;
+    if (remaining > 0) {
+      timerArm(remaining);
+      return;
+    }
+
+    if (pending >= 0) {
+      // The main loop did not render the previous entry in time; it is superseded.
+      underruns = underruns + 1;
+    }
+    pending = next;
+    next = next + 1;
+  }
+}
+
+void TC3_Handler() {
+  TC3->COUNT16.INTFLAG.reg = TC_INTFLAG_MC0;
+  timerStop();
+  scheduleTick();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Public interface
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void scheduleInit() {
+  for (size_t i = 0; i < SCHEDULE_SIZE; i++) {
+    messageInit(entries[i]);
+  }
+  timerBegin();
+}
+
+bool scheduleAdd(const Message& msg) {
+  if (running || numEntries == SCHEDULE_SIZE) {
+    return false;
+  }
+  if (numEntries > 0 && msg.t_us < entries[numEntries - 1].t_us) {
+    return false;
+  }
+  entries[numEntries++] = msg;
+  return true;
+}
+
+bool scheduleClear() {
+  if (running) {
+    return false;
+  }
+  numEntries = 0;
+  return true;
+}
+
+bool scheduleStart(unsigned long period_us, unsigned long cycles) {
+  if (running || numEntries == 0 || entries[numEntries - 1].t_us >= period_us) {
+    return false;
+  }
+
+  periodUs = period_us;
+  numCycles = cycles;
+  next = 0;
+  cycle = 0;
+  underruns = 0;
+  pending = -1;
+  cycleStart = micros();
+  running = true;
+
+  noInterrupts();
+  scheduleTick();
+  interrupts();
+  return true;
+}
+
+void scheduleStop() {
+  noInterrupts();
+  running = false;
+  pending = -1;
+  timerStop();
+  interrupts();
+}
+
+bool schedulePoll(const Message*& msg) {
+  noInterrupts();
+  int index = pending;
+  pending = -1;
+  interrupts();
+
+  if (index < 0) {
+    return false;
+  }
+  msg = &entries[index];
+  return true;
+}
+
+void scheduleGetStatus(ScheduleStatus& status) {
+  noInterrupts();
+  status.running = running;
+  status.num_entries = numEntries;
+  status.next = next;
+  status.cycle = cycle;
+  status.underruns = underruns;
+  interrupts();
+}
@@ -0,0 +1,57 @@
+/// Autonomous pattern playback.
+///
+/// This module stores a schedule of (timestamp, pattern) entries and plays them back without any
+/// involvement from the host. A hardware timer interrupt marks each entry as due at its timestamp,
+/// and the main loop renders due entries as soon as it polls the schedule. Timing therefore does
+/// not depend on the serial link, only on how quickly loop() comes back around.
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "comms.h"
+
+// The maximum number of entries in the schedule.
+const size_t SCHEDULE_SIZE = 64;
+
+// A snapshot of the state of the schedule.
+typedef struct {
+  bool running;
+  size_t num_entries;
+  size_t next;              // index of the next entry that will become due
+  unsigned long cycle;      // number of completed cycles
+  unsigned long underruns;  // entries that became due before the previous one was rendered
+} ScheduleStatus;
+
+// Initialize the schedule and its hardware timer.
+void scheduleInit();
+
+// Append a deferred message to the schedule.
+//
+// Returns false if the schedule is running or full, or if the timestamp of the message precedes
+// that of the last entry.
+bool scheduleAdd(const Message& msg);
+
+// Remove all entries from the schedule. Returns false if the schedule is running.
+bool scheduleClear();
+
+// Start playback.
+//
+// The entry timestamps are offsets from the start of each cycle. A new cycle starts every
+// period_us microseconds. Playback stops after `cycles` cycles, or never if `cycles` is 0.
+//
+// Returns false if the schedule is empty, already running, or if the last entry does not fit
+// within the period.
+bool scheduleStart(unsigned long period_us, unsigned long cycles);
+
+// Stop playback.
+void scheduleStop();
+
+// Get the entry that has become due, if any.
+//
+// Returns true and sets `msg` to point to the entry if an entry is due. Each due entry is
+// returned only once.
+bool schedulePoll(const Message*& msg);
+
+// Get a snapshot of the schedule state.
+void scheduleGetStatus(ScheduleStatus& status);
+
+#endif // #SCHEDULE_H
@@ -0,0 +1,171 @@
+#include <Arduino.h>
+
+#include "comms.h"
+#include "sync.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Synchronization state
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// The preload queue is a single-producer/single-consumer ring. The main loop appends to it and the
+// sync interrupt handler consumes from it. One slot always stays free to tell a full ring from an
+// empty one, so the ring has PRELOAD_SIZE + 1 slots.
+const size_t QUEUE_SLOTS = PRELOAD_SIZE + 1;
+static Message queue[QUEUE_SLOTS];
+static volatile size_t head = 0; // next slot to latch; written by the interrupt handler
+static volatile size_t tail = 0; // next free slot; written by the main loop
+static volatile size_t start = 0; // first slot of the cycle
+static volatile bool cycling = false;
+
+static SyncMode mode = SyncMode::off;
+static volatile int latched = -1; // slot latched by the last edge and not yet polled
+static volatile unsigned long edgeTime = 0;
+static unsigned long renderEdgeTime = 0; // edge time of the pattern that is being rendered
+
+static volatile SyncStats stats;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Sync edge
+///////////////////////////////////////////////////////////////////////////////////////////////////
+static void onSyncEdge() {
+  unsigned long now = micros();
+  stats.edges = stats.edges + 1;
+
+  if (head == tail) {
+    stats.empty = stats.empty + 1;
+    return;
+  }
+  if (latched >= 0) {
+    // The previous pattern is superseded before it was ever displayed.
+    stats.missed = stats.missed + 1;
+  }
+  latched = head;
+  edgeTime = now;
+  head = (head + 1) % QUEUE_SLOTS;
+  if (cycling && head == tail) {
+    head = start;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Public interface
+///////////////////////////////////////////////////////////////////////////////////////////////////
+void syncInit() {
+  for (size_t i = 0; i < QUEUE_SLOTS; i++) {
+    messageInit(queue[i]);
+  }
+  syncSetMode(SyncMode::off);
+  SyncStats discard;
+  syncGetStats(discard);
+}
+
+void syncSetMode(SyncMode newMode) {
+  detachInterrupt(digitalPinToInterrupt(SYNC_PIN));
+  mode = newMode;
+
+  switch (mode) {
+    case SyncMode::leader:
+      pinMode(SYNC_PIN, OUTPUT);
+      digitalWrite(SYNC_PIN, LOW);
+      break;
+    case SyncMode::follower:
+      pinMode(SYNC_PIN, INPUT);
+      attachInterrupt(digitalPinToInterrupt(SYNC_PIN), onSyncEdge, RISING);
+      break;
+    default:
+      pinMode(SYNC_PIN, INPUT);
+      break;
+  }
+}
+
+bool syncPreload(const Message& msg) {
+  size_t next = (tail + 1) % QUEUE_SLOTS;
+  // While cycling, the slots from start to head still hold patterns of the cycle.
+  if (next == head || (cycling && next == start)) {
+    return false;
+  }
+  queue[tail] = msg;
+  tail = next;
+  return true;
+}
+
+void syncClearPreload() {
+  noInterrupts();
+  head = tail;
+  start = tail;
+  latched = -1;
+  interrupts();
+}
+
+void syncSetCycle(bool cycle) {
+  noInterrupts();
+  cycling = cycle;
+  start = head;
+  interrupts();
+}
+
+bool syncAdvance() {
+  if (mode != SyncMode::leader) {
+    return false;
+  }
+
+  // The leader latches at the rising edge, just like the followers do in their interrupt handler.
+  noInterrupts();
+  digitalWrite(SYNC_PIN, HIGH);
+  onSyncEdge();
+  interrupts();
+  delayMicroseconds(SYNC_PULSE_US);
+  digitalWrite(SYNC_PIN, LOW);
+  return true;
+}
+
+bool syncPoll(const Message*& msg) {
+  noInterrupts();
+  int slot = latched;
+  latched = -1;
+  renderEdgeTime = edgeTime;
+  interrupts();
+
+  if (slot < 0) {
+    return false;
+  }
+  msg = &queue[slot];
+  return true;
+}
+
+void syncRendered() {
+  unsigned long latency = micros() - renderEdgeTime;
+
+  noInterrupts();
+  if (stats.rendered == 0 || latency < stats.min_us) {
+    stats.min_us = latency;
+  }
+  if (latency > stats.max_us) {
+    stats.max_us = latency;
+  }
+  stats.last_us = latency;
+  stats.total_us = stats.total_us + latency;
+  stats.rendered = stats.rendered + 1;
+  interrupts();
+}
+
+void syncGetStats(SyncStats& out) {
+  noInterrupts();
+  out.edges = stats.edges;
+  out.rendered = stats.rendered;
+  out.missed = stats.missed;
+  out.empty = stats.empty;
+  out.last_us = stats.last_us;
+  out.min_us = stats.min_us;
+  out.max_us = stats.max_us;
+  out.total_us = stats.total_us;
+
+  stats.edges = 0;
+  stats.rendered = 0;
+  stats.missed = 0;
+  stats.empty = 0;
+  stats.last_us = 0;
+  stats.min_us = 0;
+  stats.max_us = 0;
+  stats.total_us = 0;
+  interrupts();
+}
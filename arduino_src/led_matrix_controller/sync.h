@@ -0,0 +1,68 @@
+/// Lock-step synchronization of several controllers.
+///
+/// Controllers that drive different parts of an illuminator share a sync line. Each controller
+/// holds a queue of preloaded patterns. The leader raises the sync line on the `advance` command,
+/// and on that edge every controller, the leader included, latches the next pattern in its queue.
+/// The main loop renders the latched pattern, and the time from the edge until the pattern is
+/// displayed is recorded so that the skew between controllers can be reported.
+#ifndef SYNC_H
+#define SYNC_H
+
+#include "comms.h"
+
+// The pin that is connected to the shared sync line.
+const uint8_t SYNC_PIN = 11;
+
+// The width of the pulse that the leader puts on the sync line.
+const unsigned int SYNC_PULSE_US = 5;
+
+// The maximum number of preloaded patterns.
+const size_t PRELOAD_SIZE = 64;
+
+// Latency statistics from sync edges to displayed patterns.
+typedef struct {
+  unsigned long edges;      // number of sync edges seen
+  unsigned long rendered;   // number of patterns displayed after an edge
+  unsigned long missed;     // edges that arrived before the previous pattern was displayed
+  unsigned long empty;      // edges that arrived while the preload queue was empty
+  unsigned long last_us;
+  unsigned long min_us;
+  unsigned long max_us;
+  unsigned long total_us;
+} SyncStats;
+
+// Initialize synchronization. The controller starts with synchronization off.
+void syncInit();
+
+// Set the role of this controller.
+void syncSetMode(SyncMode mode);
+
+// Append a pattern to the preload queue. Returns false if the queue is full.
+bool syncPreload(const Message& msg);
+
+// Remove all patterns from the preload queue.
+void syncClearPreload();
+
+// Repeat the preloaded patterns.
+//
+// While cycling, latched patterns stay in the queue, and the edge after the last pattern latches
+// the pattern that was next when cycling was switched on. Patterns preloaded meanwhile join the
+// cycle. Their slots only become free again when cycling is switched off.
+void syncSetCycle(bool cycle);
+
+// Raise the sync line. Returns false if this controller is not the leader.
+bool syncAdvance();
+
+// Get the pattern that was latched by the last sync edge, if any.
+//
+// Returns true and sets `msg` to point to the pattern if one has been latched. Each latched
+// pattern is returned only once.
+bool syncPoll(const Message*& msg);
+
+// Record that the pattern returned by the last call to syncPoll has been displayed.
+void syncRendered();
+
+// Get the latency statistics and reset them.
+void syncGetStats(SyncStats& stats);
+
+#endif // #SYNC_H
@@ -0,0 +1,80 @@
+#include <Arduino.h>
+
+#include "telemetry.h"
+
+const uint32_t CYCLES_PER_US = F_CPU / 1000000;
+
+typedef struct {
+  uint32_t count;
+  uint32_t min_cycles;
+  uint32_t max_cycles;
+  uint64_t total_cycles;
+  uint32_t buckets[NUM_BUCKETS];
+} Histogram;
+
+static Histogram histograms[(size_t)Stage::numStages];
+
+static const char* const STAGE_NAMES[] = {"parse", "render", "show", "dither"};
+
+uint32_t cycleCount() {
+  uint32_t ms;
+  uint32_t ticks;
+  // Re-read if the millisecond counter changed in the meantime so that both values belong to the
+  // same SysTick period.
+  do {
+    ms = millis();
+    ticks = SysTick->VAL;
+  } while (ms != millis());
+
+  uint32_t reload = SysTick->LOAD;
+  return ms * (reload + 1) + (reload - ticks);
+}
+
+void telemetryRecord(Stage stage, uint32_t cycles) {
+  Histogram& h = histograms[(size_t)stage];
+
+  if (h.count == 0 || cycles < h.min_cycles) {
+    h.min_cycles = cycles;
+  }
+  if (cycles > h.max_cycles) {
+    h.max_cycles = cycles;
+  }
+  h.count++;
+  h.total_cycles += cycles;
+
+  uint32_t us = cycles / CYCLES_PER_US;
+  size_t bucket = 0;
+  while (us > 1 && bucket < NUM_BUCKETS - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  h.buckets[bucket]++;
+}
+
+void telemetryPrint() {
+  for (size_t i = 0; i < (size_t)Stage::numStages; i++) {
+    const Histogram& h = histograms[i];
+    uint32_t mean_cycles = h.count ? h.total_cycles / h.count : 0;
+
+    Serial.print(F("stats "));
+    Serial.print(STAGE_NAMES[i]);
+    Serial.print(' ');
+    Serial.print(h.count);
+    Serial.print(' ');
+    Serial.print(h.min_cycles / CYCLES_PER_US);
+    Serial.print(' ');
+    Serial.print(mean_cycles / CYCLES_PER_US);
+    Serial.print(' ');
+    Serial.print(h.max_cycles / CYCLES_PER_US);
+    for (size_t j = 0; j < NUM_BUCKETS; j++) {
+      Serial.print(' ');
+      Serial.print(h.buckets[j]);
+    }
+    Serial.println();
+  }
+  telemetryReset();
+}
+
+void telemetryReset() {
+  memset(histograms, 0, sizeof(histograms));
+}
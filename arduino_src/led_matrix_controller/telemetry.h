@@ -0,0 +1,40 @@
+/// Hot-path telemetry.
+///
+/// This module measures how long each stage of the main loop takes and aggregates the results
+/// into fixed-bucket histograms in RAM. Recording a sample does not allocate and costs a few
+/// hundred nanoseconds.
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+// The stages of the main loop that are measured.
+//
+// dither is the cost of one dithering subframe, including its matrix.show().
+enum class Stage {parse, render, show, dither, numStages};
+
+// The number of histogram buckets per stage.
+//
+// Bucket i counts durations in [2^i, 2^(i + 1)) microseconds, except that bucket 0 also counts
+// durations below 1 us and the last bucket counts everything longer.
+const size_t NUM_BUCKETS = 16;
+
+// Returns a free-running CPU cycle count.
+//
+// The Cortex-M0+ has no cycle counter, so the count is derived from SysTick, which counts down
+// once per millisecond, and the millisecond counter. The count wraps around about every 89 s;
+// differences between two counts are correct as long as they span less than that.
+uint32_t cycleCount();
+
+// Records the duration of one execution of a stage.
+void telemetryRecord(Stage stage, uint32_t cycles);
+
+// Prints one line per stage to Serial and resets the statistics.
+//
+// Each line has the format "stats <stage> <count> <min_us> <mean_us> <max_us> <bucket 0> ...".
+void telemetryPrint();
+
+// Resets the statistics of all stages.
+void telemetryReset();
+
+#endif // #TELEMETRY_H
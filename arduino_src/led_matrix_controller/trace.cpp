@@ -0,0 +1,49 @@
+#include "trace.h"
+
+static TraceEvent events[TRACE_SIZE];
+static size_t head = 0;       // index of the oldest event
+static size_t numEvents = 0;
+static uint16_t nextSeq = 0;
+static unsigned long lost = 0;
+
+void traceRecord(const Message& msg, TraceSource source) {
+  size_t tail = (head + numEvents) % TRACE_SIZE;
+  if (numEvents == TRACE_SIZE) {
+    head = (head + 1) % TRACE_SIZE;
+    lost++;
+  } else {
+    numEvents++;
+  }
+
+  TraceEvent& event = events[tail];
+  event.t_us = micros();
+  event.seq = nextSeq++;
+  event.cmd = (uint8_t)msg.cmd;
+  event.source = (uint8_t)source;
+  event.x = msg.x;
+  event.y = msg.y;
+  event.r = msg.r;
+  event.r_out = msg.r_out;
+  event.count = msg.cmd == Command::recall ? msg.slot : msg.count;
+  event.state = msg.state;
+}
+
+void tracePrint() {
+  Serial.print(F("trace "));
+  Serial.print(numEvents);
+  Serial.print(' ');
+  Serial.println(lost);
+
+  char hex[2 * sizeof(TraceEvent) + 1];
+  for (size_t i = 0; i < numEvents; i++) {
+    const uint8_t* bytes = (const uint8_t*)&events[(head + i) % TRACE_SIZE];
+    for (size_t j = 0; j < sizeof(TraceEvent); j++) {
+      sprintf(hex + 2 * j, "%02x", bytes[j]);
+    }
+    Serial.println(hex);
+  }
+
+  head = 0;
+  numEvents = 0;
+  lost = 0;
+}
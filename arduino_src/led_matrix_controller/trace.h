@@ -0,0 +1,48 @@
+/// On-device event trace.
+///
+/// Every displayed pattern is recorded as a fixed-size binary event in a ring buffer in RAM. The
+/// host downloads the buffer in bulk with the `trace` command after an acquisition and aligns the
+/// events with the camera frames, so that dropped or misaligned frames are found without a round
+/// trip per frame. When the buffer is full, the oldest events are overwritten; the running
+/// sequence number tells the host how many were lost.
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+#include "comms.h"
+
+// The number of events in the ring buffer. Each event takes 16 bytes of RAM.
+const size_t TRACE_SIZE = 512;
+
+// What caused a pattern to be displayed.
+enum class TraceSource : uint8_t {command, schedule, sync};
+
+// A displayed pattern. The layout is little endian and packed so that the host can decode the
+// records byte by byte.
+typedef struct __attribute__((packed)) {
+  uint32_t t_us;    // micros() right after the pattern was displayed
+  uint16_t seq;     // running event number, wraps around at 2^16
+  uint8_t cmd;      // the Command
+  uint8_t source;   // the TraceSource
+  int16_t x;
+  int16_t y;
+  uint8_t r;
+  uint8_t r_out;
+  uint8_t count;    // the slot for recall
+  uint8_t state;
+} TraceEvent;
+
+static_assert(sizeof(TraceEvent) == 16, "TraceEvent must be 16 bytes");
+
+// Record that the pattern in the message has just been displayed.
+void traceRecord(const Message& msg, TraceSource source);
+
+// Prints the buffered events to Serial, oldest first, and empties the buffer.
+//
+// The first line has the format "trace <count> <lost>", where lost is the number of events that
+// were overwritten since the last dump. It is followed by one line per event with the 16 bytes of
+// the event in hexadecimal.
+void tracePrint();
+
+#endif // #TRACE_H
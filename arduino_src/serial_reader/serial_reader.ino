@@ -1,60 +1,126 @@
+// Serial link benchmark
+//
+// Answers timestamped ping frames so that the host can measure the round-trip latency and the
+// sustained throughput of the serial link for different frame sizes and baud rates. The host side
+// is `leb.ptycho.linkbench` and the `link_benchmark` script.
+//
+// Frames are lines of printable ASCII characters:
+//
+//   P <seq> <payload>\n   ->  p <seq> <rx_us> <tx_us> <payload>\n
+//   B <baud>\n            ->  b <baud>\n, then the port is reopened at the new baud rate
+//   anything else         ->  e <reason>\n
+//
+// `rx_us` is the value of micros() when the first byte of the ping arrived and `tx_us` is its value
+// just before the answer is written. The payload is echoed unchanged, so the answer is as large as
+// the ping plus the timestamps.
 const uint32_t BAUD = 9600;
-const size_t CHAR_LIMIT = 20;
+const size_t FRAME_LIMIT = 256;
 const char LINE_TERMINATOR = '\n';
+const unsigned long READ_TIMEOUT_US = 1000000;
 
-String input;
+char frame[FRAME_LIMIT];
+size_t frameLength = 0;
+bool frameTruncated = false;
+uint32_t frameStartUs = 0;
+uint32_t lastByteUs = 0;
 
 void setup() {
   Serial.begin(BAUD);
 }
 
 void loop() {
-  if (readStringUntil(input, LINE_TERMINATOR, CHAR_LIMIT)) {
-    if (input[input.length() - 1] == LINE_TERMINATOR) {
-      Serial.print(F(" got a line of input '")); Serial.print(input); Serial.println("'");
+  if (readFrame()) {
+    if (frameTruncated) {
+      Serial.println(F("e frame too long"));
     } else {
-      Serial.print(F(" reached limit or timeout without receiving line terminator '")); Serial.print(input); Serial.println("'");
+      handleFrame();
     }
 
-    // Clear the input buffer to prepare for the next line.
-    input = "";
+    // Clear the input buffer to prepare for the next frame.
+    frameLength = 0;
+    frameTruncated = false;
   }
 }
 
-// Read from Serial until until_c char found or char limit read or timeout reached.
-// 
-// The function returns true when until_c is found or the input is length limited. Otherwise false
-// is returned. until_c, if found, is returned as last char in String.
+// Read from Serial until the line terminator is found or the timeout is reached.
+//
+// The function returns true when a complete frame is in `frame`, without the terminator and null
+// terminated. Frames that do not fit into the buffer are marked as truncated. A partial frame is
+// discarded if no byte arrives within READ_TIMEOUT_US.
 //
-// If no char limit is desired, then pass 0 for the `char_limit` argument.
-// 
 // This function call is non-blocking.
-bool readStringUntil(String& input, char until_c, size_t char_limit) {
-  static bool timerRunning;
-  static unsigned long timerStart;
-  static const unsigned long timeout_ms = 1000; // 1sec  set to 0 for no timeout
-
+bool readFrame() {
   while (Serial.available()) {
-    timerRunning = false;
-
+    uint32_t now = micros();
     char c = Serial.read();
-    input += c;
-    if (c == until_c) {
-      return true;
+    if (frameLength == 0 && !frameTruncated) {
+      frameStartUs = now;
     }
-    if (char_limit && (input.length() >= char_limit)) {
+    lastByteUs = now;
+
+    if (c == LINE_TERMINATOR) {
+      frame[frameLength] = '\0';
       return true;
     }
-    // Restart timer running if the timeout is non-zero.
-    if (timeout_ms > 0) {
-      timerRunning = true;
-      timerStart = millis();
+    if (frameLength < FRAME_LIMIT - 1) {
+      frame[frameLength++] = c;
+    } else {
+      frameTruncated = true;
     }
   }
 
-  if (timerRunning && ((millis() - timerStart) > timeout_ms)) {
-    timerRunning = false;
-    return true;
+  if ((frameLength > 0 || frameTruncated) && (micros() - lastByteUs > READ_TIMEOUT_US)) {
+    frameLength = 0;
+    frameTruncated = false;
   }
   return false;
-}
\ No newline at end of file
+}
+
+void handleFrame() {
+  if (frameLength < 1) {
+    Serial.println(F("e empty frame"));
+    return;
+  }
+
+  char* end;
+  switch (frame[0]) {
+    case 'P': {
+      unsigned long seq = strtoul(frame + 1, &end, 10);
+      if (end == frame + 1 || (*end != ' ' && *end != '\0')) {
+        Serial.println(F("e invalid sequence number"));
+        return;
+      }
+      const char* payload = (*end == ' ') ? end + 1 : end;
+
+      uint32_t txUs = micros();
+      Serial.print(F("p "));
+      Serial.print(seq);
+      Serial.print(' ');
+      Serial.print(frameStartUs);
+      Serial.print(' ');
+      Serial.print(txUs);
+      Serial.print(' ');
+      Serial.print(payload);
+      Serial.print(LINE_TERMINATOR);
+      break;
+    }
+    case 'B': {
+      unsigned long baud = strtoul(frame + 1, &end, 10);
+      if (end == frame + 1 || *end != '\0' || baud == 0) {
+        Serial.println(F("e invalid baud rate"));
+        return;
+      }
+      Serial.print(F("b "));
+      Serial.print(baud);
+      Serial.print(LINE_TERMINATOR);
+
+      // Let the answer go out at the old baud rate before switching.
+      Serial.flush();
+      Serial.end();
+      Serial.begin(baud);
+      break;
+    }
+    default:
+      Serial.println(F("e unknown frame"));
+  }
+}
@@ -0,0 +1,75 @@
+"""Measures the round trip time of synchronous commands through LEDController.
+
+A thread on the master side of a pseudo-terminal acknowledges every line at once, so the timings
+are dominated by the client. The script compares `send`, which talks to the port directly while
+nothing else is pending, with `send_async(...).result()`, which hands every command to the writer
+and reader threads.
+
+Only Unix-like systems provide pseudo-terminals.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/client_latency.py --num_commands 2000
+```
+
+"""
+import argparse
+import os
+import threading
+import time
+
+import numpy as np
+import serial
+
+from leb.ptycho.client import LEDController
+
+
+def acknowledge(master: int) -> None:
+    """Answers every line written to the pseudo-terminal with an acknowledgement."""
+    while True:
+        try:
+            data = os.read(master, 1024)
+        except OSError:
+            return
+        if not data:
+            return
+        os.write(master, b"0\n" * data.count(b"\n"))
+
+
+def round_trips_us(send, num_commands: int) -> np.ndarray:
+    times = []
+    for _ in range(num_commands):
+        start = time.perf_counter()
+        send("fill 0")
+        times.append(time.perf_counter() - start)
+    return np.array(times) * 1e6
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--num_commands", type=int, default=2000, help="The commands per run.")
+    args = parser.parse_args()
+
+    master, slave = os.openpty()
+    threading.Thread(target=acknowledge, args=(master,), daemon=True).start()
+
+    with LEDController(serial.Serial(os.ttyname(slave), timeout=0.05)) as ctrl:
+        paths = {
+            "send (direct)": ctrl.send,
+            "send_async().result()": lambda cmd: ctrl.send_async(cmd).result(),
+        }
+
+        print(f"{'path':<24} {'median us':>10} {'p99 us':>10}")
+        for name, send in paths.items():
+            round_trips_us(send, args.num_commands // 10)  # warm up
+            times = round_trips_us(send, args.num_commands)
+            print(f"{name:<24} {np.median(times):>10.1f} {np.percentile(times, 99):>10.1f}")
+
+    os.close(master)
+    os.close(slave)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,67 @@
+"""Compares the number of iterations that the update methods of fp_recover need to converge.
+
+Each method reconstructs datasets from fp_simulation() until the data fidelity error falls below a
+target. The datasets have an unaberrated and an aberrated pupil; the Zernike coefficients of the
+aberrated pupil are given in radians.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_convergence.py --target_error 1e-3 --max_iterations 40
+```
+
+"""
+import argparse
+
+from leb.ptycho.fp import ObjectUpdateMethod, PupilRecoveryMethod, fp_recover
+from leb.ptycho.simulation import fp_simulation
+
+
+ABERRATIONS = [0, 0, 0, 0.3, 0.2, -0.2, 0.1, 0, 0, 0]
+
+METHODS = {
+    "rPIE": dict(),
+    "mPIE": dict(object_update_method=ObjectUpdateMethod.mPIE),
+    "rPIE + rPIE pupil": dict(pupil_recovery_method=PupilRecoveryMethod.rPIE),
+    "mPIE + rPIE pupil": dict(
+        object_update_method=ObjectUpdateMethod.mPIE,
+        pupil_recovery_method=PupilRecoveryMethod.rPIE,
+    ),
+    "rPIE + GD pupil": dict(pupil_recovery_method=PupilRecoveryMethod.GD, learning_rate=1e-4),
+    "rPIE + Adam pupil": dict(pupil_recovery_method=PupilRecoveryMethod.ADAM, learning_rate=1e-3),
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--target_error", type=float, default=1e-3, help="The target error.")
+    parser.add_argument("--max_iterations", type=int, default=40, help="The iteration limit.")
+    args = parser.parse_args()
+
+    datasets = {
+        "unaberrated": fp_simulation(),
+        "aberrated": fp_simulation(zernike_coeffs=ABERRATIONS),
+    }
+
+    print(f"{'method':<20} {'dataset':<12} {'iterations':>10} {'error':>10} {'time s':>8}")
+    for name, kwargs in METHODS.items():
+        for dataset_name, (dataset, pupil, _, _) in datasets.items():
+            results = fp_recover(
+                dataset,
+                pupil,
+                num_iterations=args.max_iterations,
+                target_error=args.target_error,
+                **kwargs,
+            )
+            iterations = len(results.history)
+            if results.errors[-1] >= args.target_error:
+                iterations = f">{iterations}"
+            print(
+                f"{name:<20} {dataset_name:<12} {iterations:>10} {results.errors[-1]:>10.3g} "
+                f"{results.history[-1].elapsed_s:>8.2f}"
+            )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+"""Benchmarks the Zernike gradients of the gradient descent pupil recovery.
+
+fp_recover derives the gradient with respect to every Zernike weight from a single inverse FFT. This
+script compares it with the previous implementation, which took one inverse FFT per mode, both for
+the gradient of one image and for one iteration of fp_recover over a simulated dataset.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_gd_gradients.py --num_px 256 --num_modes 10
+```
+
+"""
+import argparse
+import time
+
+import numpy as np
+from numpy.fft import ifft2, ifftshift
+
+from leb.ptycho.fp import (
+    Pupil,
+    PupilRecoveryMethod,
+    _unshifted_index,
+    fp_recover,
+    zernike_gradients,
+)
+from leb.ptycho.simulation import fp_simulation
+
+
+def per_mode_gradients(spectrum, low_res_img, img_diff, unit_zernike_modes):
+    """The previous implementation: one inverse FFT per mode on the full, centered spectrum."""
+    gradients = []
+    for zernike_mode in unit_zernike_modes:
+        gd_temp = ifft2(ifftshift(spectrum * np.pi * zernike_mode))
+        gradients.append(2 * np.sum(img_diff * np.imag(np.conj(low_res_img) * gd_temp)))
+    return np.array(gradients)
+
+
+def best_of(func, repeats: int) -> float:
+    times = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        func()
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--num_px", type=int, default=256, help="The size of the images.")
+    parser.add_argument("--num_modes", type=int, default=10, help="The number of Zernike modes.")
+    parser.add_argument("--repeats", type=int, default=5, help="The runs per measurement.")
+    args = parser.parse_args()
+
+    # Gradient of a single image
+    pupil = Pupil.from_system_params(num_px=args.num_px)
+    rng = np.random.default_rng(0)
+    bbox = pupil.support_bbox
+    fft_idx = _unshifted_index(bbox, args.num_px)
+    modes = np.array([pupil.zernike.unit_mode(j) for j in range(args.num_modes)])
+    spectrum = pupil.p * (rng.normal(size=pupil.p.shape) + 1j * rng.normal(size=pupil.p.shape))
+    low_res_img = ifft2(ifftshift(spectrum))
+    img_diff = rng.normal(size=pupil.p.shape)
+    modes_box = modes[(slice(None), *bbox)]
+
+    t_loop = best_of(
+        lambda: per_mode_gradients(spectrum, low_res_img, img_diff, modes), args.repeats
+    )
+    t_single = best_of(
+        lambda: zernike_gradients(spectrum[bbox], low_res_img, img_diff, modes_box, fft_idx),
+        args.repeats,
+    )
+    print(f"Gradients of one {args.num_px} px image and {args.num_modes} modes")
+    print(f"  one FFT per mode: {t_loop * 1e3:8.2f} ms")
+    print(f"  single FFT:       {t_single * 1e3:8.2f} ms ({t_loop / t_single:.1f}x)")
+
+    # One GD iteration of fp_recover on a simulated dataset of 16 x 16 LEDs with 64 px images
+    dataset, pupil, _, _ = fp_simulation()
+    t_iteration = best_of(
+        lambda: fp_recover(
+            dataset,
+            pupil,
+            num_iterations=1,
+            pupil_recovery_method=PupilRecoveryMethod.GD,
+            num_zernike_coeffs=args.num_modes,
+        ),
+        args.repeats,
+    )
+    print(f"fp_recover GD iteration, {len(dataset.images)} images: {t_iteration:.3f} s")
+
+
+if __name__ == "__main__":
+    main()
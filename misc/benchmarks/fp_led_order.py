@@ -0,0 +1,84 @@
+"""Compares the number of iterations that fp_recover needs to converge with each LED order.
+
+Each order reconstructs datasets from fp_simulation() until the data fidelity error falls below a
+target. The datasets have an unaberrated and an aberrated pupil; the pupil is recovered with rPIE.
+The simulated images are ordered by illumination angle like a spiral acquisition, so the
+unaberrated dataset is also run with its images in raster order.
+The random order is run with several seeds and reports the median number of iterations.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_led_order.py --target_error 1e-3 --max_iterations 40
+```
+
+"""
+import argparse
+
+import numpy as np
+
+from leb.ptycho.datasets import FPDataset
+from leb.ptycho.fp import LEDOrder, PupilRecoveryMethod, fp_recover
+from leb.ptycho.simulation import fp_simulation
+
+
+ABERRATIONS = [0, 0, 0, 0.3, 0.2, -0.2, 0.1, 0, 0, 0]
+
+NUM_SEEDS = 5
+
+
+def raster_order(dataset: FPDataset) -> FPDataset:
+    order = np.lexsort(dataset.led_indexes.T[::-1])
+    return FPDataset(
+        images=dataset.images[order],
+        wavevectors=dataset.wavevectors[order],
+        led_indexes=dataset.led_indexes[order],
+    )
+
+
+def iterations_to_target(dataset, pupil, led_order, target_error, max_iterations, seed=None):
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=max_iterations,
+        pupil_recovery_method=PupilRecoveryMethod.rPIE,
+        led_order=led_order,
+        seed=seed,
+        target_error=target_error,
+    )
+    if results.errors[-1] >= target_error:
+        return np.inf, results.history[-1].elapsed_s
+    return len(results.history), results.history[-1].elapsed_s
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--target_error", type=float, default=1e-3, help="The target error.")
+    parser.add_argument("--max_iterations", type=int, default=40, help="The iteration limit.")
+    args = parser.parse_args()
+
+    dataset, pupil, _, _ = fp_simulation()
+    datasets = {
+        "unaberrated": (dataset, pupil),
+        "raster": (raster_order(dataset), pupil),
+        "aberrated": fp_simulation(zernike_coeffs=ABERRATIONS)[0:2],
+    }
+
+    print(f"{'order':<10} {'dataset':<12} {'iterations':>10} {'time s':>8}")
+    for led_order in LEDOrder:
+        seeds = range(NUM_SEEDS) if led_order is LEDOrder.RANDOM else [None]
+        for dataset_name, (dataset, pupil) in datasets.items():
+            runs = [
+                iterations_to_target(
+                    dataset, pupil, led_order, args.target_error, args.max_iterations, seed
+                )
+                for seed in seeds
+            ]
+            iterations, elapsed_s = np.median(runs, axis=0)
+            iterations = f">{args.max_iterations}" if np.isinf(iterations) else f"{iterations:g}"
+            print(f"{led_order.name:<10} {dataset_name:<12} {iterations:>10} {elapsed_s:>8.2f}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,83 @@
+"""Compares the time that fp_recover and fp_recover_multiresolution need to reach an error.
+
+Both reconstruct datasets from fp_simulation() at a final upsampling factor of 4 until the data
+fidelity error of the final level falls below a target. The coarse levels of the multi-resolution
+reconstructions run a fixed number of iterations, unless they reach the target before. The
+reported iterations are those of all levels. The datasets have an unaberrated and an
+aberrated pupil; the aberrated pupil is recovered with rPIE.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_multiresolution.py --target_error 1e-3 --coarse_iterations 10
+```
+
+"""
+import argparse
+import time
+
+from leb.ptycho.fp import PupilRecoveryMethod, fp_recover, fp_recover_multiresolution
+from leb.ptycho.simulation import fp_simulation
+
+
+ABERRATIONS = [0, 0, 0, 0.3, 0.2, -0.2, 0.1, 0, 0, 0]
+
+UPSAMPLING_FACTORS = ((4,), (2, 4), (3, 4), (2, 3, 4))
+
+MAX_ITERATIONS = 60
+
+
+def best_of(func, repeats: int) -> float:
+    times = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        func()
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--target_error", type=float, default=1e-3, help="The target error.")
+    parser.add_argument(
+        "--coarse_iterations", type=int, default=10, help="The iterations of each coarse level."
+    )
+    parser.add_argument("--repeats", type=int, default=3, help="The number of timed runs.")
+    args = parser.parse_args()
+
+    datasets = {
+        "unaberrated": (fp_simulation(), PupilRecoveryMethod.NONE),
+        "aberrated": (fp_simulation(zernike_coeffs=ABERRATIONS), PupilRecoveryMethod.rPIE),
+    }
+
+    print(f"{'dataset':<12} {'levels':<10} {'iterations':>10} {'error':>10} {'time s':>8}")
+    for name, ((dataset, pupil, _, _), pupil_recovery_method) in datasets.items():
+        for factors in UPSAMPLING_FACTORS:
+            num_iterations = [args.coarse_iterations] * (len(factors) - 1) + [MAX_ITERATIONS]
+            kwargs = dict(
+                pupil_recovery_method=pupil_recovery_method, target_error=args.target_error
+            )
+            if len(factors) == 1:
+                run = lambda: fp_recover(  # noqa: E731
+                    dataset, pupil, num_iterations=MAX_ITERATIONS, upsampling_factor=4, **kwargs
+                )
+            else:
+                run = lambda: fp_recover_multiresolution(  # noqa: E731
+                    dataset,
+                    pupil,
+                    upsampling_factors=factors,
+                    num_iterations=num_iterations,
+                    **kwargs,
+                )
+            results = run()
+            elapsed_s = best_of(run, args.repeats)
+            levels = ",".join(str(f) for f in factors)
+            print(
+                f"{name:<12} {levels:<10} {len(results.history):>10} {results.errors[-1]:>10.3g} "
+                f"{elapsed_s:>8.2f}"
+            )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,129 @@
+"""Benchmarks fp_recover against rPIE updates of the full slice for several NAs and pixel sizes.
+
+fp_recover restricts the spectral-domain arithmetic to the bounding box of the pupil's support.
+The fraction of the slice that the box covers, and therefore the speedup, grows with the pupil
+radius in pixels, i.e. with the NA and the pixel size in the sample plane. This script times one
+iteration of both implementations on random data and checks that their results agree.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_pupil_support.py --num_px 256 --num_leds 9
+```
+
+"""
+import argparse
+import time
+
+import numpy as np
+from numpy.fft import fft2, fftshift, ifft2, ifftshift
+from skimage.transform import rescale
+
+from leb.ptycho.datasets import FPDataset
+from leb.ptycho.fp import Pupil, PupilRecoveryMethod, fp_recover, slice_fft
+
+
+NAS = (0.05, 0.1, 0.2, 0.288)
+PX_SIZES_UM = (2.4, 3.45, 5.86)
+UPSAMPLING_FACTOR = 2
+
+
+def full_grid_rpie(dataset: FPDataset, pupil: Pupil, num_iterations: int = 1):
+    """The rPIE object and pupil updates of fp_recover, computed on the full grid of each slice."""
+    num_px = dataset.images.shape[1]
+    target_fft = fftshift(fft2(rescale(np.mean(dataset.images, axis=0), UPSAMPLING_FACTOR)))
+    p = pupil.p.copy()
+
+    for _ in range(num_iterations):
+        for image, wavevector, _ in dataset:
+            kx_ky_px = np.round(wavevector[0:2] / pupil.dk).astype(int)
+            current_slice_fft = slice_fft(target_fft, kx_ky_px, num_px)
+
+            low_res_img_fft = current_slice_fft * p
+            low_res_img = ifft2(ifftshift(low_res_img_fft))
+            low_res_img = np.abs(image) * np.exp(1j * np.angle(low_res_img))
+            diff = fftshift(fft2(low_res_img)) - low_res_img_fft
+
+            current_slice_fft += np.conj(p) / np.max(np.abs(p) ** 2) * diff
+            p = p + np.conj(current_slice_fft) / np.max(np.abs(current_slice_fft) ** 2) * diff
+
+            # Pupil.set_p
+            y, x = np.ogrid[-num_px // 2 : num_px // 2, -num_px // 2 : num_px // 2]
+            p[x**2 + y**2 > pupil.pupil_radius_px**2] = 0
+
+    return ifft2(ifftshift(target_fft)), p
+
+
+def random_dataset(pupil: Pupil, num_px: int, num_leds: int) -> FPDataset:
+    """Returns random images with wavevectors that keep every slice inside the target spectrum."""
+    rng = np.random.default_rng(0)
+    images = rng.random((num_leds**2, num_px, num_px))
+
+    max_k_px = (num_px * UPSAMPLING_FACTOR - num_px) // 2
+    k_px = np.linspace(-max_k_px, max_k_px, num_leds).astype(int)
+    kx, ky = np.meshgrid(k_px, k_px)
+    wavevectors = np.stack([kx.ravel(), ky.ravel(), np.zeros(kx.size)], axis=1) * pupil.dk
+    led_indexes = np.zeros((num_leds**2, 2), dtype=np.int32)
+
+    return FPDataset(images, wavevectors, led_indexes)
+
+
+def best_of(func, repeats: int) -> float:
+    times = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        func()
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--num_px", type=int, default=256, help="The size of the images.")
+    parser.add_argument("--num_leds", type=int, default=9, help="The LEDs along each side.")
+    parser.add_argument("--repeats", type=int, default=3, help="The runs per measurement.")
+    args = parser.parse_args()
+
+    print(
+        f"{'NA':>6} {'px um':>6} {'r px':>5} {'box':>6} {'full s':>8} {'box s':>8} {'speedup':>8}"
+    )
+    for px_size_um in PX_SIZES_UM:
+        for na in NAS:
+            pupil = Pupil.from_system_params(num_px=args.num_px, px_size_um=px_size_um, na=na)
+            if 2 * pupil.pupil_radius_px + 1 > args.num_px:
+                continue
+            dataset = random_dataset(pupil, args.num_px, args.num_leds)
+
+            obj, p = full_grid_rpie(dataset, pupil)
+            results = fp_recover(
+                dataset,
+                pupil,
+                num_iterations=1,
+                pupil_recovery_method=PupilRecoveryMethod.rPIE,
+                upsampling_factor=UPSAMPLING_FACTOR,
+            )
+            assert np.allclose(results.object, obj) and np.allclose(results.pupil.p, p)
+
+            t_full = best_of(lambda: full_grid_rpie(dataset, pupil), args.repeats)
+            t_box = best_of(
+                lambda: fp_recover(
+                    dataset,
+                    pupil,
+                    num_iterations=1,
+                    pupil_recovery_method=PupilRecoveryMethod.rPIE,
+                    upsampling_factor=UPSAMPLING_FACTOR,
+                ),
+                args.repeats,
+            )
+
+            rows, cols = pupil.support_bbox
+            box_fraction = (rows.stop - rows.start) * (cols.stop - cols.start) / args.num_px**2
+            print(
+                f"{na:>6.3f} {px_size_um:>6.2f} {pupil.pupil_radius_px:>5} {box_fraction:>6.1%} "
+                f"{t_full:>8.3f} {t_box:>8.3f} {t_full / t_box:>7.2f}x"
+            )
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,99 @@
+"""Compares cold and warm-started reconstructions of a simulated time series.
+
+The ground truth object of fp_simulation() drifts by a fraction of a pixel and changes its phase
+slightly from frame to frame, and the aberrated pupil stays the same. Each frame is reconstructed
+until the data fidelity error falls below a target, once from the upsampled mean image and once
+warm-started from the results of the previous frame.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/fp_warm_start.py --num_frames 5 --target_error 1e-3
+```
+
+"""
+import argparse
+
+import numpy as np
+from numpy.fft import fft2, fftfreq, ifft2
+
+from leb.ptycho.calibration import calibrate_rectangular_matrix
+from leb.ptycho.datasets import FPDataset
+from leb.ptycho.fp import PupilRecoveryMethod, fp_recover
+from leb.ptycho.simulation import fp_simulation, generate_led_indexes, generate_simulated_images
+
+
+ABERRATIONS = [0, 0, 0, 0.3, 0.2, -0.2, 0.1, 0, 0, 0]
+
+DRIFT_PX = 0.25
+"""The shift of the object between frames in pixels of the ground truth."""
+
+PHASE_CHANGE = 0.02
+"""The relative change of the object's phase between frames."""
+
+MAX_ITERATIONS = 60
+
+
+def shifted(obj: np.ndarray, shift_px: float) -> np.ndarray:
+    """Shifts an object along both axes by Fourier interpolation."""
+    k = fftfreq(obj.shape[0])
+    ramp = np.exp(-2j * np.pi * shift_px * (k[:, None] + k[None, :]))
+    return ifft2(fft2(obj) * ramp)
+
+
+def time_series(num_frames: int) -> tuple[list[FPDataset], object]:
+    """Simulates the datasets of a slowly changing object."""
+    first, pupil, gt, gt_pupil = fp_simulation(zernike_coeffs=ABERRATIONS)
+    calibration = calibrate_rectangular_matrix(
+        generate_led_indexes((8, 8), (16, 16)),
+        (8, 8),
+        pitch_mm=(4, 4),
+        axial_offset_mm=-50,
+        wavelength_um=0.488,
+        sort=True,
+    )
+
+    datasets = [first]
+    for frame in range(1, num_frames):
+        obj = shifted(gt, frame * DRIFT_PX)
+        obj = np.abs(obj) * np.exp(1j * (1 + frame * PHASE_CHANGE) * np.angle(obj))
+        images = generate_simulated_images(obj, calibration, gt_pupil)
+        datasets.append(FPDataset.from_calibration(images=images, calibration=calibration))
+    return datasets, pupil
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--num_frames", type=int, default=5, help="The number of frames.")
+    parser.add_argument("--target_error", type=float, default=1e-3, help="The target error.")
+    args = parser.parse_args()
+
+    datasets, pupil = time_series(args.num_frames)
+    kwargs = dict(
+        num_iterations=MAX_ITERATIONS,
+        pupil_recovery_method=PupilRecoveryMethod.rPIE,
+        target_error=args.target_error,
+    )
+
+    print(f"{'frame':>5} {'cold its':>8} {'cold s':>7} {'warm its':>8} {'warm s':>7}")
+    previous = None
+    totals = np.zeros(4)
+    for frame, dataset in enumerate(datasets):
+        cold = fp_recover(dataset, pupil, **kwargs)
+        warm = fp_recover(dataset, pupil, warm_start=previous, **kwargs)
+        previous = warm
+
+        row = [
+            len(cold.history),
+            cold.history[-1].elapsed_s,
+            len(warm.history),
+            warm.history[-1].elapsed_s,
+        ]
+        totals += row
+        print(f"{frame:>5} {row[0]:>8} {row[1]:>7.2f} {row[2]:>8} {row[3]:>7.2f}")
+    print(f"{'total':>5} {totals[0]:>8g} {totals[1]:>7.2f} {totals[2]:>8g} {totals[3]:>7.2f}")
+
+
+if __name__ == "__main__":
+    main()
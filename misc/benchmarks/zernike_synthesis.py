@@ -0,0 +1,64 @@
+"""Benchmarks the synthesis of a pupil phase from Zernike weights.
+
+`Zernike` stores its modes once as a (disc pixels x modes) matrix, so that a phase is one
+matrix-vector product over the pixels of the unit disc. This script compares it with evaluating
+the weights on the full grid and replacing the NaNs outside the disc, which is what
+`RZern.eval_grid` and `Zernike` did before. The grids are those of `Pupil.from_system_params`,
+where the unit disc is the pupil.
+
+Usage
+-----
+
+```console
+python misc/benchmarks/zernike_synthesis.py --num_px 512 2048
+```
+
+"""
+import argparse
+import time
+
+import numpy as np
+
+from leb.ptycho.fp import Pupil
+
+
+def best_of(func, repeats: int) -> float:
+    times = []
+    for _ in range(repeats):
+        start = time.perf_counter()
+        func()
+        times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def full_grid_synthesis(zernike, weights):
+    z = np.tensordot(weights, zernike.unit_modes, axes=1)
+    z[np.isnan(z)] = 0
+    return z
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--num_px", type=int, nargs="+", default=[512, 2048], help="Grid sizes.")
+    parser.add_argument("--na", type=float, default=0.288, help="The NA of the pupil.")
+    parser.add_argument("--repeats", type=int, default=10, help="The runs per measurement.")
+    args = parser.parse_args()
+
+    print(f"{'px':>6} {'disc':>6} {'full grid ms':>13} {'basis ms':>9} {'speedup':>8}")
+    for num_px in args.num_px:
+        zernike = Pupil.from_system_params(num_px=num_px, na=args.na).zernike
+        weights = np.linspace(-1, 1, zernike.num_modes)
+        out = np.empty((num_px, num_px))
+        assert np.allclose(zernike(weights, out=out), full_grid_synthesis(zernike, weights))
+
+        t_full = best_of(lambda: full_grid_synthesis(zernike, weights), args.repeats)
+        t_basis = best_of(lambda: zernike(weights, out=out), args.repeats)
+        disc = zernike._disc_idx.size / num_px**2
+        print(
+            f"{num_px:>6} {disc:>6.1%} {t_full * 1e3:>13.2f} {t_basis * 1e3:>9.2f} "
+            f"{t_full / t_basis:>7.1f}x"
+        )
+
+
+if __name__ == "__main__":
+    main()
@@ -4,7 +4,22 @@ The public API is defined here.
 
 """
 
-from leb.ptycho.acquisition import Direction, Metadata, spiral  # noqa: F401
+from leb.ptycho.acquisition import (  # noqa: F401
+    Direction,
+    LEDExposure,
+    Metadata,
+    MultiRing,
+    Ring,
+    displayed_brightness,
+    intensity_schedule,
+    intensity_schedule_from_prescan,
+    macro_commands,
+    na_to_led_radius,
+    parse_report,
+    schedule_commands,
+    spiral,
+    sync_skew,
+)
 from leb.ptycho.datasets import (  # noqa: F401
     Format,
     FPDataset,
@@ -14,11 +29,17 @@ from leb.ptycho.datasets import (  # noqa: F401
     load_dataset,
 )
 from leb.ptycho.calibration import Calibration, calibrate_rectangular_matrix  # noqa: F401
+from leb.ptycho.dpc import DPCConfig, DPCSolver, HalfCircle, dpc_recover  # noqa: F401
 from leb.ptycho.fp import (  # noqa: F401
     FPRecoveryError,
     FPResults,
+    IterationMetrics,
+    LEDOrder,
+    ObjectUpdateMethod,
     Pupil,
     PupilRecoveryMethod,
+    StopReason,
     fp_recover,
+    fp_recover_multiresolution,
 )
 from leb.ptycho.simulation import fp_simulation  # noqa: F401
@@ -1,7 +1,23 @@
 """LED array acquisition tools."""
 
+from dataclasses import dataclass
 from enum import Enum
-from typing import TypedDict
+from typing import Self, TypedDict
+
+import numpy as np
+
+
+SCHEDULE_SIZE = 64
+"""The maximum number of entries in the LED controller's pattern schedule."""
+
+MACRO_SLOTS = 16
+"""The number of pattern macros that the LED controller stores."""
+
+MACRO_LENGTH = 8
+"""The maximum number of drawing commands per macro."""
+
+BIT_DEPTH = 4
+"""The number of brightness bits displayed by the LED controller without dithering."""
 
 
 class Direction(Enum):
@@ -57,5 +73,454 @@ class Metadata(TypedDict):
 
     led_indexes: tuple[int, int]
     led_center: tuple[int, int]
-    exposure_time_ms: int
+    exposure_time_ms: float
     gain_db: float
+    led_state: int
+
+
+def na_to_led_radius(
+    na: float,
+    pitch_mm: float = 4.0,
+    axial_offset_mm: float = -65,
+    t_mm: float = 0.0,
+    n_g: float = 1.515,
+) -> float:
+    """Returns the distance from the center LED, in LED pitches, that illuminates at a given NA.
+
+    The geometry is the same as the one used by `calibrate_rectangular_matrix`: the LED matrix lies
+    at z = axial_offset_mm and the rays are refracted by a slide of thickness t_mm and refractive
+    index n_g on their way to the sample.
+
+    Parameters
+    ----------
+    na : float
+        The illumination numerical aperture, i.e. the sine of the illumination angle in air.
+    pitch_mm : float
+        The distance between neighboring LEDs.
+    axial_offset_mm : float
+        The offset from the LED matrix to the sample, which lies at z = 0.
+    t_mm : float
+        The thickness of the glass slide/coverslip in mm.
+    n_g : float
+        The refractive index of the glass slide/coverslip.
+
+    Returns
+    -------
+    float
+        The radius in units of LED pitches.
+
+    """
+    if not 0 <= na < 1:
+        raise ValueError(f"The NA must lie in the interval [0, 1). Received: {na}")
+
+    D = np.abs(axial_offset_mm) - t_mm  # distance from LED to slide side closest to the array
+    theta_air = np.arcsin(na)
+    theta_glass = np.arcsin(na / n_g)
+
+    return float((D * np.tan(theta_air) + t_mm * np.tan(theta_glass)) / pitch_mm)
+
+
+@dataclass(frozen=True)
+class Ring:
+    """An annulus of LEDs centered on an LED.
+
+    Attributes
+    ----------
+    center : tuple[int, int]
+        The (x, y) indexes of the LED at the center of the ring.
+    r_in : int
+        The inner radius of the ring in LED pitches.
+    r_out : int
+        The outer radius of the ring in LED pitches.
+    state : int
+        The brightness of the ring in percent.
+
+    """
+
+    center: tuple[int, int]
+    r_in: int
+    r_out: int
+    state: int = 100
+
+    def __post_init__(self):
+        if self.r_in < 0 or self.r_out < self.r_in:
+            raise ValueError(
+                f"Expected 0 <= r_in <= r_out. Actual values: r_in={self.r_in}, r_out={self.r_out}"
+            )
+
+    @classmethod
+    def from_na(
+        cls,
+        center: tuple[int, int],
+        na: float,
+        width: int = 1,
+        state: int = 100,
+        **kwargs,
+    ) -> Self:
+        """Creates a ring whose outermost LEDs illuminate the sample at or just below an NA.
+
+        Matching the ring to the objective NA produces annular illumination in which every LED lies
+        just inside the bright-field region.
+
+        `kwargs` are passed to `na_to_led_radius`.
+
+        Parameters
+        ----------
+        center : tuple[int, int]
+            The (x, y) indexes of the LED at the center of the ring.
+        na : float
+            The NA to match, usually the NA of the objective.
+        width : int
+            The number of LEDs across the annulus.
+        state : int
+            The brightness of the ring in percent.
+
+        Returns
+        -------
+        Ring
+            The ring matched to the NA.
+
+        """
+        r_out = int(np.floor(na_to_led_radius(na, **kwargs)))
+        r_in = max(r_out - width + 1, 0)
+
+        return cls(center, r_in, r_out, state)
+
+    def command(self) -> str:
+        """The LED controller command that draws the ring."""
+        x, y = self.center
+        return f"ring {x} {y} {self.r_in} {self.r_out} {self.state}"
+
+
+@dataclass(frozen=True)
+class MultiRing(Ring):
+    """A set of concentric annuli of LEDs.
+
+    The innermost annulus spans r_in to r_out. Each of the remaining count - 1 annuli has the same
+    width and is separated from the previous one by a gap of that width.
+
+    Attributes
+    ----------
+    count : int
+        The number of annuli.
+
+    """
+
+    count: int = 1
+
+    def __post_init__(self):
+        super().__post_init__()
+        if self.count < 1:
+            raise ValueError(f"The number of rings must be positive. Received: {self.count}")
+
+    def radii(self) -> list[tuple[int, int]]:
+        """The (inner, outer) radii of each annulus, from the inside out."""
+        width = self.r_out - self.r_in + 1
+        return [(self.r_in + 2 * i * width, self.r_out + 2 * i * width) for i in range(self.count)]
+
+    def command(self) -> str:
+        """The LED controller command that draws the rings."""
+        x, y = self.center
+        return f"rings {x} {y} {self.r_in} {self.r_out} {self.count} {self.state}"
+
+
+def schedule_commands(
+    entries: list[tuple[int, str | Ring]], period_us: int, cycles: int = 0
+) -> list[str]:
+    """Returns the LED controller commands that upload and play a schedule of patterns.
+
+    The controller plays the schedule back from a hardware timer, so the host does not need to
+    send any commands during playback.
+
+    Parameters
+    ----------
+    entries : list[tuple[int, str | Ring]]
+        (timestamp, pattern) pairs. Timestamps are in microseconds from the start of each cycle and
+        must not decrease. A pattern is either a drawing command or a pattern descriptor.
+    period_us : int
+        The time between the starts of consecutive cycles in microseconds. It must be greater than
+        the last timestamp.
+    cycles : int
+        The number of times to play the schedule. 0 plays it until a `stop` command is received.
+
+    Returns
+    -------
+    list[str]
+        The commands to send to the controller, in order.
+
+    """
+    if not entries:
+        raise ValueError("The schedule must contain at least one entry.")
+    if len(entries) > SCHEDULE_SIZE:
+        raise ValueError(f"The schedule holds at most {SCHEDULE_SIZE} entries, got {len(entries)}.")
+
+    timestamps = [t_us for t_us, _ in entries]
+    if any(t_us < 0 for t_us in timestamps) or timestamps != sorted(timestamps):
+        raise ValueError("Timestamps must be non-negative and must not decrease.")
+    if timestamps[-1] >= period_us:
+        raise ValueError(
+            f"The last timestamp ({timestamps[-1]} us) must be less than the period "
+            f"({period_us} us)."
+        )
+    if cycles < 0:
+        raise ValueError(f"The number of cycles must not be negative. Received: {cycles}")
+
+    commands = ["clearSchedule"]
+    for t_us, pattern in entries:
+        cmd = pattern.command() if isinstance(pattern, Ring) else pattern
+        commands.append(f"at {t_us} {cmd}")
+    commands.append(f"play {period_us} {cycles}")
+
+    return commands
+
+
+def macro_commands(
+    slot: int, patterns: list[str | Ring], boot: bool = False, save: bool = True
+) -> list[str]:
+    """Returns the LED controller commands that define a macro.
+
+    Once defined, `@<slot>` draws all patterns of the macro at the cost of parsing a single short
+    command. Macros can also be preloaded and scheduled, e.g. `preload @<slot>`. Patterns are drawn
+    on top of each other and of the current pattern, so start a macro with `fill 0` or a `single`
+    command to replace what is displayed.
+
+    Parameters
+    ----------
+    slot : int
+        The slot of the macro. Any macro in the slot is replaced.
+    patterns : list[str | Ring]
+        The drawing commands or pattern descriptors, in the order they are drawn.
+    boot : bool
+        Display the macro when the controller starts.
+    save : bool
+        Write all macros to the controller's flash so that they persist across power cycles. Flash
+        endures a limited number of writes, so don't save for every acquisition.
+
+    Returns
+    -------
+    list[str]
+        The commands to send to the controller, in order.
+
+    """
+    if not 0 <= slot < MACRO_SLOTS:
+        raise ValueError(f"The slot must be between 0 and {MACRO_SLOTS - 1}. Received: {slot}")
+    if not 1 <= len(patterns) <= MACRO_LENGTH:
+        raise ValueError(f"A macro holds 1 to {MACRO_LENGTH} patterns, got {len(patterns)}.")
+
+    cmds = [pattern.command() if isinstance(pattern, Ring) else pattern for pattern in patterns]
+    if any(cmd.startswith("@") for cmd in cmds):
+        raise ValueError("Macros cannot recall other macros.")
+
+    commands = [f"undef {slot}"] + [f"def {slot} {cmd}" for cmd in cmds]
+    if boot:
+        commands.append(f"boot {slot}")
+    if save:
+        commands.append("save")
+
+    return commands
+
+
+def parse_report(line: str) -> dict[str, int]:
+    """Parses a single-line report from the LED controller, e.g. from `status` or `skew`.
+
+    Parameters
+    ----------
+    line : str
+        A line of space-separated key=value pairs with integer values.
+
+    Returns
+    -------
+    dict[str, int]
+        The values of the report by key.
+
+    """
+    report = {}
+    for item in line.split():
+        key, sep, value = item.partition("=")
+        if not sep:
+            raise ValueError(f"Expected a key=value pair, got '{item}' in '{line}'.")
+        report[key] = int(value)
+
+    return report
+
+
+def sync_skew(reports: dict[str, str]) -> dict[str, float]:
+    """Computes the skew between synchronized LED controllers from their `skew` reports.
+
+    Each controller reports the latency from the sync edge to the moment its pattern was displayed.
+    The skew of a controller is its mean latency minus that of the fastest controller.
+
+    Parameters
+    ----------
+    reports : dict[str, str]
+        The `skew` report line of each controller, keyed by a name for the controller.
+
+    Returns
+    -------
+    dict[str, float]
+        The skew of each controller in microseconds.
+
+    """
+    parsed = {name: parse_report(line) for name, line in reports.items()}
+    for name, report in parsed.items():
+        if report["rendered"] == 0:
+            raise ValueError(f"Controller {name} has not displayed any synchronized patterns.")
+
+    fastest = min(report["mean_us"] for report in parsed.values())
+    return {name: float(report["mean_us"] - fastest) for name, report in parsed.items()}
+
+
+def displayed_brightness(state: int, bit_depth: int = BIT_DEPTH) -> float:
+    """Returns the fraction of the full LED brightness that the controller displays for a state.
+
+    The controller scales the state in percent to a 5 bit value and the panels display its
+    bit_depth most significant bits, so only some states are displayed exactly.
+
+    Parameters
+    ----------
+    state : int
+        The brightness in percent that is sent to the controller.
+    bit_depth : int
+        The number of brightness bits displayed by the panels.
+
+    Returns
+    -------
+    float
+        The displayed brightness relative to a state of 100.
+
+    """
+    if not 0 <= state <= 100:
+        raise ValueError(f"The state must lie in the interval [0, 100]. Received: {state}")
+
+    level = int(state * 31 * 0.01) >> (5 - bit_depth)
+    return level / (2**bit_depth - 1)
+
+
+@dataclass(frozen=True)
+class LEDExposure:
+    """The illumination and camera settings for a single LED of an acquisition.
+
+    Attributes
+    ----------
+    state : int
+        The brightness of the LED in percent.
+    exposure_time_ms : float
+        The camera exposure time.
+
+    """
+
+    state: int
+    exposure_time_ms: float
+
+    @property
+    def dose(self) -> float:
+        """The displayed brightness times the exposure time."""
+        return displayed_brightness(self.state) * self.exposure_time_ms
+
+
+def intensity_schedule(
+    led_indexes: list[tuple[int, int]],
+    center: tuple[int, int],
+    na: float,
+    bf_exposure: LEDExposure,
+    df_exposure: LEDExposure,
+    **kwargs,
+) -> list[LEDExposure]:
+    """Returns the per-LED settings that match the illumination to the NA of the objective.
+
+    Bright-field images are much brighter than dark-field images. Instead of bracketing every LED
+    with several exposures, LEDs inside the objective NA are acquired with bf_exposure and all
+    others with df_exposure, so each LED needs a single exposure.
+
+    `kwargs` are passed to `na_to_led_radius`.
+
+    Parameters
+    ----------
+    led_indexes : list[tuple[int, int]]
+        The (x, y) indexes of the LEDs in acquisition order.
+    center : tuple[int, int]
+        The (x, y) indexes of the on-axis LED.
+    na : float
+        The NA of the objective.
+    bf_exposure : LEDExposure
+        The settings for the bright-field LEDs, usually dim and short.
+    df_exposure : LEDExposure
+        The settings for the dark-field LEDs, usually bright and long.
+
+    Returns
+    -------
+    list[LEDExposure]
+        The settings for each LED, in the order of led_indexes.
+
+    Raises
+    ------
+    ValueError
+        If the controller would switch the LEDs of either setting off.
+
+    """
+    for name, exposure in (("bright-field", bf_exposure), ("dark-field", df_exposure)):
+        if displayed_brightness(exposure.state) == 0:
+            raise ValueError(
+                f"The {name} LED state {exposure.state} is displayed as off at a bit depth of "
+                f"{BIT_DEPTH}."
+            )
+
+    radius = na_to_led_radius(na, **kwargs)
+    return [
+        bf_exposure if np.hypot(x - center[0], y - center[1]) <= radius else df_exposure
+        for x, y in led_indexes
+    ]
+
+
+def intensity_schedule_from_prescan(
+    mean_intensities: list[float],
+    prescan: list[LEDExposure],
+    target_intensity: float,
+    min_exposure_time_ms: float = 1.0,
+    max_exposure_time_ms: float = 5000.0,
+) -> list[LEDExposure]:
+    """Returns the per-LED settings that bring each image to a target mean intensity.
+
+    The exposure times are derived from a quick pre-scan, e.g. with short exposures or binning, by
+    assuming that the intensity is proportional to the exposure time. The LED brightness of the
+    pre-scan is kept.
+
+    Parameters
+    ----------
+    mean_intensities : list[float]
+        The background-corrected mean intensity of each pre-scan image.
+    prescan : list[LEDExposure]
+        The settings of each pre-scan image.
+    target_intensity : float
+        The desired mean intensity of each image.
+    min_exposure_time_ms : float
+        The shortest exposure time to use.
+    max_exposure_time_ms : float
+        The longest exposure time to use, which is also used for LEDs with no measured signal.
+
+    Returns
+    -------
+    list[LEDExposure]
+        The settings for each LED, in the order of the pre-scan.
+
+    """
+    if len(mean_intensities) != len(prescan):
+        raise ValueError(
+            f"Expected one intensity per pre-scan image. Actual numbers: intensities: "
+            f"{len(mean_intensities)}, pre-scan images: {len(prescan)}"
+        )
+    if target_intensity <= 0:
+        raise ValueError(f"The target intensity must be positive. Received: {target_intensity}")
+
+    schedule = []
+    for mean, exposure in zip(mean_intensities, prescan):
+        if mean > 0:
+            exposure_time_ms = exposure.exposure_time_ms * target_intensity / mean
+        else:
+            exposure_time_ms = max_exposure_time_ms
+        exposure_time_ms = float(
+            np.clip(exposure_time_ms, min_exposure_time_ms, max_exposure_time_ms)
+        )
+        schedule.append(LEDExposure(exposure.state, exposure_time_ms))
+
+    return schedule
@@ -0,0 +1,183 @@
+"""Self-benchmarks of the LED controller firmware.
+
+The `bench <iterations>` command times every drawing primitive at several radii and the parser on
+canned inputs on the board itself, and the `version` command identifies the firmware build. This
+module runs the benchmark through an `LEDController`, parses its output and keeps a history of the
+results with one JSON file per firmware build, so that the cost of drawing and parsing can be
+tracked across firmware versions.
+
+Example
+-------
+
+```python
+with LEDController("/dev/ttyACM0") as ctrl:
+    report = run_bench(ctrl, iterations=100)
+save_report(report, Path("benchmarks"))
+
+baseline = load_reports(Path("benchmarks"))[0]
+print(compare(baseline, report))
+```
+
+"""
+from dataclasses import asdict, dataclass, field
+from datetime import datetime
+import json
+from pathlib import Path
+import re
+from typing import Sequence
+
+
+DEFAULT_TIMEOUT_S = 120.0
+"""The time to wait for the benchmark to finish. Each iteration of each case blocks the board."""
+
+
+@dataclass(frozen=True)
+class FirmwareBuild:
+    """The version and the build time that the firmware reports."""
+
+    version: str
+    build: str
+
+    @property
+    def key(self) -> str:
+        """A file name safe identifier of the build."""
+        return re.sub(r"[^A-Za-z0-9.]+", "_", f"{self.version} {self.build}").strip("_")
+
+
+@dataclass(frozen=True)
+class BenchResult:
+    """The timing of one benchmark case in microseconds per operation.
+
+    Attributes
+    ----------
+    case : str
+        The drawing primitive, or "parse.<verb>" for the parser.
+    r : int
+        The outer radius of the pattern, or 0 for cases without a radius.
+
+    """
+
+    case: str
+    r: int
+    iterations: int
+    min_us: float
+    mean_us: float
+    max_us: float
+
+
+@dataclass(frozen=True)
+class BenchReport:
+    """The results of one benchmark run of a firmware build."""
+
+    firmware: FirmwareBuild
+    results: list[BenchResult]
+    recorded: str = field(default_factory=lambda: datetime.now().isoformat(timespec="seconds"))
+
+    def to_dict(self) -> dict:
+        return asdict(self)
+
+    @classmethod
+    def from_dict(cls, data: dict) -> "BenchReport":
+        return cls(
+            firmware=FirmwareBuild(**data["firmware"]),
+            results=[BenchResult(**result) for result in data["results"]],
+            recorded=data["recorded"],
+        )
+
+    def result(self, case: str, r: int = 0) -> BenchResult:
+        """Returns the result of a case."""
+        for result in self.results:
+            if (result.case, result.r) == (case, r):
+                return result
+        raise KeyError(f"There is no result for {case} with r={r}.")
+
+
+def parse_version(lines: Sequence[str]) -> FirmwareBuild:
+    """Parses the output of the `version` command."""
+    if not lines or not lines[0].startswith("version "):
+        raise ValueError("The output is not a version line.")
+
+    _, version, build = (lines[0].split(" ", 2) + [""])[:3]
+    return FirmwareBuild(version=version, build=build)
+
+
+def parse_bench(lines: Sequence[str]) -> list[BenchResult]:
+    """Parses the output of the `bench` command.
+
+    Raises
+    ------
+    ValueError
+        If a line is not a benchmark result.
+
+    """
+    results = []
+    for line in lines:
+        fields = line.split()
+        if len(fields) != 7 or fields[0] != "bench":
+            raise ValueError(f"Not a benchmark result: '{line}'")
+        _, case, r, iterations, min_us, mean_us, max_us = fields
+        results.append(
+            BenchResult(case, int(r), int(iterations), float(min_us), float(mean_us), float(max_us))
+        )
+    return results
+
+
+def run_bench(ctrl, iterations: int = 100, timeout: float = DEFAULT_TIMEOUT_S) -> BenchReport:
+    """Identifies the firmware and runs its self-benchmark.
+
+    Parameters
+    ----------
+    ctrl : leb.ptycho.client.LEDController
+        The connection to the controller.
+    iterations : int
+        The number of times each case is run.
+    timeout : float
+        The time in seconds to wait for the benchmark to finish.
+
+    """
+    firmware = parse_version(ctrl.send("version"))
+    results = parse_bench(ctrl.send_async(f"bench {iterations}").result(timeout))
+    return BenchReport(firmware=firmware, results=results)
+
+
+def save_report(report: BenchReport, directory: Path) -> Path:
+    """Appends a report to the history of its firmware build.
+
+    Each build has one JSON file in the directory that holds a list of all of its reports.
+
+    Returns
+    -------
+    Path
+        The path of the file.
+
+    """
+    directory.mkdir(parents=True, exist_ok=True)
+    path = directory / f"{report.firmware.key}.json"
+
+    history = json.loads(path.read_text()) if path.exists() else []
+    history.append(report.to_dict())
+    path.write_text(json.dumps(history, indent=2))
+
+    return path
+
+
+def load_reports(directory: Path) -> list[BenchReport]:
+    """Loads the reports of all firmware builds in a directory, oldest first."""
+    reports = []
+    for path in directory.glob("*.json"):
+        reports.extend(BenchReport.from_dict(data) for data in json.loads(path.read_text()))
+    return sorted(reports, key=lambda report: report.recorded)
+
+
+def compare(baseline: BenchReport, report: BenchReport) -> dict[tuple[str, int], float]:
+    """Returns the ratio of the mean time of each case in the report to that in the baseline.
+
+    Cases that only one of the reports contains are left out.
+
+    """
+    baseline_means = {(result.case, result.r): result.mean_us for result in baseline.results}
+    return {
+        (result.case, result.r): result.mean_us / baseline_means[(result.case, result.r)]
+        for result in report.results
+        if baseline_means.get((result.case, result.r))
+    }
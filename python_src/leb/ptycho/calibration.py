@@ -28,6 +28,7 @@ the same as rotating by 180 degrees about the intermediate x-axis, which flips b
 z-axes.
 
 """
+from typing import Optional
 import warnings
 
 import numpy as np
@@ -49,6 +50,8 @@ def calibrate_rectangular_matrix(
     t_mm: float = 0.0,
     n_g: float = 1.515,
     sort: bool = False,
+    panel_size: Optional[int | tuple[int, int]] = None,
+    panel_gap_mm: float | tuple[float, float] = 0.0,
 ) -> Calibration:
     """Computes the wavevectors that correspond to a set of LED coordinates on a rectangular matrix.
 
@@ -88,6 +91,14 @@ def calibrate_rectangular_matrix(
         If True, then the results are sorted from lowest (kx, ky) magnitudes to highest. If False,
         then the results are returned in the same order as the input. Sorting helps ensures that
         the smallest angle illuminations are computed first.
+    panel_size : Optional[int | tuple[int, int]]
+        The number of LEDs along the (x, y) sides of each panel if the matrix is tiled from several
+        panels. LED indexes are then global indexes across the whole tiling, with panel
+        (i, j) covering the indexes [i * panel_size[0], (i + 1) * panel_size[0]) in x and likewise
+        in y. If None, the matrix is treated as a single panel.
+    panel_gap_mm : float | tuple[float, float]
+        The extra (x, y) distance between the LEDs on either side of a boundary between two
+        panels, on top of the pitch. Only used if panel_size is not None.
 
     Returns
     -------
@@ -96,14 +107,9 @@ def calibrate_rectangular_matrix(
 
     """
 
-    # Convert pitch to tuple if necessary
-    if not isinstance(pitch_mm, tuple):
-        pitch_mm = (pitch_mm, pitch_mm)
-
     # Translate the origin of the LED matrix coordinate system to the center LED
-    led_coords = np.array(led_indexes)
-    led_coords[:, 0] = (led_coords[:, 0] - center_led[0]) * pitch_mm[0]
-    led_coords[:, 1] = (led_coords[:, 1] - center_led[1]) * pitch_mm[1]
+    led_coords = led_positions_mm(led_indexes, pitch_mm, panel_size, panel_gap_mm)
+    led_coords -= led_positions_mm([center_led], pitch_mm, panel_size, panel_gap_mm)
 
     # Rotate the LED coordinates about the z-axis to align the local x-axis with the global x-axis.
     # Positive rotations are clockwise when looking at the LED side of the matrix.
@@ -142,6 +148,52 @@ def calibrate_rectangular_matrix(
     return results
 
 
+def led_positions_mm(
+    led_indexes: list[LEDIndexes],
+    pitch_mm: float | tuple[float, float] = 4.0,
+    panel_size: Optional[int | tuple[int, int]] = None,
+    panel_gap_mm: float | tuple[float, float] = 0.0,
+) -> np.ndarray:
+    """Computes the positions of LEDs in the local coordinate system of the matrix.
+
+    The origin is at the LED with indexes (0, 0).
+
+    Parameters
+    ----------
+    led_indexes : list[LEDIndexes]
+        The global (x, y) indexes of the LEDs.
+    pitch_mm : float | tuple[float, float]
+        The horizontal/vertical distance between LEDs on a panel.
+    panel_size : Optional[int | tuple[int, int]]
+        The number of LEDs along the (x, y) sides of each panel of a tiled matrix, or None for a
+        single panel.
+    panel_gap_mm : float | tuple[float, float]
+        The extra (x, y) distance between LEDs on either side of a panel boundary.
+
+    Returns
+    -------
+    np.ndarray
+        The (x, y) positions of the LEDs in mm. The shape is (N, 2), where N is the number of LEDs.
+
+    """
+    # Convert pitch, panel size and gap to tuples if necessary
+    if not isinstance(pitch_mm, tuple):
+        pitch_mm = (pitch_mm, pitch_mm)
+    if not isinstance(panel_gap_mm, tuple):
+        panel_gap_mm = (panel_gap_mm, panel_gap_mm)
+
+    indexes = np.array(led_indexes, dtype=np.int64).reshape(-1, 2)
+    positions = indexes * np.array(pitch_mm, dtype=np.float64)
+
+    if panel_size is not None:
+        if not isinstance(panel_size, tuple):
+            panel_size = (panel_size, panel_size)
+        panels = np.floor_divide(indexes, np.array(panel_size))
+        positions += panels * np.array(panel_gap_mm, dtype=np.float64)
+
+    return positions
+
+
 def compute_dir_cos(
     led_coords_mm: np.ndarray,
     axial_offset_mm: float = -50.0,
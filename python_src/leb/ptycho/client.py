@@ -0,0 +1,333 @@
+"""Host-side client for the LED matrix controller.
+
+The client owns the serial port and pipelines commands: writes are queued and sent by a background
+thread, and acknowledgements are matched to commands by a second thread. The controller answers
+commands in the order it receives them, so every command gets a future that resolves with the lines
+the controller printed before its `0` acknowledgement. A synchronous `send` while nothing else is
+pending skips the threads and talks to the port directly, which saves two thread hand-offs.
+
+If the serial port fails, all pending commands fail with a `ConnectionError` and the client is
+closed.
+
+Example
+-------
+
+```python
+with LEDController("/dev/ttyACM0") as ctrl:
+    ctrl.send("fill 0")
+
+    # Send a whole pattern sequence at once and wait for all acknowledgements
+    ctrl.send_batch([f"preload single {x} 16 100" for x in range(8)])
+    ctrl.wait()
+```
+
+"""
+from collections import deque
+from concurrent.futures import Future
+import logging
+import threading
+import time
+from typing import Iterable, Optional
+
+import serial
+
+
+logger = logging.getLogger(__name__)
+
+
+OK = "0"
+ERROR = "1"
+TERMINATOR = "\n"
+
+RX_BUFFER_SIZE = 256
+"""The size of the controller's serial receive buffer in bytes."""
+
+CHAR_LIMIT = 48
+"""The maximum length of a command, including the terminator."""
+
+
+class ControllerError(Exception):
+    """The controller answered a command with an error."""
+
+    def __init__(self, cmd: str, output: list[str]):
+        reason = output[0] if output else "no reason given"
+        super().__init__(f"The controller rejected '{cmd}': {reason}")
+        self.cmd = cmd
+        self.output = output
+
+
+class LEDController:
+    """A pipelined connection to an LED matrix controller.
+
+    At most `window` bytes of unacknowledged commands are in flight. The default matches the
+    controller's receive buffer, so the controller never drops input, no matter how many commands
+    are queued.
+
+    Parameters
+    ----------
+    port : str | serial.Serial
+        The name of the serial port or an open port. An open port without a read timeout gets one,
+        so that the client can be closed.
+    baudrate : int
+        The baud rate, if the port is opened by the client.
+    timeout : float
+        The time in seconds that `send` waits for an acknowledgement.
+    window : int
+        The maximum number of unacknowledged bytes.
+
+    """
+
+    def __init__(
+        self,
+        port: str | serial.Serial,
+        baudrate: int = 9600,
+        timeout: float = 5.0,
+        window: int = RX_BUFFER_SIZE,
+    ):
+        if window < CHAR_LIMIT:
+            raise ValueError(f"The window must hold at least one command ({CHAR_LIMIT} bytes).")
+
+        self._serial = (
+            serial.Serial(port, baudrate=baudrate, timeout=0.1) if isinstance(port, str) else port
+        )
+        if self._serial.timeout is None:
+            self._serial.timeout = 0.1
+        self._serial.reset_input_buffer()
+        self.timeout = timeout
+        self.window = window
+
+        # Commands waiting to be written, and written commands waiting for acknowledgement, as
+        # (cmd, payload, future) tuples.
+        self._queued: deque[tuple[str, bytes, Future]] = deque()
+        self._in_flight: deque[tuple[str, bytes, Future]] = deque()
+        self._in_flight_bytes = 0
+        self._rx = bytearray()
+        self._output: list[str] = []
+        self._lock = threading.Condition()
+        self._direct = False  # a synchronous send owns the port
+        self._reading = False  # the reader thread is reading from the port
+        self._closed = False
+
+        self._writer = threading.Thread(target=self._write_loop, daemon=True)
+        self._reader = threading.Thread(target=self._read_loop, daemon=True)
+        self._writer.start()
+        self._reader.start()
+
+    def __enter__(self) -> "LEDController":
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def close(self) -> None:
+        """Stops the I/O threads, fails all pending commands and closes the port."""
+        with self._lock:
+            self._closed = True
+            self._lock.notify_all()
+
+        self._writer.join()
+        self._reader.join()
+        self._serial.close()
+        self._fail(ConnectionError("The connection was closed."))
+
+    def send_async(self, cmd: str) -> Future:
+        """Queues a command and returns a future for the controller's output.
+
+        The future resolves with the lines that the controller printed before acknowledging the
+        command, or raises a `ControllerError` if the controller rejected it.
+
+        """
+        return self.send_batch([cmd])[0]
+
+    def send_batch(self, cmds: Iterable[str]) -> list[Future]:
+        """Queues several commands at once and returns one future per command."""
+        items = [(cmd, _encode(cmd), Future()) for cmd in cmds]
+
+        with self._lock:
+            if self._closed:
+                raise ConnectionError("The connection is closed.")
+            self._queued.extend(items)
+            self._lock.notify_all()
+
+        return [future for _, _, future in items]
+
+    def send(self, cmd: str) -> list[str]:
+        """Sends a command and waits for its acknowledgement.
+
+        Returns
+        -------
+        list[str]
+            The lines that the controller printed before acknowledging the command.
+
+        """
+        payload = _encode(cmd)
+        with self._lock:
+            direct = not (
+                self._closed or self._direct or self._reading or self._queued or self._in_flight
+            )
+            self._direct = direct
+        if not direct:
+            return self.send_async(cmd).result(self.timeout)
+
+        try:
+            return self._send_direct(cmd, payload)
+        finally:
+            with self._lock:
+                self._direct = False
+                self._lock.notify_all()
+
+    @property
+    def pending(self) -> int:
+        """The number of commands that have not been acknowledged yet."""
+        with self._lock:
+            return len(self._queued) + len(self._in_flight)
+
+    def wait(self, timeout: Optional[float] = None) -> None:
+        """Waits until all queued commands have been acknowledged."""
+        with self._lock:
+            futures = [future for _, _, future in list(self._queued) + list(self._in_flight)]
+        for future in futures:
+            future.exception(timeout if timeout is not None else self.timeout)
+
+    def _send_direct(self, cmd: str, payload: bytes) -> list[str]:
+        deadline = time.monotonic() + self.timeout
+        try:
+            self._serial.write(payload)
+            while (line := self._read_line()) not in (OK, ERROR):
+                if line is not None:
+                    self._output.append(line)
+                elif time.monotonic() > deadline:
+                    # Leave the command in flight, so that the reader consumes a late
+                    # acknowledgement and the output before it instead of the next command.
+                    with self._lock:
+                        self._in_flight.append((cmd, payload, Future()))
+                        self._in_flight_bytes += len(payload)
+                    raise TimeoutError(f"The controller did not acknowledge '{cmd}'.")
+        except serial.SerialException as exc:
+            error = ConnectionError("The serial port failed.")
+            self._fail(error)
+            raise error from exc
+
+        output, self._output = self._output, []
+        if line == ERROR:
+            raise ControllerError(cmd, output)
+        return output
+
+    def _fail(self, exc: Exception) -> None:
+        """Closes the client and fails all pending commands with exc."""
+        with self._lock:
+            self._closed = True
+            pending = list(self._queued) + list(self._in_flight)
+            self._queued.clear()
+            self._in_flight.clear()
+            self._in_flight_bytes = 0
+            self._lock.notify_all()
+
+        for _, _, future in pending:
+            future.set_exception(exc)
+
+    def _write_loop(self) -> None:
+        while True:
+            with self._lock:
+                # Wait for commands that fit into the window. A command always fits if nothing else
+                # is in flight.
+                while not self._closed and (
+                    self._direct
+                    or not self._queued
+                    or (
+                        self._in_flight
+                        and self._in_flight_bytes + len(self._queued[0][1]) > self.window
+                    )
+                ):
+                    self._lock.wait()
+                if self._closed:
+                    return
+
+                # Coalesce as many queued commands as fit into a single write.
+                chunk = bytearray()
+                while self._queued and (
+                    not chunk or self._in_flight_bytes + len(self._queued[0][1]) <= self.window
+                ):
+                    item = self._queued.popleft()
+                    self._in_flight.append(item)
+                    self._in_flight_bytes += len(item[1])
+                    chunk += item[1]
+                # Wake the reader up.
+                self._lock.notify_all()
+
+            try:
+                self._serial.write(chunk)
+            except serial.SerialException as exc:
+                self._fail_port(exc)
+                return
+
+    def _read_loop(self) -> None:
+        while True:
+            # Only read while commands are in flight, so that a direct send can own the port.
+            with self._lock:
+                while not self._closed and (self._direct or not self._in_flight):
+                    self._lock.wait()
+                if self._closed:
+                    return
+                self._reading = True
+
+            try:
+                line = self._read_line()
+            except serial.SerialException as exc:
+                self._fail_port(exc)
+                return
+            finally:
+                with self._lock:
+                    self._reading = False
+                    self._lock.notify_all()
+
+            if line is not None:
+                self._handle_line(line)
+
+    def _fail_port(self, exc: serial.SerialException) -> None:
+        """Fails all pending commands after an I/O thread lost the port."""
+        if self._closed:
+            return
+        logger.error("The serial port failed: %s", exc)
+        error = ConnectionError("The serial port failed.")
+        error.__cause__ = exc
+        self._fail(error)
+
+    def _read_line(self) -> Optional[str]:
+        """Returns the next line from the port, or None if the read timed out."""
+        idx = self._rx.find(TERMINATOR.encode("ascii"))
+        if idx < 0:
+            self._rx += self._serial.read(max(1, self._serial.in_waiting))
+            idx = self._rx.find(TERMINATOR.encode("ascii"))
+            if idx < 0:
+                return None
+        line = self._rx[:idx].decode("ascii", errors="replace").rstrip("\r")
+        del self._rx[: idx + 1]
+        return line
+
+    def _handle_line(self, line: str) -> None:
+        if line not in (OK, ERROR):
+            self._output.append(line)
+            return
+
+        with self._lock:
+            if not self._in_flight:
+                logger.warning("Dropping unexpected reply from the controller: %s", line)
+                self._output = []
+                return
+            cmd, payload, future = self._in_flight.popleft()
+            self._in_flight_bytes -= len(payload)
+            self._lock.notify_all()
+
+        output, self._output = self._output, []
+        if line == OK:
+            future.set_result(output)
+        else:
+            future.set_exception(ControllerError(cmd, output))
+
+
+def _encode(cmd: str) -> bytes:
+    payload = (cmd + TERMINATOR).encode("ascii")
+    if len(payload) > CHAR_LIMIT:
+        raise ValueError(f"'{cmd}' is longer than {CHAR_LIMIT - 1} characters.")
+    return payload
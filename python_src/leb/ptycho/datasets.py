@@ -4,7 +4,7 @@ from enum import auto, Enum
 import json
 from pathlib import Path
 import pickle
-from typing import Any, Self
+from typing import Any, Optional, Self
 
 import numpy as np
 from numpy.typing import NDArray
@@ -14,6 +14,7 @@ from skimage.restoration import inpaint
 import tifffile
 from tqdm import tqdm
 
+from leb.ptycho.acquisition import displayed_brightness
 from leb.ptycho.calibration import Calibration, LEDIndexes, calibrate_rectangular_matrix
 
 
@@ -34,12 +35,16 @@ class FPDataset:
         A time x 3 array of wavevectors corresponding to each image.
     led_indexes: np.ndarray
         A time x 2 array of LED indexes corresponding to each wavevector.
+    intensity_scale: np.ndarray, optional
+        The relative illumination dose, i.e. LED brightness times exposure time and gain, of each
+        image. None if all images were acquired with the same settings.
 
     """
 
     images: np.ndarray
     wavevectors: np.ndarray
     led_indexes: np.ndarray
+    intensity_scale: Optional[np.ndarray] = None
 
     def __post_init__(self):
         """Validate the array data."""
@@ -78,6 +83,14 @@ class FPDataset:
                 f"numbers: images: {self.images.shape[0]}, wavevectors: "
                 f"{self.wavevectors.shape[0]}, led_indexes: {self.led_indexes.shape[0]}"
             )
+        if self.intensity_scale is not None:
+            if self.intensity_scale.shape != (self.images.shape[0],):
+                raise ValueError(
+                    "The intensity_scale array must have one entry per image. Actual shape: "
+                    f"{self.intensity_scale.shape}"
+                )
+            if np.any(self.intensity_scale <= 0):
+                raise ValueError("The intensity_scale entries must be positive.")
 
     def __len__(self):
         return self.images.shape[0]
@@ -89,12 +102,16 @@ class FPDataset:
             images = self.images[np.newaxis, idxs]
             wavevectors = self.wavevectors[np.newaxis, idxs]
             led_indexes = self.led_indexes[np.newaxis, idxs]
+            scale_idxs = np.s_[np.newaxis, idxs]
         elif isinstance(idxs, slice):
             images = self.images[idxs]
             wavevectors = self.wavevectors[idxs]
             led_indexes = self.led_indexes[idxs]
+            scale_idxs = idxs
+
+        intensity_scale = None if self.intensity_scale is None else self.intensity_scale[scale_idxs]
 
-        return FPDataset(images, wavevectors, led_indexes)
+        return FPDataset(images, wavevectors, led_indexes, intensity_scale)
 
     def __iter__(self):
         return (
@@ -107,11 +124,21 @@ class FPDataset:
         return self.images.shape
 
     @classmethod
-    def from_calibration(cls, images: np.ndarray, calibration: Calibration) -> Self:
+    def from_calibration(
+        cls,
+        images: np.ndarray,
+        calibration: Calibration,
+        intensity_scale: Optional[np.ndarray] = None,
+    ) -> Self:
         led_indexes = np.array(list(calibration.keys()))
         wavevectors = np.array(list(calibration.values()))
 
-        return cls(images=images, wavevectors=wavevectors, led_indexes=led_indexes)
+        return cls(
+            images=images,
+            wavevectors=wavevectors,
+            led_indexes=led_indexes,
+            intensity_scale=intensity_scale,
+        )
 
     def crop(self, row_min: int, row_max: int, col_min: int, col_max: int) -> Self:
         """Crop the images in the dataset."""
@@ -119,6 +146,23 @@ class FPDataset:
             images=self.images[:, row_min:row_max, col_min:col_max],
             wavevectors=self.wavevectors,
             led_indexes=self.led_indexes,
+            intensity_scale=self.intensity_scale,
+        )
+
+    def normalized(self) -> Self:
+        """Returns the dataset with the images divided by their intensity scale.
+
+        This brings images that were acquired with different LED brightnesses, exposure times or
+        gains onto a common intensity scale. The returned dataset has no intensity scale.
+
+        """
+        if self.intensity_scale is None:
+            return self
+
+        return FPDataset(
+            images=self.images / self.intensity_scale[:, np.newaxis, np.newaxis],
+            wavevectors=self.wavevectors,
+            led_indexes=self.led_indexes,
         )
 
     @staticmethod
@@ -177,6 +221,7 @@ class StackType(Enum):
 def load_dataset(
     file_path: Path,
     stack_type: StackType = StackType.MM,
+    normalize: bool = True,
     **kwargs,
 ) -> FPDataset:
     """Load a Fourier Ptychographic dataset from an image stack.
@@ -189,6 +234,9 @@ def load_dataset(
         The path to the image stack.
     stack_type : StackType, optional
         The type of the image stack, by default StackType.MM.
+    normalize : bool, optional
+        Divide the images by their intensity scale if the metadata records a per-LED intensity
+        schedule, by default True.
 
     Returns
     -------
@@ -220,7 +268,14 @@ def load_dataset(
         **kwargs,
     )
 
-    return FPDataset.from_calibration(images=images, calibration=calibration)
+    intensity_scale = (
+        None if metadata.intensity_scale is None else np.array(metadata.intensity_scale)
+    )
+    dataset = FPDataset.from_calibration(
+        images=images, calibration=calibration, intensity_scale=intensity_scale
+    )
+
+    return dataset.normalized() if normalize else dataset
 
 
 @dataclass(frozen=True)
@@ -229,6 +284,7 @@ class Metadata:
 
     led_indexes: list[LEDIndexes]
     center_led_index: LEDIndexes
+    intensity_scale: Optional[list[float]] = None
 
 
 def parse_mm_metadata(
@@ -303,9 +359,17 @@ def parse_freeze_metadata(
     metadata: dict[str, Any],
     led_key: str = "led_indexes",
     center_led_key: str = "led_center",
+    exposure_time_key: str = "exposure_time_ms",
+    gain_key: str = "gain_db",
+    state_key: str = "led_state",
 ) -> Metadata:
     """Parse the metadata from a Freeze stack.
 
+    If every frame records its exposure time, the intensity scale of each frame is its LED
+    brightness times its exposure time and gain, relative to the first frame. Frames without an LED
+    state were acquired at full brightness, and frames without a gain at 0 dB. If all frames
+    received the same dose, the intensity scale is None so that the images are not rescaled.
+
     Parameters
     ----------
     metadata : dict
@@ -314,6 +378,12 @@ def parse_freeze_metadata(
         The key for the LED indexes, by default "led_indexes".
     center_led_key : str, optional
         The key for the center LED index, by default "led_center".
+    exposure_time_key : str, optional
+        The key for the exposure time in ms, by default "exposure_time_ms".
+    gain_key : str, optional
+        The key for the gain in dB, by default "gain_db".
+    state_key : str, optional
+        The key for the LED brightness in percent, by default "led_state".
 
     Returns
     -------
@@ -328,12 +398,34 @@ def parse_freeze_metadata(
     del md_json["shape"]
 
     led_indexes = []
+    doses = []
     for frame in md_json.keys():
         coords = tuple(md_json[frame][led_key])
         led_indexes.append(coords)
 
+        if exposure_time_key in md_json[frame]:
+            frame_md = md_json[frame]
+            dose = (
+                displayed_brightness(frame_md.get(state_key, 100))
+                * frame_md[exposure_time_key]
+                * 10 ** (frame_md.get(gain_key, 0) / 20)
+            )
+            if dose <= 0:
+                raise ValueError(
+                    f"{frame} received no light: its LED state, exposure time or gain is too low."
+                )
+            doses.append(dose)
+
+    intensity_scale = None
+    if len(doses) == len(led_indexes) and len(set(doses)) > 1:
+        intensity_scale = [dose / doses[0] for dose in doses]
+
     # Assumes center LED indexes remain unchanged across all frames
-    return Metadata(led_indexes=led_indexes, center_led_index=tuple(md_json[frame][center_led_key]))
+    return Metadata(
+        led_indexes=led_indexes,
+        center_led_index=tuple(md_json[frame][center_led_key]),
+        intensity_scale=intensity_scale,
+    )
 
 
 def hdr_combine(
@@ -0,0 +1,393 @@
+"""Quantitative differential phase contrast (DPC) from half-circle illumination.
+
+The `phaseTop`, `phaseBottom`, `phaseRight` and `phaseLeft` commands of the LED matrix controller
+illuminate the sample with half-circles of LEDs. Under the weak object approximation, each image is
+linear in the absorption and the phase of the sample, and its spectrum is the sum of the spectra of
+both, each filtered by a weak object transfer function (WOTF) that depends only on the pupil and
+the illumination source. Inverting this linear model with Tikhonov regularization recovers the
+phase from a cycle of four images.
+
+See Tian and Waller, Quantitative differential phase contrast imaging in an LED array microscope,
+Optics Express 23, 11394 (2015).
+
+The transfer functions only depend on the optical system and the LED geometry. `DPCSolver`
+combines them into one linear filter per image, so that a reconstruction costs one real FFT per
+image and two inverse FFTs. Solvers are cached per `DPCConfig`.
+
+Example
+-------
+
+```python
+config = DPCConfig(num_px=512, na=0.288, center_led=(16, 16), radius=3)
+solver = DPCSolver.from_config(config)
+for images in cycles:  # each an array of the four half-circle images in config.half_circles order
+    result = solver.solve(images)
+    show(result.phase)
+```
+
+"""
+from dataclasses import dataclass, field
+from enum import Enum
+from functools import lru_cache
+from typing import Optional, Sequence
+
+import numpy as np
+from numpy.fft import ifftshift, irfft2, rfft2
+from numpy.typing import NDArray
+
+from leb.ptycho.calibration import Calibration, LEDIndexes, calibrate_rectangular_matrix
+from leb.ptycho.fp import Pupil
+
+
+DEFAULT_REG_ABSORPTION = 1e-2
+"""The default Tikhonov regularization of the absorption."""
+
+DEFAULT_REG_PHASE = 1e-2
+"""The default Tikhonov regularization of the phase."""
+
+
+class DPCError(Exception):
+    pass
+
+
+class HalfCircle(Enum):
+    """The half-circle patterns of the LED matrix controller.
+
+    The values are the commands that display them. The LED y index grows downwards, so the top
+    half-circle holds the LEDs above the center row. The center row or column is always dark.
+
+    """
+
+    TOP = "phaseTop"
+    BOTTOM = "phaseBottom"
+    RIGHT = "phaseRight"
+    LEFT = "phaseLeft"
+
+    def led_indexes(self, center: LEDIndexes, radius: int) -> list[LEDIndexes]:
+        """Returns the (x, y) indexes of the LEDs that the pattern switches on.
+
+        The circle is approximated by the LEDs whose distance from the center is at most the
+        radius. The firmware rasterizes the circle with the midpoint algorithm, which may differ at
+        the edge by a single LED for some radii.
+
+        """
+        dx, dy = np.meshgrid(np.arange(-radius, radius + 1), np.arange(-radius, radius + 1))
+        inside = dx**2 + dy**2 <= radius**2
+        match self:
+            case HalfCircle.TOP:
+                inside &= dy < 0
+            case HalfCircle.BOTTOM:
+                inside &= dy > 0
+            case HalfCircle.RIGHT:
+                inside &= dx > 0
+            case HalfCircle.LEFT:
+                inside &= dx < 0
+
+        return [(center[0] + int(x), center[1] + int(y)) for x, y in zip(dx[inside], dy[inside])]
+
+    def command(self, center: LEDIndexes, radius: int, state: int = 100) -> str:
+        """Returns the command that displays the pattern."""
+        return f"{self.value} {center[0]} {center[1]} {radius} {state}"
+
+
+DPC_SEQUENCE = (HalfCircle.TOP, HalfCircle.BOTTOM, HalfCircle.RIGHT, HalfCircle.LEFT)
+"""The order in which `umanager/phase_contrast.bsh` acquires the half-circle images."""
+
+
+@dataclass(frozen=True)
+class DPCConfig:
+    """The optical system and LED geometry of a DPC acquisition.
+
+    The system parameters are the ones of `Pupil.from_system_params` and the LED geometry
+    parameters the ones of `calibrate_rectangular_matrix`. Configurations are hashable and are
+    used as the cache keys of the transfer functions.
+
+    Attributes
+    ----------
+    center_led : LEDIndexes
+        The (x, y) indexes of the LED on the optics axis, i.e. the center of the half-circles.
+    radius : int
+        The radius of the half-circles in LEDs.
+    half_circles : tuple[HalfCircle, ...]
+        The patterns of the images in the order in which they are passed to the solver.
+
+    """
+
+    num_px: int = 512
+    px_size_um: float = 5.86
+    wavelength_um: float = 0.488
+    mag: float = 10.0
+    na: float = 0.288
+    zernike_coeffs: Optional[tuple[float, ...]] = None
+    center_led: LEDIndexes = (16, 16)
+    radius: int = 3
+    pitch_mm: float = 4.0
+    lateral_offset_mm: tuple[float, float] = (0.0, 0.0)
+    axial_offset_mm: float = -65
+    rot_deg: float = 0.0
+    t_mm: float = 0.0
+    n_g: float = 1.515
+    half_circles: tuple[HalfCircle, ...] = field(default=DPC_SEQUENCE)
+
+    def pupil(self) -> Pupil:
+        """Returns the pupil of the optical system."""
+        return Pupil.from_system_params(
+            num_px=self.num_px,
+            px_size_um=self.px_size_um,
+            wavelength_um=self.wavelength_um,
+            mag=self.mag,
+            na=self.na,
+            zernike_coeffs=list(self.zernike_coeffs) if self.zernike_coeffs is not None else None,
+        )
+
+    def calibration(self, half_circle: HalfCircle) -> Calibration:
+        """Returns the wavevectors of the LEDs of a half-circle."""
+        return calibrate_rectangular_matrix(
+            half_circle.led_indexes(self.center_led, self.radius),
+            self.center_led,
+            pitch_mm=self.pitch_mm,
+            lateral_offset_mm=self.lateral_offset_mm,
+            axial_offset_mm=self.axial_offset_mm,
+            rot_deg=self.rot_deg,
+            wavelength_um=self.wavelength_um,
+            t_mm=self.t_mm,
+            n_g=self.n_g,
+        )
+
+
+@dataclass(frozen=True)
+class TransferFunctions:
+    """The weak object transfer functions of a set of images.
+
+    The arrays have the shape (num_images, num_px, num_px) and the layout of `numpy.fft.fft2`, i.e.
+    the zero frequency is at index (0, 0). They are normalized by the background intensity of
+    each image.
+
+    """
+
+    absorption: NDArray[np.complex128]
+    phase: NDArray[np.complex128]
+
+
+@dataclass(frozen=True)
+class DPCResult:
+    """The absorption and the phase of a weak object.
+
+    The complex transmission of the object is `exp(-absorption + 1j * phase)`. Neither contains the
+    zero frequency, i.e. both have a mean of zero.
+
+    """
+
+    absorption: NDArray[np.float64]
+    phase: NDArray[np.float64]
+
+
+def source(
+    pupil: Pupil,
+    calibration: Calibration,
+    weights: Optional[Sequence[float]] = None,
+) -> NDArray[np.float64]:
+    """Returns the illumination source of a set of LEDs on the pupil grid.
+
+    Each LED is a point source at the pixel of its transverse wavevector, with the same sign
+    convention as `fp_recover`. The source is centered like the pupil.
+
+    Parameters
+    ----------
+    pupil : Pupil
+        The pupil that defines the grid.
+    calibration : Calibration
+        The wavevectors of the LEDs that are switched on.
+    weights : Sequence[float], optional
+        The relative brightness of each LED. Defaults to equally bright LEDs.
+
+    """
+    num_px = pupil.p.shape[0]
+    wavevectors = np.array(list(calibration.values()), dtype=np.float64).reshape(-1, 3)
+    if weights is None:
+        weights = np.ones(len(wavevectors))
+
+    # fp_recover images an LED with transverse wavevector k through the object spectrum at
+    # u + k, which is a source point at -k.
+    k_px = np.round(-wavevectors[:, :2] / pupil.dk).astype(int) + num_px // 2
+    inside = np.all((k_px >= 0) & (k_px < num_px), axis=1)
+
+    s = np.zeros((num_px, num_px))
+    np.add.at(s, (k_px[inside, 1], k_px[inside, 0]), np.asarray(weights, dtype=np.float64)[inside])
+    return s
+
+
+def transfer_functions(pupil: Pupil, sources: Sequence[NDArray[np.float64]]) -> TransferFunctions:
+    """Computes the weak object transfer functions of partially coherent illumination.
+
+    For a source S and a pupil P, the absorption and phase transfer functions are
+
+        H_abs(u) = -(A(u) + conj(A(-u))) / B
+        H_phase(u) = 1j * (A(u) - conj(A(-u))) / B
+
+    where A(u) = sum_u' S(u') conj(P(u')) P(u' + u) and B = sum_u' S(u') |P(u')|^2. The correlation
+    A is computed with FFTs.
+
+    Parameters
+    ----------
+    pupil : Pupil
+        The pupil of the optical system.
+    sources : Sequence[NDArray[np.float64]]
+        The illumination source of each image, centered like the pupil (see `source`).
+
+    Raises
+    ------
+    DPCError
+        If a source does not illuminate the pupil, i.e. it only produces a dark field image.
+
+    """
+    p = ifftshift(pupil.p)
+    fft_p = np.fft.fft2(p)
+
+    h_abs, h_phase = [], []
+    for s in sources:
+        sp = ifftshift(s) * np.conj(p)
+        background = np.sum(ifftshift(s) * np.abs(p) ** 2)
+        if background <= 0:
+            raise DPCError("The source does not illuminate the pupil.")
+
+        a = np.fft.ifft2(np.conj(np.fft.fft2(np.conj(sp))) * fft_p)
+        a_mirrored = np.conj(np.roll(a[::-1, ::-1], 1, axis=(0, 1)))  # conj(A(-u))
+
+        h_abs.append(-(a + a_mirrored) / background)
+        h_phase.append(1j * (a - a_mirrored) / background)
+
+    return TransferFunctions(absorption=np.array(h_abs), phase=np.array(h_phase))
+
+
+class DPCSolver:
+    """Recovers the absorption and phase of weak objects from DPC images.
+
+    The solver minimizes
+
+        sum_j |I_j - H_abs,j * mu - H_phase,j * phi|^2 + reg_absorption |mu|^2 + reg_phase |phi|^2
+
+    in the Fourier domain, where I_j is the spectrum of the j-th normalized image. The solution is
+    linear in the images, so the solver precomputes one filter per image for the absorption and one
+    for the phase.
+
+    Parameters
+    ----------
+    wotf : TransferFunctions
+        The transfer functions of the images.
+    reg_absorption : float
+        The regularization of the absorption. Larger values suppress noise at frequencies that the
+        images transfer weakly.
+    reg_phase : float
+        The regularization of the phase.
+
+    """
+
+    def __init__(
+        self,
+        wotf: TransferFunctions,
+        reg_absorption: float = DEFAULT_REG_ABSORPTION,
+        reg_phase: float = DEFAULT_REG_PHASE,
+    ):
+        if reg_absorption <= 0 or reg_phase <= 0:
+            raise DPCError("The regularization parameters must be positive.")
+
+        self.wotf = wotf
+        self.reg_absorption = reg_absorption
+        self.reg_phase = reg_phase
+        self.shape = wotf.absorption.shape[1:]
+
+        # The object is real, so only the half-spectrum of rfft2 is needed.
+        num_cols = self.shape[1] // 2 + 1
+        h_abs = wotf.absorption[..., :num_cols]
+        h_phase = wotf.phase[..., :num_cols]
+
+        # Invert the 2 x 2 normal equations at every frequency.
+        a = np.sum(np.abs(h_abs) ** 2, axis=0) + reg_absorption
+        d = np.sum(np.abs(h_phase) ** 2, axis=0) + reg_phase
+        b = np.sum(np.conj(h_abs) * h_phase, axis=0)
+        det = a * d - np.abs(b) ** 2
+
+        self._absorption_filters = (d * np.conj(h_abs) - b * np.conj(h_phase)) / det
+        self._phase_filters = (a * np.conj(h_phase) - np.conj(b) * np.conj(h_abs)) / det
+
+    @classmethod
+    def from_config(
+        cls,
+        config: DPCConfig,
+        reg_absorption: float = DEFAULT_REG_ABSORPTION,
+        reg_phase: float = DEFAULT_REG_PHASE,
+    ) -> "DPCSolver":
+        """Returns the solver of a configuration, computing it only on the first call."""
+        return _cached_solver(config, reg_absorption, reg_phase)
+
+    @property
+    def num_images(self) -> int:
+        return self.wotf.absorption.shape[0]
+
+    def solve(self, images: NDArray) -> DPCResult:
+        """Recovers the absorption and phase from one image per transfer function.
+
+        Each image is normalized by its mean, which removes the differences in brightness between
+        the half-circles.
+
+        Parameters
+        ----------
+        images : NDArray
+            The images, with the shape (num_images, num_px, num_px).
+
+        """
+        images = np.asarray(images, dtype=np.float64)
+        if images.shape != (self.num_images, *self.shape):
+            raise DPCError(
+                f"Expected images of shape {(self.num_images, *self.shape)}, got {images.shape}"
+            )
+
+        means = images.mean(axis=(1, 2), keepdims=True)
+        if np.any(means <= 0):
+            raise DPCError("The images must have a positive mean intensity.")
+
+        spectra = rfft2(images / means - 1)
+        absorption = irfft2(np.einsum("jkl,jkl->kl", self._absorption_filters, spectra), self.shape)
+        phase = irfft2(np.einsum("jkl,jkl->kl", self._phase_filters, spectra), self.shape)
+
+        return DPCResult(absorption=absorption, phase=phase)
+
+
+@lru_cache(maxsize=8)
+def config_transfer_functions(config: DPCConfig) -> TransferFunctions:
+    """Returns the transfer functions of a configuration, computing them only on the first call."""
+    pupil = config.pupil()
+    sources = [
+        source(pupil, config.calibration(half_circle)) for half_circle in config.half_circles
+    ]
+    return transfer_functions(pupil, sources)
+
+
+@lru_cache(maxsize=8)
+def _cached_solver(config: DPCConfig, reg_absorption: float, reg_phase: float) -> DPCSolver:
+    return DPCSolver(config_transfer_functions(config), reg_absorption, reg_phase)
+
+
+def dpc_recover(
+    images: NDArray,
+    config: DPCConfig,
+    reg_absorption: float = DEFAULT_REG_ABSORPTION,
+    reg_phase: float = DEFAULT_REG_PHASE,
+) -> DPCResult:
+    """Recovers the absorption and phase of a weak object from a cycle of half-circle images.
+
+    Parameters
+    ----------
+    images : NDArray
+        The images, with the shape (len(config.half_circles), num_px, num_px), in the order of
+        config.half_circles.
+    config : DPCConfig
+        The optical system and LED geometry.
+    reg_absorption : float
+        The Tikhonov regularization of the absorption.
+    reg_phase : float
+        The Tikhonov regularization of the phase.
+
+    """
+    return DPCSolver.from_config(config, reg_absorption, reg_phase).solve(images)
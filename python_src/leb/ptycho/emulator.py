@@ -0,0 +1,1138 @@
+"""An emulator of the LED matrix controller on a pseudo-terminal.
+
+The emulator speaks the serial protocol of the Arduino control code in
+`arduino_src/led_matrix_controller`: the same commands, replies, error messages and help text, the
+`0`/`1` acknowledgements and the 48 character line limit. It keeps a virtual frame buffer that
+is drawn with the same algorithms as Adafruit_GFX, so patterns can be checked pixel by pixel.
+
+The serial link and the rendering time can be modeled. Bytes take 10 bit times to arrive at the
+configured baud rate, every rendered pattern takes `render_time_s`, and incoming bytes that do
+not fit into the 256 byte receive buffer while the emulator is busy stay in the pseudo-terminal
+until there is room, just like they stay in the board's USB buffers.
+
+Only Unix-like systems provide pseudo-terminals.
+
+Example
+-------
+
+```python
+with Emulator(render_time_s=0.002) as emulator:
+    with LEDController(emulator.port) as ctrl:
+        ctrl.send("brightfield 16 16 3 100")
+    print(emulator.framebuffer()[16, 13:20])
+```
+
+"""
+from dataclasses import dataclass, field, replace
+from enum import Enum
+import os
+import re
+import select
+import threading
+import time
+import tty
+from typing import Optional
+
+import numpy as np
+
+from leb.ptycho.trace import TRACE_SIZE, TraceEvent, TraceSource
+
+
+CHAR_LIMIT = 48
+RX_BUFFER_SIZE = 256
+SCHEDULE_SIZE = 64
+PRELOAD_SIZE = 64
+PANEL_SIZE = 32
+BIT_DEPTH = 4
+MAX_BRIGHTNESS = 31
+DITHER_MAX_BITS = 4
+DITHER_MIN_SUBFRAME_US = 1000
+NUM_BUCKETS = 16
+READ_TIMEOUT_S = 1.0
+BENCH_MAX_ITERATIONS = 10000
+MACRO_SLOTS = 16
+MACRO_LENGTH = 8
+FIRMWARE_VERSION = "3.0.0"
+BUILD = "emulator"
+
+BENCH_RADII = (1, 4, 8, 16)
+
+OK = b"0\n"
+ERROR = b"1\n"
+
+HELP = [
+    "Available commands:",
+    "  draw <x> <y> (0 - 100)\\n",
+    "  single <x> <y> (0 - 100)\\n",
+    "  fill (0 - 100)\\n",
+    "  brightfield <x> <y> <r> (0 - 100)\\n",
+    "  darkfield <x> <y> <r> (0 - 100)\\n",
+    "  phaseTop <x> <y> <r> (0 - 100)\\n",
+    "  phaseBottom <x> <y> <r> (0 - 100)\\n",
+    "  phaseRight <x> <y> <r> (0 - 100)\\n",
+    "  phaseLeft <x> <y> <r> (0 - 100)\\n",
+    "  ring <x> <y> <r_in> <r_out> (0 - 100)\\n",
+    "  rings <x> <y> <r_in> <r_out> <count> (0 - 100)\\n",
+    "  at <t_us> <drawing command>\\n",
+    "  play <period_us> <cycles>\\n",
+    "  stop\\n",
+    "  status\\n",
+    "  clearSchedule\\n",
+    "  stats\\n",
+    "  geometry <panels_x> <panels_y> (0 - 1)\\n",
+    "  sync (off | leader | follower)\\n",
+    "  preload <drawing command>\\n",
+    "  advance\\n",
+    "  skew\\n",
+    "  clearPreload\\n",
+    "  cyclePreload (on | off)\\n",
+    "  dither (0 - 4) [subframe_us]\\n",
+    "  trace\\n",
+    "  bench <iterations>\\n",
+    "  version\\n",
+    "  def <slot> <drawing command>\\n",
+    "  undef <slot>\\n",
+    "  @<slot>\\n",
+    "  boot (-1 - 15)\\n",
+    "  save\\n",
+    "  macros\\n",
+    "  help\\n",
+    "",
+    "Note: commands must be terminated with a \\n character.",
+]
+"""The lines of the controller's help text."""
+
+
+class Command(Enum):
+    DRAW = "draw"
+    SINGLE = "single"
+    FILL = "fill"
+    BRIGHTFIELD = "brightfield"
+    DARKFIELD = "darkfield"
+    PHASE_TOP = "phaseTop"
+    PHASE_BOTTOM = "phaseBottom"
+    PHASE_RIGHT = "phaseRight"
+    PHASE_LEFT = "phaseLeft"
+    RING = "ring"
+    RINGS = "rings"
+    PLAY = "play"
+    STOP = "stop"
+    STATUS = "status"
+    CLEAR_SCHEDULE = "clearSchedule"
+    STATS = "stats"
+    GEOMETRY = "geometry"
+    SYNC = "sync"
+    ADVANCE = "advance"
+    SKEW = "skew"
+    CLEAR_PRELOAD = "clearPreload"
+    CYCLE_PRELOAD = "cyclePreload"
+    DITHER = "dither"
+    TRACE = "trace"
+    BENCH = "bench"
+    VERSION = "version"
+    RECALL = "@"
+    DEF = "def"
+    UNDEF = "undef"
+    SAVE = "save"
+    MACROS = "macros"
+    BOOT = "boot"
+    HELP = "help"
+
+
+DRAWING_COMMANDS = {
+    Command.RECALL,
+    Command.DRAW,
+    Command.SINGLE,
+    Command.FILL,
+    Command.BRIGHTFIELD,
+    Command.DARKFIELD,
+    Command.PHASE_TOP,
+    Command.PHASE_BOTTOM,
+    Command.PHASE_RIGHT,
+    Command.PHASE_LEFT,
+    Command.RING,
+    Command.RINGS,
+}
+
+# The number of integer arguments of each command and the checks on them, as in comms.cpp
+_INT_ARGS = {
+    Command.DRAW: 3,
+    Command.SINGLE: 3,
+    Command.FILL: 1,
+    Command.BRIGHTFIELD: 4,
+    Command.DARKFIELD: 4,
+    Command.PHASE_TOP: 4,
+    Command.PHASE_BOTTOM: 4,
+    Command.PHASE_RIGHT: 4,
+    Command.PHASE_LEFT: 4,
+    Command.RING: 5,
+    Command.RINGS: 6,
+    Command.GEOMETRY: 3,
+    Command.DITHER: 2,
+    Command.BENCH: 1,
+}
+
+BENCH_PRIMITIVES = {
+    Command.DRAW: False,
+    Command.SINGLE: False,
+    Command.FILL: False,
+    Command.BRIGHTFIELD: True,
+    Command.DARKFIELD: True,
+    Command.PHASE_TOP: True,
+    Command.PHASE_BOTTOM: True,
+    Command.PHASE_RIGHT: True,
+    Command.PHASE_LEFT: True,
+    Command.RING: True,
+    Command.RINGS: True,
+}
+"""The benchmarked drawing primitives and whether they are benchmarked at several radii."""
+
+BENCH_PARSER_INPUTS = {
+    "parse.draw": "draw 16 16 100\n",
+    "parse.brightfield": "brightfield 16 16 8 100\n",
+    "parse.rings": "rings 16 16 2 3 4 100\n",
+    "parse.at": "at 1000000 single 16 16 100\n",
+    "parse.preload": "preload fill 50\n",
+    "parse.status": "status\n",
+}
+
+_INT = re.compile(r"\s*([+-]?\d+)")
+
+
+class Deferral(Enum):
+    NONE = 0
+    SCHEDULE = 1
+    PRELOAD = 2
+    MACRO = 3
+
+
+@dataclass
+class Message:
+    """A parsed command. Fields are used as in the firmware's Message struct."""
+
+    cmd: Command = Command.DRAW
+    x: int = 0
+    y: int = 0
+    r: int = 0
+    r_out: int = 0
+    count: int = 0
+    state: int = 0
+    t_us: int = 0
+    slot: int = 0
+    deferral: Deferral = Deferral.NONE
+    sync_mode: str = "off"
+    is_valid: bool = False
+
+
+def _scan_ints(args: str, n: int) -> list[int]:
+    """Parses up to n leading integers like sscanf with "%d %d ..."."""
+    values = []
+    pos = 0
+    for _ in range(n):
+        match = _INT.match(args, pos)
+        if match is None:
+            break
+        values.append(int(match.group(1)))
+        pos = match.end()
+    return values
+
+
+def _unsigned_long(value: int) -> int:
+    return value & 0xFFFFFFFF
+
+
+@dataclass
+class _Histogram:
+    count: int = 0
+    min_us: int = 0
+    max_us: int = 0
+    total_us: int = 0
+    buckets: list[int] = field(default_factory=lambda: [0] * NUM_BUCKETS)
+
+    def record(self, duration_us: int) -> None:
+        if self.count == 0 or duration_us < self.min_us:
+            self.min_us = duration_us
+        self.max_us = max(self.max_us, duration_us)
+        self.total_us += duration_us
+        self.count += 1
+        bucket = min(max(duration_us, 1).bit_length() - 1, NUM_BUCKETS - 1)
+        self.buckets[bucket] += 1
+
+
+class Emulator:
+    """An LED matrix controller on a pseudo-terminal.
+
+    Parameters
+    ----------
+    baudrate : int, optional
+        The baud rate of the modeled serial link. None transfers bytes without delay.
+    render_time_s : float
+        The time that drawing and displaying a pattern takes.
+    chain_length : int
+        The number of chained panels.
+    flash : dict, optional
+        The flash contents of another emulator, to emulate a power cycle. Saved macros are loaded
+        from it and the boot macro is displayed on start.
+
+    Attributes
+    ----------
+    port : str
+        The path of the pseudo-terminal that clients connect to.
+    flash : dict
+        The macros and the boot macro as of the last `save` command.
+
+    """
+
+    def __init__(
+        self,
+        baudrate: Optional[int] = None,
+        render_time_s: float = 0.0,
+        chain_length: int = 1,
+        flash: Optional[dict] = None,
+    ):
+        self.baudrate = baudrate
+        self.render_time_s = render_time_s
+        self.chain_length = chain_length
+
+        self._master, self._slave = os.openpty()
+        self.port = os.ttyname(self._slave)
+        # Raw mode passes bytes through unchanged.
+        tty.setraw(self._slave)
+
+        self._lock = threading.RLock()
+        self._thread: Optional[threading.Thread] = None
+        self._running = False
+
+        # Serial input: the receive ring as (time of arrival, byte) pairs, and the partial line
+        self._rx: list[tuple[float, int]] = []
+        self._rx_stats = {"bytes": 0, "overflows": 0, "truncated": 0, "high_water": 0}
+        self._link_free_at = 0.0
+        self._input = bytearray()
+        self._last_input_at: Optional[float] = None
+
+        # The firmware never clears its error message between commands.
+        self._error_msg = ""
+
+        # Frame buffer of the whole chain and the tiling that maps global coordinates onto it
+        self._chain = np.zeros((PANEL_SIZE, PANEL_SIZE * chain_length), dtype=np.uint16)
+        self._panels_x = chain_length
+        self._panels_y = 1
+        self._serpentine = False
+        self._levels: Optional[np.ndarray] = None
+        self._extra_bits = 0
+        self._subframe_us = 0
+        self._max_level = MAX_BRIGHTNESS
+
+        # Schedule, as in schedule.cpp
+        self._schedule: list[Message] = []
+        self._schedule_running = False
+        self._period_us = 0
+        self._num_cycles = 0
+        self._next = 0
+        self._cycle = 0
+        self._underruns = 0
+        self._pending = -1
+        self._cycle_start = 0.0
+
+        # Synchronization, as in sync.cpp
+        self._sync_mode = "off"
+        self._preload: list[Message] = []
+        self._preload_head = 0  # next pattern to latch; earlier ones are kept while cycling
+        self._preload_cycling = False
+        self._latched: Optional[Message] = None
+        self._edge_time = 0.0
+        self._sync_stats = _new_sync_stats()
+
+        self._histograms = {stage: _Histogram() for stage in ("parse", "render", "show", "dither")}
+
+        # Event trace, as in trace.cpp
+        self._boot = time.monotonic()
+        self._trace: list[TraceEvent] = []
+        self._trace_seq = 0
+        self._trace_lost = 0
+
+        # Macros, as in macros.cpp
+        self.flash = flash if flash is not None else {"macros": [[]] * MACRO_SLOTS, "boot": -1}
+        self._macros: list[list[Message]] = [list(macro) for macro in self.flash["macros"]]
+        self._boot_slot: int = self.flash["boot"]
+
+    def __enter__(self) -> "Emulator":
+        self.start()
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def start(self) -> None:
+        """Starts answering commands in a background thread."""
+        self._running = True
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+        self._write(b"Protomatter begin() status: 0\r\n")
+        if self._boot_slot >= 0:
+            with self._lock:
+                self._render(Message(cmd=Command.RECALL, slot=self._boot_slot))
+
+    def close(self) -> None:
+        """Stops the emulator and closes the pseudo-terminal."""
+        self._running = False
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+        os.close(self._master)
+        os.close(self._slave)
+
+    @property
+    def width(self) -> int:
+        """The width of the tiling in LEDs."""
+        return self._panels_x * PANEL_SIZE
+
+    @property
+    def height(self) -> int:
+        """The height of the tiling in LEDs."""
+        return self._panels_y * PANEL_SIZE
+
+    def framebuffer(self) -> np.ndarray:
+        """Returns the displayed brightness of every LED, relative to full brightness.
+
+        The array is indexed as [y, x] in global LED coordinates. In dithering mode the brightness
+        is the average over a full cycle of subframes.
+
+        """
+        with self._lock:
+            hw_max = 2**BIT_DEPTH - 1
+            shift = 5 - BIT_DEPTH
+            if self._levels is not None:
+                bits = self._extra_bits
+                mask = (1 << bits) - 1
+                levels = self._levels.astype(np.int64)
+                total = np.zeros(levels.shape)
+                for t in range(1 << bits):
+                    threshold = _reverse_bits(t, bits)
+                    hw = (levels >> bits) + ((levels & mask) > threshold)
+                    total += (((hw << shift) & 0xFFFF) & 0x1F) >> shift
+                return total / (1 << bits) / hw_max
+
+            ys, xs = np.mgrid[0 : self.height, 0 : self.width]
+            colors = np.zeros((self.height, self.width), dtype=np.int64)
+            for y, x in zip(ys.ravel(), xs.ravel()):
+                chain_x, chain_y = self._to_chain(x, y)
+                colors[y, x] = self._chain[chain_y, chain_x]
+            return ((colors & 0x1F) >> shift) / hw_max
+
+    def micros(self) -> int:
+        """The emulated controller's micros() clock, which wraps around at 32 bits."""
+        return int((time.monotonic() - self._boot) * 1e6) % 2**32
+
+    def sync_edge(self) -> None:
+        """Puts a rising edge on the sync line, e.g. from a camera's exposure output."""
+        with self._lock:
+            if self._sync_mode == "follower":
+                self._on_sync_edge()
+
+    ###############################################################################################
+    # Main loop
+    ###############################################################################################
+    def _run(self) -> None:
+        while self._running:
+            self._pump(self._idle_timeout())
+
+            with self._lock:
+                if self._latched is not None:
+                    msg, edge_time = self._latched, self._edge_time
+                    self._latched = None
+                    self._render(msg, TraceSource.SYNC)
+                    self._sync_rendered(edge_time)
+                self._schedule_tick()
+                if self._pending >= 0:
+                    msg = self._schedule[self._pending]
+                    self._pending = -1
+                    self._render(msg, TraceSource.SCHEDULE)
+
+            line = self._read_line()
+            if line is not None:
+                self._handle_line(line)
+
+    def _idle_timeout(self) -> float:
+        timeout = 0.01
+        if self._rx:
+            timeout = max(0.0, self._rx[0][0] - time.monotonic())
+        if self._schedule_running and self._next < len(self._schedule):
+            due = self._cycle_start + self._schedule[self._next].t_us * 1e-6
+            timeout = min(timeout, max(0.0, due - time.monotonic()))
+        return min(timeout, 0.01)
+
+    def _pump(self, timeout: float) -> None:
+        """Moves the bytes waiting on the pseudo-terminal into the receive ring."""
+        room = RX_BUFFER_SIZE - len(self._rx)
+        if room == 0:
+            # Leave the input in the pseudo-terminal, which holds the writer back.
+            time.sleep(timeout)
+            timeout = 0.0
+        try:
+            readable, _, _ = select.select([self._master], [], [], timeout)
+        except (OSError, ValueError):
+            self._running = False
+            return
+        if not readable:
+            return
+        if room == 0:
+            self._rx_stats["overflows"] += 1
+            return
+        try:
+            data = os.read(self._master, room)
+        except OSError:
+            return
+
+        now = time.monotonic()
+        byte_time = 10 / self.baudrate if self.baudrate else 0.0
+        arrival = max(now, self._link_free_at)
+        for byte in data:
+            arrival += byte_time
+            self._rx.append((arrival, byte))
+            self._rx_stats["bytes"] += 1
+            self._rx_stats["high_water"] = max(self._rx_stats["high_water"], len(self._rx))
+        self._link_free_at = arrival
+        if len(data) == room and select.select([self._master], [], [], 0)[0]:
+            # The ring is full and input is still waiting.
+            self._rx_stats["overflows"] += 1
+
+    def _read_line(self) -> Optional[bytes]:
+        """Reads from the receive ring like readStringUntil in comms.cpp."""
+        now = time.monotonic()
+        while self._rx and self._rx[0][0] <= now:
+            _, byte = self._rx.pop(0)
+            self._last_input_at = None
+            self._input.append(byte)
+            if byte == ord("\n"):
+                return self._take_input()
+            if len(self._input) >= CHAR_LIMIT:
+                self._rx_stats["truncated"] += 1
+                return self._take_input()
+            self._last_input_at = now
+
+        if self._last_input_at is not None and now - self._last_input_at > READ_TIMEOUT_S:
+            self._last_input_at = None
+            return self._take_input()
+        return None
+
+    def _take_input(self) -> bytes:
+        line = bytes(self._input)
+        self._input.clear()
+        return line
+
+    def _handle_line(self, line: bytes) -> None:
+        start = time.perf_counter()
+        msg = self._parse(line.decode("ascii", errors="replace"))
+        self._record("parse", start)
+
+        with self._lock:
+            if msg.is_valid:
+                if msg.deferral == Deferral.SCHEDULE:
+                    ok = self._add_to_schedule(msg)
+                elif msg.deferral == Deferral.PRELOAD:
+                    ok = self._add_to_preload(msg)
+                elif msg.deferral == Deferral.MACRO:
+                    ok = self._add_to_macro(msg)
+                else:
+                    ok = self._do_action(msg)
+                self._write(OK if ok else ERROR)
+            else:
+                self._println(self._error_msg)
+                self._print_help()
+                self._write(ERROR)
+
+    ###############################################################################################
+    # Serial output
+    ###############################################################################################
+    def _write(self, data: bytes) -> None:
+        if self.baudrate:
+            time.sleep(len(data) * 10 / self.baudrate)
+        try:
+            os.write(self._master, data)
+        except OSError:
+            self._running = False
+
+    def _println(self, line: str) -> None:
+        # Serial.println terminates lines with CR LF.
+        self._write(line.encode("ascii") + b"\r\n")
+
+    def _print_help(self) -> None:
+        self._write(b"".join(line.encode("ascii") + b"\r\n" for line in HELP))
+
+    ###############################################################################################
+    # Parsing, as in comms.cpp
+    ###############################################################################################
+    def _parse(self, line: str) -> Message:
+        msg = Message()
+        if not line.endswith("\n"):
+            self._error_msg = "No line terminator found"
+            return msg
+
+        verb, sep, args = line.partition(" ")
+        if not sep:
+            verb = line[:-1]
+
+        msg.is_valid = True
+        if verb.lower() == "at":
+            values = re.match(r"\s*([+-]?\d+)\s*", args)
+            if values is None or values.end() == 0:
+                msg.is_valid = False
+                return msg
+            msg = self._parse_deferred(args[values.end() :])
+            if msg.is_valid:
+                msg.t_us = _unsigned_long(int(values.group(1)))
+                msg.deferral = Deferral.SCHEDULE
+            return msg
+        if verb.lower() == "preload":
+            msg = self._parse_deferred(args)
+            if msg.is_valid:
+                msg.deferral = Deferral.PRELOAD
+            return msg
+        if verb.lower() == "def":
+            values = re.match(r"\s*([+-]?\d+)\s*", args)
+            if values is None or not 0 <= int(values.group(1)) < MACRO_SLOTS:
+                msg.is_valid = False
+                return msg
+            msg = self._parse_deferred(args[values.end() :])
+            if msg.is_valid:
+                msg.slot = int(values.group(1))
+                msg.deferral = Deferral.MACRO
+            return msg
+        if verb.startswith("@"):
+            msg.cmd = Command.RECALL
+            self._parse_slot(verb[1:], msg)
+            return msg
+
+        for cmd in Command:
+            if verb.lower() == cmd.value.lower():
+                msg.cmd = cmd
+                break
+        else:
+            msg.is_valid = False
+            self._error_msg = "Unrecognized command: " + line
+            return msg
+
+        if msg.cmd in (Command.UNDEF, Command.BOOT):
+            self._parse_slot(args, msg)
+        else:
+            self._parse_args(args, msg)
+        return msg
+
+    def _parse_deferred(self, line: str) -> Message:
+        msg = self._parse(line)
+        if not msg.is_valid:
+            return msg
+        if msg.deferral != Deferral.NONE or msg.cmd not in DRAWING_COMMANDS:
+            msg.is_valid = False
+            self._error_msg = "Only drawing commands can be deferred"
+        return msg
+
+    @staticmethod
+    def _parse_slot(args: str, msg: Message) -> None:
+        values = _scan_ints(args, 1)
+        min_slot = -1 if msg.cmd == Command.BOOT else 0
+        if len(values) == 1 and min_slot <= values[0] < MACRO_SLOTS:
+            msg.slot = values[0]
+        else:
+            msg.is_valid = False
+
+    def _parse_args(self, args: str, msg: Message) -> None:
+        cmd = msg.cmd
+        if cmd == Command.SYNC:
+            mode = args[:-1]
+            if mode.lower() in ("off", "leader", "follower"):
+                msg.sync_mode = mode.lower()
+            else:
+                msg.is_valid = False
+            return
+        if cmd == Command.CYCLE_PRELOAD:
+            state = args[:-1].lower()
+            if state in ("on", "off"):
+                msg.count = int(state == "on")
+            else:
+                msg.is_valid = False
+            return
+        if cmd == Command.PLAY:
+            values = _scan_ints(args, 2)
+            if len(values) == 2 and _unsigned_long(values[0]) > 0 and values[1] >= 0:
+                msg.t_us = _unsigned_long(values[0])
+                msg.count = values[1]
+            else:
+                msg.is_valid = False
+            return
+        if cmd not in _INT_ARGS:
+            return
+
+        values = _scan_ints(args, _INT_ARGS[cmd])
+        if cmd == Command.DITHER and len(values) == 1:
+            values.append(0)  # the subframe period is optional
+        if len(values) != _INT_ARGS[cmd]:
+            msg.is_valid = False
+            return
+
+        if cmd in (Command.DRAW, Command.SINGLE):
+            msg.x, msg.y, msg.state = values
+        elif cmd == Command.FILL:
+            (msg.state,) = values
+        elif cmd == Command.RING:
+            x, y, r_in, r_out, state = values
+            if r_in >= 0 and r_out >= r_in:
+                msg.x, msg.y, msg.r, msg.r_out, msg.state = values
+            else:
+                msg.is_valid = False
+        elif cmd == Command.RINGS:
+            x, y, r_in, r_out, count, state = values
+            if r_in >= 0 and r_out >= r_in and count > 0:
+                msg.x, msg.y, msg.r, msg.r_out, msg.count, msg.state = values
+            else:
+                msg.is_valid = False
+        elif cmd == Command.GEOMETRY:
+            panels_x, panels_y, serpentine = values
+            if panels_x > 0 and panels_y > 0 and serpentine in (0, 1):
+                msg.x, msg.y, msg.count = values
+            else:
+                msg.is_valid = False
+        elif cmd == Command.BENCH:
+            if 1 <= values[0] <= BENCH_MAX_ITERATIONS:
+                msg.count = values[0]
+            else:
+                msg.is_valid = False
+        elif cmd == Command.DITHER:
+            if values[0] > DITHER_MAX_BITS:
+                msg.is_valid = False
+                self._error_msg = f"Cannot dither with more than {DITHER_MAX_BITS} extra bits"
+            elif values[0] >= 0:
+                msg.count, msg.t_us = values
+            else:
+                msg.is_valid = False
+        else:
+            msg.x, msg.y, msg.r, msg.state = values
+
+    ###############################################################################################
+    # Actions, as in led_matrix_controller.ino
+    ###############################################################################################
+    def _do_action(self, msg: Message) -> bool:
+        if msg.cmd == Command.RECALL and not self._macros[msg.slot]:
+            self._println("The macro is empty")
+            return False
+        if msg.cmd in DRAWING_COMMANDS:
+            self._render(msg)
+            return True
+
+        match msg.cmd:
+            case Command.PLAY:
+                if (
+                    self._schedule_running
+                    or not self._schedule
+                    or self._schedule[-1].t_us >= msg.t_us
+                ):
+                    self._println(
+                        "Cannot play: running, empty, or entries do not fit in the period"
+                    )
+                    return False
+                self._period_us = msg.t_us
+                self._num_cycles = msg.count
+                self._next = 0
+                self._cycle = 0
+                self._underruns = 0
+                self._pending = -1
+                self._cycle_start = time.monotonic()
+                self._schedule_running = True
+                self._schedule_tick()
+            case Command.STOP:
+                self._schedule_running = False
+                self._pending = -1
+            case Command.STATUS:
+                self._println(
+                    f"running={int(self._schedule_running)} entries={len(self._schedule)} "
+                    f"next={self._next} cycle={self._cycle} underruns={self._underruns}"
+                )
+            case Command.CLEAR_SCHEDULE:
+                if self._schedule_running:
+                    self._println("Cannot clear the schedule while it is running")
+                    return False
+                self._schedule.clear()
+            case Command.STATS:
+                self._print_stats()
+            case Command.GEOMETRY:
+                if msg.x * msg.y > self.chain_length:
+                    self._println("The geometry needs more panels than there are in the chain")
+                    return False
+                self._panels_x, self._panels_y, self._serpentine = msg.x, msg.y, bool(msg.count)
+                if self._extra_bits > 0:
+                    self._set_dither_bits(self._extra_bits, self._subframe_us)
+            case Command.SYNC:
+                self._sync_mode = msg.sync_mode
+            case Command.ADVANCE:
+                if self._sync_mode != "leader":
+                    self._println("Only the sync leader can advance")
+                    return False
+                self._on_sync_edge()
+            case Command.SKEW:
+                self._print_skew()
+            case Command.CLEAR_PRELOAD:
+                self._preload.clear()
+                self._preload_head = 0
+                self._latched = None
+            case Command.CYCLE_PRELOAD:
+                del self._preload[: self._preload_head]
+                self._preload_head = 0
+                self._preload_cycling = bool(msg.count)
+            case Command.DITHER:
+                if not self._set_dither_bits(msg.count, msg.t_us):
+                    self._println(
+                        "Cannot dither: too many extra bits, too short subframes or no memory"
+                    )
+                    return False
+            case Command.TRACE:
+                self._print_trace()
+            case Command.BENCH:
+                self._bench(msg.count)
+                self._fill_screen(0)
+            case Command.VERSION:
+                self._println(f"version {FIRMWARE_VERSION} {BUILD}")
+            case Command.UNDEF:
+                self._macros[msg.slot] = []
+            case Command.SAVE:
+                self.flash = {
+                    "macros": [[replace(step) for step in macro] for macro in self._macros],
+                    "boot": self._boot_slot,
+                }
+            case Command.MACROS:
+                self._println(f"boot {self._boot_slot}")
+                for slot, macro in enumerate(self._macros):
+                    if macro:
+                        self._println(f"macro {slot} {len(macro)}")
+            case Command.BOOT:
+                self._boot_slot = msg.slot
+            case Command.HELP:
+                self._print_help()
+        return True
+
+    def _add_to_schedule(self, msg: Message) -> bool:
+        if (
+            self._schedule_running
+            or len(self._schedule) == SCHEDULE_SIZE
+            or (self._schedule and msg.t_us < self._schedule[-1].t_us)
+        ):
+            self._println("Cannot add to schedule: running, full, or timestamp out of order")
+            return False
+        self._schedule.append(replace(msg))
+        return True
+
+    def _add_to_macro(self, msg: Message) -> bool:
+        macro = self._macros[msg.slot]
+        if len(macro) == MACRO_LENGTH or msg.cmd == Command.RECALL:
+            self._println("Cannot define: the macro is full or the command is a recall")
+            return False
+        # The firmware stores the arguments in single bytes, except for the coordinates.
+        macro.append(
+            replace(
+                msg,
+                deferral=Deferral.NONE,
+                r=msg.r & 0xFF,
+                r_out=msg.r_out & 0xFF,
+                count=msg.count & 0xFF,
+                state=msg.state & 0xFF,
+            )
+        )
+        return True
+
+    def _add_to_preload(self, msg: Message) -> bool:
+        if len(self._preload) == PRELOAD_SIZE:
+            self._println("Cannot preload: the queue is full")
+            return False
+        self._preload.append(replace(msg))
+        return True
+
+    def _schedule_tick(self) -> None:
+        while self._schedule_running:
+            elapsed_us = (time.monotonic() - self._cycle_start) * 1e6
+
+            if self._next == len(self._schedule):
+                self._cycle += 1
+                if self._num_cycles and self._cycle >= self._num_cycles:
+                    self._schedule_running = False
+                    return
+                self._cycle_start += self._period_us * 1e-6
+                self._next = 0
+                continue
+
+            if self._schedule[self._next].t_us > elapsed_us:
+                return
+
+            if self._pending >= 0:
+                self._underruns += 1
+            self._pending = self._next
+            self._next += 1
+
+    def _on_sync_edge(self) -> None:
+        stats = self._sync_stats
+        stats["edges"] += 1
+        if self._preload_head == len(self._preload):
+            stats["empty"] += 1
+            return
+        if self._latched is not None:
+            stats["missed"] += 1
+        self._latched = self._preload[self._preload_head]
+        self._edge_time = time.monotonic()
+        if self._preload_cycling:
+            self._preload_head = (self._preload_head + 1) % len(self._preload)
+        else:
+            del self._preload[0]
+
+    def _sync_rendered(self, edge_time: float) -> None:
+        latency = int((time.monotonic() - edge_time) * 1e6)
+        stats = self._sync_stats
+        if stats["rendered"] == 0 or latency < stats["min_us"]:
+            stats["min_us"] = latency
+        stats["max_us"] = max(stats["max_us"], latency)
+        stats["last_us"] = latency
+        stats["total_us"] += latency
+        stats["rendered"] += 1
+
+    def _print_skew(self) -> None:
+        s = self._sync_stats
+        mean_us = s["total_us"] // s["rendered"] if s["rendered"] else 0
+        self._println(
+            f"edges={s['edges']} rendered={s['rendered']} missed={s['missed']} "
+            f"empty={s['empty']} last_us={s['last_us']} min_us={s['min_us']} "
+            f"mean_us={mean_us} max_us={s['max_us']}"
+        )
+        self._sync_stats = _new_sync_stats()
+
+    def _print_stats(self) -> None:
+        for stage, h in self._histograms.items():
+            mean_us = h.total_us // h.count if h.count else 0
+            buckets = " ".join(str(b) for b in h.buckets)
+            self._println(f"stats {stage} {h.count} {h.min_us} {mean_us} {h.max_us} {buckets}")
+        self._histograms = {stage: _Histogram() for stage in self._histograms}
+
+        r = self._rx_stats
+        self._println(
+            f"rx_bytes={r['bytes']} rx_overflows={r['overflows']} "
+            f"rx_truncated={r['truncated']} rx_high_water={r['high_water']}"
+        )
+        self._rx_stats = {key: 0 for key in r}
+
+    def _bench(self, iterations: int) -> None:
+        """Times the drawing primitives and the parser like bench.cpp, on the host's CPU."""
+
+        def print_result(name: str, r: int, durations: list[float]) -> None:
+            us = [d * 1e6 for d in durations]
+            self._println(
+                f"bench {name} {r} {iterations} "
+                f"{min(us):.2f} {sum(us) / iterations:.2f} {max(us):.2f}"
+            )
+
+        msg = Message(x=self.width // 2, y=self.height // 2, state=100)
+        for cmd, has_radius in BENCH_PRIMITIVES.items():
+            msg.cmd = cmd
+            for r in BENCH_RADII if has_radius else (0,):
+                msg.r, msg.r_out, msg.count = r, r, 1
+                if cmd == Command.RING:
+                    msg.r = r // 2
+                elif cmd == Command.RINGS:
+                    msg.r, msg.r_out, msg.count = r % 2, r % 2, r // 2 + 1
+                durations = []
+                for _ in range(iterations):
+                    start = time.perf_counter()
+                    self._draw(msg)
+                    durations.append(time.perf_counter() - start)
+                print_result(cmd.value, r, durations)
+
+        for name, line in BENCH_PARSER_INPUTS.items():
+            durations = []
+            for _ in range(iterations):
+                start = time.perf_counter()
+                self._parse(line)
+                durations.append(time.perf_counter() - start)
+            print_result(name, 0, durations)
+
+    def _print_trace(self) -> None:
+        self._println(f"trace {len(self._trace)} {self._trace_lost}")
+        for event in self._trace:
+            self._println(event.pack().hex())
+        self._trace = []
+        self._trace_lost = 0
+
+    def _trace_record(self, msg: Message, source: TraceSource) -> None:
+        if len(self._trace) == TRACE_SIZE:
+            self._trace.pop(0)
+            self._trace_lost += 1
+        self._trace.append(
+            TraceEvent(
+                seq=self._trace_seq,
+                t_us=self.micros(),
+                cmd="recall" if msg.cmd == Command.RECALL else msg.cmd.value,
+                source=source,
+                x=msg.x,
+                y=msg.y,
+                r=msg.r,
+                r_out=msg.r_out,
+                count=msg.slot if msg.cmd == Command.RECALL else msg.count,
+                state=msg.state,
+            )
+        )
+        self._trace_seq += 1
+
+    def _record(self, stage: str, start: float) -> None:
+        self._histograms[stage].record(int((time.perf_counter() - start) * 1e6))
+
+    ###############################################################################################
+    # Drawing, as in drawing.cpp, dither.cpp and Adafruit_GFX
+    ###############################################################################################
+    def _set_dither_bits(self, extra_bits: int, subframe_us: int = 0) -> bool:
+        self._levels = None
+        self._extra_bits = 0
+        self._subframe_us = 0
+        self._max_level = MAX_BRIGHTNESS
+        self._chain[:] = 0
+
+        if extra_bits > DITHER_MAX_BITS:
+            return False
+        if subframe_us != 0 and subframe_us < DITHER_MIN_SUBFRAME_US:
+            return False
+        if extra_bits > 0:
+            self._levels = np.zeros((self.height, self.width), dtype=np.uint16)
+            self._extra_bits = extra_bits
+            self._subframe_us = subframe_us
+            self._max_level = (2**BIT_DEPTH - 1) << extra_bits
+        return True
+
+    def _level(self, state: int) -> int:
+        return int(state * self._max_level * 0.01) & 0xFFFF
+
+    def _render(self, msg: Message, source: TraceSource = TraceSource.COMMAND) -> None:
+        start = time.perf_counter()
+        self._draw(msg)
+        if self.render_time_s:
+            time.sleep(self.render_time_s)
+        self._record("render", start)
+
+        # Displaying is instantaneous in the emulator, and so are the dithering subframes.
+        self._record("show", time.perf_counter())
+        if self._levels is not None:
+            self._record("dither", time.perf_counter())
+        self._trace_record(msg, source)
+
+    def _draw(self, msg: Message) -> None:
+        if msg.cmd == Command.RECALL:
+            for step in self._macros[msg.slot]:
+                self._draw(step)
+            return
+
+        level = self._level(msg.state)
+        x, y, r = msg.x, msg.y, msg.r
+        match msg.cmd:
+            case Command.DRAW:
+                self._draw_pixel(x, y, level)
+            case Command.SINGLE:
+                self._fill_screen(0)
+                self._draw_pixel(x, y, level)
+            case Command.FILL:
+                self._fill_screen(level)
+            case Command.BRIGHTFIELD:
+                self._fill_circle(x, y, r, level)
+            case Command.DARKFIELD:
+                self._fill_screen(level)
+                self._fill_circle(x, y, r, 0)
+            case Command.PHASE_TOP:
+                self._fill_circle(x, y, r, level)
+                self._fill_rect(x - r, y, r * 2 + 1, r + 1, 0)
+            case Command.PHASE_BOTTOM:
+                self._fill_circle(x, y, r, level)
+                self._fill_rect(x - r, y - r, r * 2 + 1, r + 1, 0)
+            case Command.PHASE_RIGHT:
+                self._fill_circle(x, y, r, level)
+                self._fill_rect(x - r, y - r, r + 1, r * 2 + 1, 0)
+            case Command.PHASE_LEFT:
+                self._fill_circle(x, y, r, level)
+                self._fill_rect(x, y - r, r + 1, r * 2 + 1, 0)
+            case Command.RING:
+                self._fill_annulus(x, y, r, msg.r_out, level)
+            case Command.RINGS:
+                width = msg.r_out - r + 1
+                for i in reversed(range(msg.count)):
+                    r_in = r + 2 * i * width
+                    self._fill_annulus(x, y, r_in, r_in + width - 1, level)
+
+    def _to_chain(self, x: int, y: int) -> tuple[int, int]:
+        tile_x, tile_y = x // PANEL_SIZE, y // PANEL_SIZE
+        local_x, local_y = x % PANEL_SIZE, y % PANEL_SIZE
+        if self._serpentine and tile_y % 2:
+            tile_x = self._panels_x - 1 - tile_x
+            local_x = PANEL_SIZE - 1 - local_x
+            local_y = PANEL_SIZE - 1 - local_y
+        panel = tile_y * self._panels_x + tile_x
+        return panel * PANEL_SIZE + local_x, local_y
+
+    def _draw_pixel(self, x: int, y: int, color: int) -> None:
+        if x < 0 or y < 0 or x >= self.width or y >= self.height:
+            return
+        if self._levels is not None:
+            self._levels[y, x] = color
+        else:
+            chain_x, chain_y = self._to_chain(x, y)
+            self._chain[chain_y, chain_x] = color
+
+    def _fill_screen(self, color: int) -> None:
+        if self._levels is not None:
+            self._levels[:] = color
+        else:
+            self._chain[:] = color
+
+    def _vline(self, x: int, y: int, h: int, color: int) -> None:
+        # Adafruit_GFX draws a line from y to y + h - 1, whatever the sign of h.
+        y_end = y + h - 1
+        for yy in range(min(y, y_end), max(y, y_end) + 1):
+            self._draw_pixel(x, yy, color)
+
+    def _fill_rect(self, x: int, y: int, w: int, h: int, color: int) -> None:
+        for xx in range(x, x + w):
+            self._vline(xx, y, h, color)
+
+    def _fill_circle(self, x0: int, y0: int, r: int, color: int) -> None:
+        self._vline(x0, y0 - r, 2 * r + 1, color)
+
+        # fillCircleHelper with both corners and delta = 0
+        f = 1 - r
+        ddf_x = 1
+        ddf_y = -2 * r
+        x, y = 0, r
+        px, py = x, y
+        delta = 1
+        while x < y:
+            if f >= 0:
+                y -= 1
+                ddf_y += 2
+                f += ddf_y
+            x += 1
+            ddf_x += 2
+            f += ddf_x
+            if x < y + 1:
+                self._vline(x0 + x, y0 - y, 2 * y + delta, color)
+                self._vline(x0 - x, y0 - y, 2 * y + delta, color)
+            if y != py:
+                self._vline(x0 + py, y0 - px, 2 * px + delta, color)
+                self._vline(x0 - py, y0 - px, 2 * px + delta, color)
+                py = y
+            px = x
+
+    def _fill_annulus(self, x: int, y: int, r_in: int, r_out: int, color: int) -> None:
+        self._fill_circle(x, y, r_out, color)
+        if r_in > 0:
+            self._fill_circle(x, y, r_in - 1, 0)
+
+
+def _new_sync_stats() -> dict[str, int]:
+    keys = ("edges", "rendered", "missed", "empty", "last_us", "min_us", "max_us", "total_us")
+    return {key: 0 for key in keys}
+
+
+def _reverse_bits(value: int, bits: int) -> int:
+    result = 0
+    for i in range(bits):
+        result = (result << 1) | ((value >> i) & 1)
+    return result
@@ -1,8 +1,12 @@
 """The primary module for performing Fourier ptychographic reconstructions."""
 from copy import deepcopy
-from dataclasses import dataclass
+from dataclasses import dataclass, field
 from enum import Enum
-from typing import Optional, Self
+from functools import cached_property
+import os
+from pathlib import Path
+import time
+from typing import Callable, Optional, Self, Sequence
 
 import numpy as np
 from numpy.fft import fft2, fftshift, ifft2, ifftshift
@@ -21,9 +25,66 @@ class FPRecoveryError(Exception):
 class PupilRecoveryMethod(Enum):
     rPIE = "rPIE"
     GD = "Gradient Descent"
+    ADAM = "Adam"
     NONE = "None"
 
 
+class ObjectUpdateMethod(Enum):
+    rPIE = "rPIE"
+    mPIE = "Momentum-accelerated PIE"
+
+
+class LEDOrder(Enum):
+    """The order in which fp_recover updates the object with the images of an iteration."""
+
+    DATASET = "Dataset order"
+    ANGLE = "Bright-field first, then dark-field by illumination angle"
+    RANDOM = "Random order in each iteration"
+    RESIDUAL = "Largest error of the previous iteration first"
+
+
+LEDSchedule = Callable[[int, FPDataset, NDArray[np.float64]], Sequence[int]]
+"""A custom LED order.
+
+It is called at the start of each iteration with the index of the iteration, the dataset and the
+error of each image in the previous iteration (NaN in the first iteration), and returns the
+indexes of the images in the order of their updates. Images may be left out or repeated.
+
+"""
+
+
+class StopReason(Enum):
+    """Why a reconstruction stopped."""
+
+    MAX_ITERATIONS = "Maximum number of iterations"
+    TARGET_ERROR = "Error below target"
+    PLATEAU = "Relative error change below tolerance"
+    TIME_BUDGET = "Time budget exceeded"
+    CALLBACK = "Stopped by callback"
+
+
+@dataclass(frozen=True)
+class IterationMetrics:
+    """The progress of a reconstruction after one iteration.
+
+    Attributes
+    ----------
+    iteration : int
+        The index of the iteration, starting at 0.
+    error : float
+        The data fidelity error of the iteration, i.e. the squared difference between the measured
+        and the estimated amplitudes summed over all images, relative to the total squared
+        measured amplitude. Each image contributes its error right before its update.
+    elapsed_s : float
+        The time since the start of the reconstruction.
+
+    """
+
+    iteration: int
+    error: float
+    elapsed_s: float
+
+
 @dataclass
 class FPResults:
     """The results of a Fourier ptychography reconstruction."""
@@ -32,6 +93,63 @@ class FPResults:
     pupil: "Pupil"
     gradients: Optional[list[float]] = None
     zernike_coeffs: Optional[list[float]] = None
+    history: list[IterationMetrics] = field(default_factory=list)
+    stop_reason: Optional[StopReason] = None
+
+    @property
+    def errors(self) -> list[float]:
+        """The data fidelity error of each iteration."""
+        return [metrics.error for metrics in self.history]
+
+    def save(self, path: Path):
+        """Saves the object, the pupil, the last Zernike coefficients and the history to a file.
+
+        The file is a NumPy .npz archive. It is replaced atomically, so an interrupted save leaves
+        the previous checkpoint intact.
+
+        """
+        path = Path(path)
+        tmp_path = path.with_name(path.name + ".tmp")
+        with open(tmp_path, "wb") as f:
+            np.savez(
+                f,
+                object=self.object,
+                pupil=self.pupil.p,
+                zernike_coeffs=np.array(self.zernike_coeffs[-1] if self.zernike_coeffs else []),
+                iterations=np.array([m.iteration for m in self.history], dtype=int),
+                errors=np.array(self.errors, dtype=float),
+                elapsed_s=np.array([m.elapsed_s for m in self.history], dtype=float),
+            )
+        os.replace(tmp_path, path)
+
+    @classmethod
+    def load(cls, path: Path, pupil: "Pupil") -> Self:
+        """Loads results that were saved with save().
+
+        Parameters
+        ----------
+        path : Path
+            The file.
+        pupil : Pupil
+            A pupil of the same system, e.g. the initial pupil estimate of the reconstruction. Its
+            data are replaced by the saved pupil.
+
+        """
+        with np.load(path) as data:
+            loaded_pupil = deepcopy(pupil)
+            loaded_pupil.set_p(data["pupil"])
+            zernike_coeffs = data["zernike_coeffs"].tolist()
+            return cls(
+                object=data["object"],
+                pupil=loaded_pupil,
+                zernike_coeffs=[zernike_coeffs] if zernike_coeffs else None,
+                history=[
+                    IterationMetrics(int(i), float(error), float(elapsed_s))
+                    for i, error, elapsed_s in zip(
+                        data["iterations"], data["errors"], data["elapsed_s"]
+                    )
+                ],
+            )
 
 
 def fp_recover(
@@ -39,12 +157,28 @@ def fp_recover(
     pupil: "Pupil",
     num_iterations: int = 10,
     pupil_recovery_method: PupilRecoveryMethod = PupilRecoveryMethod.NONE,
+    object_update_method: ObjectUpdateMethod = ObjectUpdateMethod.rPIE,
+    led_order: LEDOrder | LEDSchedule = LEDOrder.DATASET,
     upsampling_factor: int = 4,
     alpha_O: float = 1.0,
     alpha_P: float = 1.0,
     num_zernike_coeffs: int = 10,
     learning_rate: float = 1e-4,
+    momentum: float = 0.7,
+    momentum_period: int = 16,
+    adam_betas: tuple[float, float] = (0.9, 0.999),
+    seed: Optional[int] = None,
+    initial_object: Optional[NDArray[np.complex128]] = None,
+    initial_zernike_coeffs: Optional[Sequence[float]] = None,
+    warm_start: Optional[FPResults] = None,
+    resume: bool = False,
+    checkpoint_path: Optional[Path] = None,
+    checkpoint_interval: int = 10,
     show_progress: bool = False,
+    target_error: Optional[float] = None,
+    rel_tol: Optional[float] = None,
+    time_budget_s: Optional[float] = None,
+    callback: Optional[Callable[[IterationMetrics], Optional[bool]]] = None,
 ) -> FPResults:
     """Reconstruct a complex object and pupil from a Fourier Ptychography dataset.
 
@@ -58,6 +192,15 @@ def fp_recover(
         The number of iterations to use in the reconstruction.
     pupil_recovery_method : PupilRecoveryMethod
         The method used to reconstruct the pupil. PupilRecoveryMethod.NONE will skip pupil recovery.
+        PupilRecoveryMethod.ADAM updates the Zernike coefficients like GD, but with the Adam
+        optimizer.
+    object_update_method : ObjectUpdateMethod
+        The update of the object. ObjectUpdateMethod.mPIE adds a momentum step to the rPIE
+        updates of the object and, with rPIE pupil recovery, of the pupil every momentum_period
+        images.
+    led_order : LEDOrder | LEDSchedule
+        The order in which the images are used in each iteration, either one of the built-in
+        orders or a function that returns the order. See LEDSchedule.
     upsampling_factor : int
         The factor by which the target object will be larger than the input data in each dimension.
         For example, if the input data is 64x64 and upsampling_factor=4, then the recovered object
@@ -69,19 +212,57 @@ def fp_recover(
         pupil_recovery_method is PupilRecoveryMethod.rPIE.
     num_zernike_coeffs : int
         The number of Zernike coefficients to use in the pupil recovery. This is only used if
-        pupil_recovery_method is PupilRecoveryMethod.GD.
+        pupil_recovery_method is PupilRecoveryMethod.GD or PupilRecoveryMethod.ADAM.
     learning_rate : float
         The learning rate used in the gradient descent pupil recovery. This is only used if
-        pupil_recovery_method is PupilRecoveryMethod.GD.
+        pupil_recovery_method is PupilRecoveryMethod.GD or PupilRecoveryMethod.ADAM. For Adam,
+        it is the largest change of a coefficient per update.
+    momentum : float
+        The momentum of mPIE, i.e. the fraction of the accumulated change that is added again at
+        each momentum step. This is only used if object_update_method is ObjectUpdateMethod.mPIE.
+    momentum_period : int
+        The number of image updates between momentum steps.
+    adam_betas : tuple[float, float]
+        The decay rates of the first and second moment estimates of Adam. This is only used if
+        pupil_recovery_method is PupilRecoveryMethod.ADAM.
+    seed : int, optional
+        The seed of the random number generator of LEDOrder.RANDOM.
+    initial_object : NDArray[np.complex128], optional
+        The initial estimate of the object at the upsampled size. Defaults to the upsampled mean of
+        the images.
+    initial_zernike_coeffs : Sequence[float], optional
+        The initial Zernike coefficients of GD and Adam pupil recovery. Defaults to zeros.
+    warm_start : FPResults, optional
+        Previous results to start from, e.g. of the previous frame of a time series or loaded
+        from a checkpoint with FPResults.load(). Their object, pupil and last Zernike coefficients
+        replace the initial estimates, so initial_object and initial_zernike_coeffs must not be
+        given as well. The states of mPIE and Adam start anew.
+    resume : bool
+        Whether to continue the history of warm_start, e.g. after an interruption. The
+        reconstruction then stops once the history holds num_iterations iterations.
+    checkpoint_path : Path, optional
+        The file to save the results to every checkpoint_interval iterations and at the end. See
+        FPResults.save().
+    checkpoint_interval : int
+        The number of iterations between checkpoints. Must be at least 1.
     show_progress : bool
         Whether to show a progress bar during the reconstruction.
+    target_error : float, optional
+        If set, stop once the error of an iteration falls below this value.
+    rel_tol : float, optional
+        If set, stop once the error decreases by less than this fraction of the previous
+        iteration's error.
+    time_budget_s : float, optional
+        If set, stop after the first iteration that ends later than this many seconds after the
+        start.
+    callback : Callable[[IterationMetrics], Optional[bool]], optional
+        Called after every iteration with its metrics. Returning True stops the reconstruction.
 
     Returns
     -------
-    obj : NDArray[np.complex128]
-        The recovered complex object.
-    pupil : Pupil
-        The recovered pupil.
+    FPResults
+        The recovered complex object and pupil, the metrics of every iteration and why the
+        reconstruction stopped.
 
     """
     if dataset.images.shape[1] != dataset.images.shape[2]:
@@ -91,15 +272,44 @@ def fp_recover(
 
     # Though we are upsampling the target, the pupil sampling rate dk remains unchanged because
     # the upsampling is performed to add pixels to the FFT, not to improve k-space resolution!
-    initial_object = np.mean(dataset.images, axis=0)
+    if warm_start is not None:
+        if initial_object is not None or initial_zernike_coeffs is not None:
+            raise FPRecoveryError(
+                "A warm start replaces the initial object and Zernike coefficients; do not pass "
+                "them as well."
+            )
+        initial_object = warm_start.object
+        pupil = warm_start.pupil
+        if warm_start.zernike_coeffs:
+            initial_zernike_coeffs = warm_start.zernike_coeffs[-1]
+    elif resume:
+        raise FPRecoveryError("Only a warm start can be resumed.")
+    if checkpoint_interval < 1:
+        raise FPRecoveryError(
+            f"The checkpoint interval must be at least 1. Actual value: {checkpoint_interval}"
+        )
+
     original_size_px = dataset.images.shape[1]
-    target = rescale(initial_object, upsampling_factor)
+    target_size_px = original_size_px * upsampling_factor
+    if initial_object is None:
+        target = rescale(np.mean(dataset.images, axis=0), upsampling_factor)
+    elif initial_object.shape != (target_size_px, target_size_px):
+        raise FPRecoveryError(
+            f"The initial object must have the upsampled size {(target_size_px, target_size_px)}. "
+            f"Actual shape: {initial_object.shape}"
+        )
+    else:
+        target = initial_object
     target_fft = fftshift(fft2(target))
     target_pupil = deepcopy(pupil)
 
     # Initialize data needed for gradient descent pupil recovery
-    if pupil_recovery_method is PupilRecoveryMethod.GD:
+    zernike_recovery = pupil_recovery_method in (PupilRecoveryMethod.GD, PupilRecoveryMethod.ADAM)
+    if zernike_recovery:
         target_zernike_coeffs = [0 for _ in range(num_zernike_coeffs)]
+        if initial_zernike_coeffs is not None:
+            num_initial = min(len(initial_zernike_coeffs), num_zernike_coeffs)
+            target_zernike_coeffs[:num_initial] = initial_zernike_coeffs[:num_initial]
         unit_zernike_modes = np.array(
             [pupil.zernike.unit_mode(i) for i in range(num_zernike_coeffs)]
         )
@@ -111,9 +321,45 @@ def fp_recover(
         unit_zernike_modes = None
         results = FPResults(np.array([], dtype=np.complex128), target_pupil)
 
-    num_iters = tqdm(range(num_iterations)) if show_progress else range(num_iterations)
+    # The pupil is zero outside its radius, so all spectral-domain arithmetic is restricted to
+    # the bounding box of its support. The FFTs of the full grid read and write the box through
+    # index arrays into the unshifted FFT layout, which also saves the fftshifts.
+    bbox = pupil.support_bbox
+    fft_idx = _unshifted_index(bbox, original_size_px)
+    support = target_pupil.support[bbox]
+    pupil_box = target_pupil.p[bbox]  # a view
+    low_res_img_fft_full = np.zeros((original_size_px, original_size_px), dtype=np.complex128)
+    if unit_zernike_modes is not None:
+        unit_zernike_modes = unit_zernike_modes[(slice(None), *bbox)]
+        phase_full = np.empty(pupil.p.shape)
+        adam_m = np.zeros(num_zernike_coeffs)
+        adam_v = np.zeros(num_zernike_coeffs)
+        adam_step = 0
+
+    # Initialize data needed for momentum-accelerated updates
+    if object_update_method is ObjectUpdateMethod.mPIE:
+        momentum_state = _Momentum(
+            target_fft, target_pupil, momentum, pupil_recovery_method is PupilRecoveryMethod.rPIE
+        )
+        num_updates = 0
+
+    # Normalizes the error. Guard against empty (all-zero) datasets.
+    total_amplitude = max(float(np.sum(np.abs(dataset.images) ** 2)), np.finfo(float).tiny)
+    schedule = led_order if callable(led_order) else _builtin_schedule(led_order, seed)
+    image_errors = np.full(len(dataset), np.nan)
+    first_iteration, offset_s = 0, 0.0
+    if resume and warm_start.history:
+        results.history = list(warm_start.history)
+        first_iteration, offset_s = len(results.history), results.history[-1].elapsed_s
+    start = time.perf_counter()
+    results.stop_reason = StopReason.MAX_ITERATIONS
+
+    iterations = range(first_iteration, num_iterations)
+    num_iters = tqdm(iterations) if show_progress else iterations
     for i in num_iters:
-        for image, wavevector, _ in dataset:
+        error = 0.0
+        for n in schedule(i, dataset, image_errors.copy()):
+            image, wavevector = dataset.images[n], dataset.wavevectors[n]
             # Obtain the rectangular slice from the target_fft centered at kx, ky to update.
             kx_ky_px = np.round(wavevector[0:2] / pupil.dk).astype(int)
             current_slice_fft = slice_fft(
@@ -132,78 +378,320 @@ def fp_recover(
                 )
                 raise FPRecoveryError(msg)
 
+            # Only the part of the slice that the pupil passes is updated.
+            slice_box = current_slice_fft[bbox]
+
             # Filter the slice with the pupil function.
-            # A copy of the slice is implicitly made to avoid modifying the original slice.
-            low_res_img_fft = current_slice_fft * target_pupil.p
+            low_res_img_fft = slice_box * pupil_box
 
             # Compute the low resolution image from the current slice
-            low_res_img = ifft2(ifftshift(low_res_img_fft))
+            low_res_img_fft_full[fft_idx] = low_res_img_fft
+            low_res_img = ifft2(low_res_img_fft_full)
+            image_errors[n] = np.sum((np.abs(image) - np.abs(low_res_img)) ** 2)
+            error += image_errors[n]
 
             # Replace the amplitude of the low res. image with the measured amplitude.
             # Leave the phase unchanged.
             low_res_img = np.abs(image) * np.exp(1j * np.angle(low_res_img))
 
             # Update the target_fft with the new slice data using the rPIE algorithm
-            next_low_res_img_fft = fftshift(fft2(low_res_img))
-            current_slice_fft += (
-                np.conj(target_pupil.p)
-                / (
-                    (1 - alpha_O) * abs(target_pupil.p) ** 2
-                    + alpha_O * np.max(np.abs(target_pupil.p) ** 2)
-                )
+            next_low_res_img_fft = fft2(low_res_img)[fft_idx]
+            pupil_intensity = np.abs(pupil_box) ** 2
+            slice_box += (
+                np.conj(pupil_box)
+                / ((1 - alpha_O) * pupil_intensity + alpha_O * np.max(pupil_intensity))
                 * (next_low_res_img_fft - low_res_img_fft)
             )
 
             # Update the pupil function
             match pupil_recovery_method:
                 case PupilRecoveryMethod.rPIE:
+                    # The maximum is taken over the whole slice, not only the pupil's box.
                     update_term = (
-                        np.conj(current_slice_fft)
+                        np.conj(slice_box)
                         / (
-                            (1 - alpha_P) * abs(current_slice_fft) ** 2
+                            (1 - alpha_P) * abs(slice_box) ** 2
                             + alpha_P * np.max(np.abs(current_slice_fft) ** 2)
                         )
                         * (next_low_res_img_fft - low_res_img_fft)
                     )
-                    target_pupil.set_p(target_pupil.p + update_term)
-                case PupilRecoveryMethod.GD:
+                    pupil_box[:] = (pupil_box + update_term) * support
+                case PupilRecoveryMethod.GD | PupilRecoveryMethod.ADAM:
                     # Modified gradient descent pupil recovery from https://doi.org/10.1063/1.5090552
-                    low_res_img_fft = (
-                        (1 / upsampling_factor) ** 2 * current_slice_fft * target_pupil.p
-                    )
-                    low_res_img = ifft2(ifftshift(low_res_img_fft))
+                    low_res_img_fft = (1 / upsampling_factor) ** 2 * slice_box * pupil_box
+                    low_res_img_fft_full[fft_idx] = low_res_img_fft
+                    low_res_img = ifft2(low_res_img_fft_full)
                     img_diff = (1 / np.max(upsampling_factor**2 * image)) * (
                         1 - upsampling_factor**2 * image / np.abs(low_res_img)
                     )
-                    for j, _ in enumerate(target_zernike_coeffs):
-                        # Create a pupil comprised of a single Zernike mode
-                        zernike_mode = unit_zernike_modes[j]
-
-                        gd_temp = ifft2(ifftshift(low_res_img_fft * np.pi * zernike_mode))
-                        # Gradient with respect to each weight
-                        gradient = 2 * np.sum(img_diff * np.imag(np.conj(low_res_img) * gd_temp))
+                    gradients = zernike_gradients(
+                        low_res_img_fft, low_res_img, img_diff, unit_zernike_modes, fft_idx
+                    )
+                    if pupil_recovery_method is PupilRecoveryMethod.ADAM:
+                        # Adam, https://doi.org/10.48550/arXiv.1412.6980
+                        adam_step += 1
+                        adam_m = adam_betas[0] * adam_m + (1 - adam_betas[0]) * gradients
+                        adam_v = adam_betas[1] * adam_v + (1 - adam_betas[1]) * gradients**2
+                        m_hat = adam_m / (1 - adam_betas[0] ** adam_step)
+                        v_hat = adam_v / (1 - adam_betas[1] ** adam_step)
+                        steps = learning_rate * m_hat / (np.sqrt(v_hat) + 1e-12)
+                    else:
+                        steps = learning_rate * gradients
+                    for j, (gradient, step) in enumerate(zip(gradients, steps)):
                         # Update each Zernike coefficient
-                        target_zernike_coeffs[j] += learning_rate * gradient
+                        target_zernike_coeffs[j] += step
 
                     # Construct the final pupil data
-                    phase = target_pupil.zernike(target_zernike_coeffs)
-                    new_pupil_data = np.abs(target_pupil.p) * np.exp(1j * np.pi * phase)
-
-                    target_pupil.set_p(new_pupil_data)
+                    phase = target_pupil.zernike(target_zernike_coeffs, out=phase_full)[bbox]
+                    pupil_box[:] = np.abs(pupil_box) * np.exp(1j * np.pi * phase) * support
 
                     # Record results
                     results.gradients.append(gradient)
-                    results.zernike_coeffs.append(target_zernike_coeffs)
+                    results.zernike_coeffs.append(list(target_zernike_coeffs))
                 case PupilRecoveryMethod.NONE:
-                    continue
+                    pass
+
+            if object_update_method is ObjectUpdateMethod.mPIE:
+                num_updates += 1
+                if num_updates % momentum_period == 0:
+                    momentum_state.step(target_fft, target_pupil)
+
+        elapsed_s = time.perf_counter() - start
+        metrics = IterationMetrics(i, float(error / total_amplitude), offset_s + elapsed_s)
+        results.history.append(metrics)
+        if show_progress:
+            num_iters.set_postfix(error=metrics.error)
+        if checkpoint_path is not None and (i + 1) % checkpoint_interval == 0:
+            results.object = ifft2(ifftshift(target_fft))
+            results.save(checkpoint_path)
+
+        if callback is not None and callback(metrics):
+            results.stop_reason = StopReason.CALLBACK
+            break
+        if target_error is not None and metrics.error < target_error:
+            results.stop_reason = StopReason.TARGET_ERROR
+            break
+        if rel_tol is not None and len(results.history) > 1:
+            previous = results.history[-2].error
+            if previous - metrics.error < rel_tol * previous:
+                results.stop_reason = StopReason.PLATEAU
+                break
+        if time_budget_s is not None and elapsed_s > time_budget_s:
+            results.stop_reason = StopReason.TIME_BUDGET
+            break
 
     # Compute the final complex object
     results.object = ifft2(ifftshift(target_fft))
     results.pupil = target_pupil
+    if checkpoint_path is not None:
+        results.save(checkpoint_path)
+
+    return results
+
+
+def fp_recover_multiresolution(
+    dataset: FPDataset,
+    pupil: "Pupil",
+    upsampling_factors: Sequence[int] = (2, 4),
+    num_iterations: int | Sequence[int] = 10,
+    **kwargs,
+) -> FPResults:
+    """Reconstructs an object coarse-to-fine with increasing upsampling factors.
+
+    Each level runs fp_recover with the next upsampling factor, using only the images whose
+    spectral slices fit into the upsampled spectrum of the level; the last level uses all images.
+    The recovered spectrum of a level is zero-padded to seed the next level, and the recovered
+    pupil (and Zernike coefficients) are carried over. Since most iterations run on small arrays,
+    a coarse start reaches a given error faster than fp_recover at the final upsampling factor.
+
+    Parameters
+    ----------
+    dataset : FPDataset
+        The set of real images taken under different illumination angles.
+    pupil : Pupil
+        The initial pupil estimate.
+    upsampling_factors : Sequence[int]
+        The upsampling factor of each level in increasing order. The last one is that of the
+        result.
+    num_iterations : int | Sequence[int]
+        The number of iterations of each level, or one number for all levels.
+    kwargs
+        Further arguments to fp_recover. The stopping criteria apply to each level.
 
+    Returns
+    -------
+    FPResults
+        The results of the last level. The history holds the iterations of all levels, numbered
+        and timed from the start of the first level. The errors of the coarse levels only cover
+        their subset of the images.
+
+    """
+    if isinstance(num_iterations, int):
+        num_iterations = [num_iterations] * len(upsampling_factors)
+    if len(num_iterations) != len(upsampling_factors):
+        raise ValueError("There must be one number of iterations per upsampling factor.")
+    if list(upsampling_factors) != sorted(upsampling_factors):
+        raise ValueError("The upsampling factors must increase.")
+    if {"initial_object", "initial_zernike_coeffs", "warm_start"} & kwargs.keys():
+        raise ValueError("The initial estimates of the levels are set by the previous levels.")
+
+    num_px = dataset.images.shape[1]
+    history = []
+    target_fft = initial_object = initial_zernike_coeffs = None
+    for level, (factor, level_iterations) in enumerate(zip(upsampling_factors, num_iterations)):
+        level_dataset = dataset
+        if level < len(upsampling_factors) - 1:
+            level_dataset = _fitting_images(dataset, pupil.dk, num_px * factor)
+        if target_fft is not None:
+            initial_object = ifft2(ifftshift(_pad_spectrum(target_fft, num_px * factor)))
+
+        results = fp_recover(
+            level_dataset,
+            pupil,
+            num_iterations=level_iterations,
+            upsampling_factor=factor,
+            initial_object=initial_object,
+            initial_zernike_coeffs=initial_zernike_coeffs,
+            **kwargs,
+        )
+
+        offset, offset_s = len(history), history[-1].elapsed_s if history else 0.0
+        history.extend(
+            IterationMetrics(offset + m.iteration, m.error, offset_s + m.elapsed_s)
+            for m in results.history
+        )
+        target_fft = fftshift(fft2(results.object))
+        pupil = results.pupil
+        if results.zernike_coeffs:
+            initial_zernike_coeffs = results.zernike_coeffs[-1]
+
+    results.history = history
     return results
 
 
+def _fitting_images(dataset: FPDataset, dk: float, target_size_px: int) -> FPDataset:
+    """Returns the images whose spectral slices lie within a spectrum of the given size."""
+    num_px = dataset.images.shape[1]
+    low = (target_size_px - num_px) // 2 + np.round(dataset.wavevectors[:, 0:2] / dk).astype(int)
+    fits = np.all((low >= 0) & (low + num_px <= target_size_px), axis=1)
+    if not np.any(fits):
+        raise FPRecoveryError(
+            f"No image fits into a spectrum of {target_size_px} pixels. Increase the smallest "
+            "upsampling factor."
+        )
+
+    return FPDataset(
+        images=dataset.images[fits],
+        wavevectors=dataset.wavevectors[fits],
+        led_indexes=dataset.led_indexes[fits],
+        intensity_scale=None if dataset.intensity_scale is None else dataset.intensity_scale[fits],
+    )
+
+
+def _pad_spectrum(spectrum_fft: NDArray, size_px: int) -> NDArray:
+    """Zero-pads a centered (fftshifted) spectrum to a larger size, keeping its center."""
+    padded = np.zeros((size_px, size_px), dtype=spectrum_fft.dtype)
+    offset = size_px // 2 - spectrum_fft.shape[0] // 2
+    padded[
+        offset : offset + spectrum_fft.shape[0], offset : offset + spectrum_fft.shape[1]
+    ] = spectrum_fft
+    return padded
+
+
+def _builtin_schedule(led_order: LEDOrder, seed: Optional[int]) -> LEDSchedule:
+    """Returns the LEDSchedule of a built-in LED order."""
+
+    def by_angle(dataset: FPDataset) -> NDArray[np.intp]:
+        # Bright-field images have the smallest transverse wavevectors, so they come first.
+        return np.argsort(np.hypot(*dataset.wavevectors[:, 0:2].T), kind="stable")
+
+    match led_order:
+        case LEDOrder.DATASET:
+            return lambda i, dataset, errors: range(len(dataset))
+        case LEDOrder.ANGLE:
+            return lambda i, dataset, errors: by_angle(dataset)
+        case LEDOrder.RANDOM:
+            rng = np.random.default_rng(seed)
+            return lambda i, dataset, errors: rng.permutation(len(dataset))
+        case LEDOrder.RESIDUAL:
+            return lambda i, dataset, errors: (
+                by_angle(dataset) if i == 0 else np.argsort(-errors, kind="stable")
+            )
+
+
+class _Momentum:
+    """The momentum step of mPIE, https://doi.org/10.1364/OPTICA.4.000736.
+
+    The velocity accumulates the change of the object spectrum (and of the pupil) between momentum
+    steps. It is restarted whenever the latest change opposes it, i.e. when the momentum overshot.
+
+    """
+
+    def __init__(self, target_fft: NDArray, pupil: "Pupil", momentum: float, with_pupil: bool):
+        self.momentum = momentum
+        self.with_pupil = with_pupil
+        self.previous_target_fft = target_fft.copy()
+        self.target_velocity = np.zeros_like(target_fft)
+        self.previous_pupil = pupil.p.copy()
+        self.pupil_velocity = np.zeros_like(pupil.p)
+
+    def step(self, target_fft: NDArray, pupil: "Pupil"):
+        """Adds the momentum to the object spectrum and the pupil in place."""
+        self._step(target_fft, self.previous_target_fft, self.target_velocity)
+        if self.with_pupil:
+            self._step(pupil.p, self.previous_pupil, self.pupil_velocity)
+            pupil.p[~pupil.support] = 0
+            self.previous_pupil[:] = pupil.p
+
+    def _step(self, current: NDArray, previous: NDArray, velocity: NDArray):
+        change = current - previous
+        if np.vdot(velocity, change).real < 0:
+            velocity[:] = 0
+        velocity *= self.momentum
+        velocity += change
+        current += self.momentum * velocity
+        previous[:] = current
+
+
+def zernike_gradients(
+    low_res_img_fft: NDArray[np.complex128],
+    low_res_img: NDArray[np.complex128],
+    img_diff: NDArray[np.float64],
+    unit_zernike_modes: NDArray[np.float64],
+    fft_idx: tuple[NDArray[np.intp], NDArray[np.intp]],
+) -> NDArray[np.float64]:
+    """Returns the gradient of the GD pupil recovery cost with respect to each Zernike weight.
+
+    The gradient with respect to the weight of mode Z_j is
+
+        2 * sum_x img_diff(x) * Im(conj(l(x)) * IFFT[pi * Z_j * L](x))
+
+    where l is the low resolution image and L its spectrum. By Parseval's theorem, this equals
+
+        2 * pi * sum_u Z_j(u) * Im(L(u) * IFFT[img_diff * conj(l)](u))
+
+    so a single inverse FFT serves every mode, and the modes enter through one matrix-vector
+    product.
+
+    Parameters
+    ----------
+    low_res_img_fft : NDArray[np.complex128]
+        The spectrum L of the low resolution image in the box of the pupil's support, centered.
+    low_res_img : NDArray[np.complex128]
+        The low resolution image l.
+    img_diff : NDArray[np.float64]
+        The weighted difference between the measured and the modeled image.
+    unit_zernike_modes : NDArray[np.float64]
+        The Zernike modes in the box, with the shape (num_modes, *low_res_img_fft.shape).
+    fft_idx : tuple[NDArray[np.intp], NDArray[np.intp]]
+        The index arrays of the box in the unshifted FFT layout.
+
+    """
+    weighted = ifft2(img_diff * np.conj(low_res_img))[fft_idx]
+    overlap = np.imag(low_res_img_fft * weighted)
+    return 2 * np.pi * unit_zernike_modes.reshape(len(unit_zernike_modes), -1) @ overlap.ravel()
+
+
 def slice_fft(
     image_fft: np.ndarray,
     transverse_wavevector_px: np.ndarray,
@@ -242,6 +730,19 @@ def slice_fft(
     return image_fft[low_y:high_y, low_x:high_x]
 
 
+def _unshifted_index(
+    bbox: tuple[slice, slice], size_px: int
+) -> tuple[NDArray[np.intp], NDArray[np.intp]]:
+    """Returns the index arrays of a box of a centered spectrum in the layout of numpy.fft.
+
+    Indexing the output of fft2 with them is the same as indexing fftshift(fft2(...)) with the box.
+
+    """
+    rows = (np.arange(size_px)[bbox[0]] - size_px // 2) % size_px
+    cols = (np.arange(size_px)[bbox[1]] - size_px // 2) % size_px
+    return np.ix_(rows, cols)
+
+
 @dataclass(frozen=True)
 class Pupil:
     """A complex pupil function of an optical system.
@@ -380,9 +881,20 @@ class Pupil:
         self.p[:] = pupil
 
         # Set values outside the pupil radius to zero
+        self.p[~self.support] = 0
+
+    @cached_property
+    def support(self) -> NDArray[np.bool_]:
+        """The pixels inside the pupil radius, i.e. where the pupil may be non-zero."""
         y, x = np.ogrid[
             -self.p.shape[0] // 2 : self.p.shape[0] // 2,
             -self.p.shape[1] // 2 : self.p.shape[1] // 2,
         ]
-        mask = x**2 + y**2 > self.pupil_radius_px**2
-        self.p[mask] = 0
+        return x**2 + y**2 <= self.pupil_radius_px**2
+
+    @cached_property
+    def support_bbox(self) -> tuple[slice, slice]:
+        """The (row, column) slices of the smallest box that contains the pupil's support."""
+        rows = np.flatnonzero(self.support.any(axis=1))
+        cols = np.flatnonzero(self.support.any(axis=0))
+        return slice(rows[0], rows[-1] + 1), slice(cols[0], cols[-1] + 1)
@@ -0,0 +1,285 @@
+"""Host side of the serial link benchmark.
+
+The benchmark firmware in `arduino_src/serial_reader` answers ping frames of a chosen size with the
+time stamps of their arrival and of the answer. The functions in this module measure the
+round-trip latency of single pings and the sustained throughput of pipelined pings, and sweep both
+over frame sizes and baud rates.
+
+The results tell how long a command of a given length takes to reach the controller and how many
+bytes must be kept in flight to saturate the link, which is what the command protocol and the
+pipelining of `leb.ptycho.client.LEDController` are sized by.
+
+Example
+-------
+
+```python
+with serial.Serial("/dev/ttyACM0", baudrate=9600, timeout=1) as port:
+    results = sweep(port, sizes=[16, 48, 128], baudrates=[9600, 115200])
+
+for result in results:
+    print(result.size, result.latency_ms.p50, result.throughput_bytes_per_s)
+```
+
+"""
+from dataclasses import dataclass
+import logging
+import time
+from typing import Iterable, Sequence
+
+import numpy as np
+import serial
+
+
+logger = logging.getLogger(__name__)
+
+
+FRAME_LIMIT = 256
+"""The maximum length of a frame, including the terminator."""
+
+SEQ_DIGITS = 6
+"""The number of digits of the sequence number in a ping frame."""
+
+MIN_FRAME_SIZE = len(f"P {0:0{SEQ_DIGITS}d} \n")
+"""The length of a ping frame without payload."""
+
+TIMESTAMP_MODULUS = 2**32
+"""The device time stamps are microseconds that wrap around at 32 bits."""
+
+PERCENTILES = (50, 90, 99)
+
+
+@dataclass(frozen=True)
+class Pong:
+    """The answer of the benchmark firmware to a ping."""
+
+    seq: int
+    rx_us: int
+    tx_us: int
+    payload: str
+
+    @property
+    def device_time_us(self) -> int:
+        """The time from the arrival of the first byte of the ping until the answer was sent."""
+        return (self.tx_us - self.rx_us) % TIMESTAMP_MODULUS
+
+
+@dataclass(frozen=True)
+class LatencyStats:
+    """Summary statistics of a set of latency samples in milliseconds."""
+
+    n: int
+    mean: float
+    min: float
+    max: float
+    p50: float
+    p90: float
+    p99: float
+
+
+@dataclass(frozen=True)
+class LinkResult:
+    """The measured performance of the link for one frame size and baud rate."""
+
+    baudrate: int
+    size: int
+    latency_ms: LatencyStats
+    device_time_ms: LatencyStats
+    throughput_frames_per_s: float
+    throughput_bytes_per_s: float
+
+
+def ping_frame(seq: int, size: int) -> bytes:
+    """Returns a ping frame of exactly `size` bytes, including the terminator.
+
+    Parameters
+    ----------
+    seq : int
+        The sequence number. It wraps around at `SEQ_DIGITS` decimal digits.
+    size : int
+        The size of the frame in bytes.
+
+    """
+    if not MIN_FRAME_SIZE <= size <= FRAME_LIMIT:
+        raise ValueError(f"The frame size must be between {MIN_FRAME_SIZE} and {FRAME_LIMIT}.")
+
+    payload = "x" * (size - MIN_FRAME_SIZE)
+    return f"P {seq % 10**SEQ_DIGITS:0{SEQ_DIGITS}d} {payload}\n".encode("ascii")
+
+
+def parse_pong(line: bytes | str) -> Pong:
+    """Parses the answer to a ping frame.
+
+    Raises
+    ------
+    ValueError
+        If the line is not an answer to a ping, e.g. because the firmware reported an error.
+
+    """
+    if isinstance(line, bytes):
+        line = line.decode("ascii", errors="replace")
+    line = line.rstrip("\r\n")
+
+    fields = line.split(" ", 4)
+    if fields[0] != "p" or len(fields) < 4:
+        raise ValueError(f"Not an answer to a ping: '{line}'")
+
+    return Pong(
+        seq=int(fields[1]),
+        rx_us=int(fields[2]),
+        tx_us=int(fields[3]),
+        payload=fields[4] if len(fields) > 4 else "",
+    )
+
+
+def latency_stats(samples_ms: Sequence[float]) -> LatencyStats:
+    """Summarizes latency samples by their mean, extrema and percentiles."""
+    if len(samples_ms) == 0:
+        raise ValueError("There are no samples.")
+
+    samples = np.asarray(samples_ms, dtype=float)
+    p50, p90, p99 = np.percentile(samples, PERCENTILES)
+    return LatencyStats(
+        n=len(samples),
+        mean=float(samples.mean()),
+        min=float(samples.min()),
+        max=float(samples.max()),
+        p50=float(p50),
+        p90=float(p90),
+        p99=float(p99),
+    )
+
+
+def set_baudrate(port: serial.Serial, baudrate: int) -> None:
+    """Switches the firmware and the host port to a new baud rate.
+
+    USB CDC ports ignore the baud rate, so the switch only changes the link speed of boards that
+    use a hardware UART.
+
+    """
+    port.reset_input_buffer()
+    port.write(f"B {baudrate}\n".encode("ascii"))
+    answer = port.readline().decode("ascii", errors="replace").rstrip("\r\n")
+    if answer != f"b {baudrate}":
+        raise RuntimeError(f"The firmware did not accept the baud rate {baudrate}: '{answer}'")
+
+    port.baudrate = baudrate
+    port.reset_input_buffer()
+
+
+def measure_latency(port: serial.Serial, size: int, n: int = 100) -> tuple[list[float], list[int]]:
+    """Sends `n` pings one after the other and times their round trips.
+
+    Returns
+    -------
+    tuple[list[float], list[int]]
+        The round-trip times in milliseconds and the device times in microseconds.
+
+    """
+    port.reset_input_buffer()
+    round_trips_ms, device_times_us = [], []
+    for seq in range(n):
+        frame = ping_frame(seq, size)
+
+        start = time.perf_counter()
+        port.write(frame)
+        line = port.readline()
+        stop = time.perf_counter()
+
+        pong = _expect_pong(line, seq)
+        round_trips_ms.append((stop - start) * 1e3)
+        device_times_us.append(pong.device_time_us)
+
+    return round_trips_ms, device_times_us
+
+
+def measure_throughput(
+    port: serial.Serial, size: int, n: int = 100, window: int = 256
+) -> tuple[float, float]:
+    """Sends `n` pings back-to-back with up to `window` unanswered bytes in flight.
+
+    Returns
+    -------
+    tuple[float, float]
+        The number of frames and the number of ping bytes per second.
+
+    """
+    if window < size:
+        raise ValueError("The window must hold at least one frame.")
+
+    port.reset_input_buffer()
+    sent = answered = 0
+
+    start = time.perf_counter()
+    while answered < n:
+        # Top up the window, then wait for the oldest answer.
+        chunk = bytearray()
+        while sent < n and (sent - answered + 1) * size <= window:
+            chunk += ping_frame(sent, size)
+            sent += 1
+        if chunk:
+            port.write(chunk)
+
+        _expect_pong(port.readline(), answered)
+        answered += 1
+    elapsed = time.perf_counter() - start
+
+    return n / elapsed, n * size / elapsed
+
+
+def sweep(
+    port: serial.Serial,
+    sizes: Iterable[int],
+    baudrates: Iterable[int] = (),
+    n: int = 100,
+    window: int = 256,
+) -> list[LinkResult]:
+    """Measures latency and throughput for every combination of frame size and baud rate.
+
+    Parameters
+    ----------
+    port : serial.Serial
+        An open port to the benchmark firmware with a read timeout.
+    sizes : Iterable[int]
+        The ping frame sizes in bytes.
+    baudrates : Iterable[int]
+        The baud rates to switch to. If empty, the current baud rate of the port is measured.
+    n : int
+        The number of pings per measurement.
+    window : int
+        The maximum number of unanswered bytes in the throughput measurement.
+
+    """
+    sizes = list(sizes)
+    baudrates = list(baudrates)
+
+    results = []
+    for baudrate in baudrates or [port.baudrate]:
+        if baudrates:
+            set_baudrate(port, baudrate)
+
+        for size in sizes:
+            logger.info("Measuring %d byte frames at %d baud", size, baudrate)
+            round_trips_ms, device_times_us = measure_latency(port, size, n)
+            frames_per_s, bytes_per_s = measure_throughput(port, size, n, window)
+            results.append(
+                LinkResult(
+                    baudrate=baudrate,
+                    size=size,
+                    latency_ms=latency_stats(round_trips_ms),
+                    device_time_ms=latency_stats([t * 1e-3 for t in device_times_us]),
+                    throughput_frames_per_s=frames_per_s,
+                    throughput_bytes_per_s=bytes_per_s,
+                )
+            )
+
+    return results
+
+
+def _expect_pong(line: bytes, seq: int) -> Pong:
+    if not line.endswith(b"\n"):
+        raise TimeoutError(f"No answer to ping {seq}.")
+
+    pong = parse_pong(line)
+    if pong.seq != seq % 10**SEQ_DIGITS:
+        raise RuntimeError(f"Expected the answer to ping {seq}, got {pong.seq}.")
+    return pong
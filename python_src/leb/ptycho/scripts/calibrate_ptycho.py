@@ -14,6 +14,16 @@ calibrate_ptycho.cmd -c 12 16 -b "C:\\Users\\laboleb\\Desktop\\kyle\\calibration
     -g 20 -n 256 -p COM5 -s "C:\\Program Files\\Micro-Manager-2.0\\Ptychography.cfg"
 ```
 
+Instead of bracketing every LED with several exposures, acquire each LED once with a per-LED
+intensity schedule. With `--na 0.1`, the bright-field LEDs inside an objective NA of 0.1 are
+acquired at 25% brightness for 50 ms and the dark-field LEDs at full brightness for 2000 ms. Adding
+`--target_intensity 1000` first runs a pre-scan with these settings and then adjusts the exposure
+time of each LED to reach a mean intensity of 1000. The schedule is recorded in the metadata.
+
+```console
+calibrate_ptycho.cmd -c 12 16 -e 50 --na 0.1 --bf_state 25 --df_exposure_time 2000
+```
+
 """
 import argparse
 from dataclasses import dataclass
@@ -26,7 +36,14 @@ import numpy as np
 from pymmcore_plus import CMMCorePlus
 from tifffile import tifffile
 
-from leb.ptycho import Metadata, spiral
+from leb.ptycho import (
+    LEDExposure,
+    Metadata,
+    displayed_brightness,
+    intensity_schedule,
+    intensity_schedule_from_prescan,
+    spiral,
+)
 
 
 logger = logging.getLogger(__name__)
@@ -38,8 +55,10 @@ CMD_TERMINATOR = "\n"
 OK = "0"
 
 DEFAULT_BASE_PATH = "C:\\Users\\laboleb\\Desktop\\calibrations"
+DEFAULT_BF_STATE = 100
 DEFAULT_CENTER_LED = (16, 16)
 DEFAULT_COM_PORT = "COM5"
+DEFAULT_DF_EXP_TIME = 2000
 DEFAULT_EXP_TIME = 50
 DEFAULT_FILENAME = "ptycho_calib_"
 DEFAULT_GAIN = 10
@@ -60,6 +79,38 @@ def parse_cli_args(args: list[str]) -> argparse.Namespace:
         description="Acquires a Fourier Ptychography calibration dataset."
     )
 
+    parser.add_argument(
+        "-a",
+        "--na",
+        type=float,
+        default=None,
+        help="The NA of the objective. If set, bright-field and dark-field LEDs are acquired with "
+        "different settings. (default: None)",
+    )
+
+    parser.add_argument(
+        "--bf_state",
+        type=int,
+        default=DEFAULT_BF_STATE,
+        help=f"The brightness in percent of the bright-field LEDs. (default: {DEFAULT_BF_STATE})",
+    )
+
+    parser.add_argument(
+        "--df_exposure_time",
+        type=int,
+        default=DEFAULT_DF_EXP_TIME,
+        help="The exposure time in ms for the dark-field LEDs. Only used with --na. "
+        f"(default: {DEFAULT_DF_EXP_TIME})",
+    )
+
+    parser.add_argument(
+        "--target_intensity",
+        type=float,
+        default=None,
+        help="If set, run a pre-scan and adjust the exposure time of each LED to reach this mean "
+        "intensity. (default: None)",
+    )
+
     parser.add_argument(
         "-b",
         "--base_path",
@@ -148,6 +199,21 @@ def validate_args(args: argparse.Namespace) -> None:
     if args.exposure_time < 0:
         raise ValueError("The exposure time must be positive.")
 
+    if args.na is not None and not 0 < args.na < 1:
+        raise ValueError("The NA must lie in the interval (0, 1).")
+
+    if not 0 <= args.bf_state <= 100:
+        raise ValueError("The bright-field LED brightness must lie in the interval [0, 100].")
+
+    if displayed_brightness(args.bf_state) == 0:
+        raise ValueError(f"The bright-field LED brightness {args.bf_state} is displayed as off.")
+
+    if args.df_exposure_time < 0:
+        raise ValueError("The dark-field exposure time must be positive.")
+
+    if args.target_intensity is not None and args.target_intensity <= 0:
+        raise ValueError("The target intensity must be positive.")
+
     if args.gain < 0:
         raise ValueError("The gain must be positive.")
 
@@ -177,8 +243,10 @@ class AcquisitionParams:
     base_path: Path
     filename: str
     center_led: tuple[int, int]
+    schedule: list[LEDExposure]
     exposure_time_ms: int = 50
     gain_db: float = 10
+    target_intensity: float | None = None
 
 
 def setup(args: argparse.Namespace) -> AcquisitionParams:
@@ -201,14 +269,31 @@ def setup(args: argparse.Namespace) -> AcquisitionParams:
 
     center_led = args.center_led
 
+    # Bright-field LEDs use the default exposure time; dark-field LEDs are only distinguished when
+    # the NA of the objective is known.
+    bf_exposure = LEDExposure(args.bf_state, args.exposure_time)
+    if args.na is None:
+        schedule = [bf_exposure] * num_images
+    else:
+        led_indexes = [spiral(ctr, (center_led[0], center_led[1])) for ctr in range(num_images)]
+        schedule = intensity_schedule(
+            led_indexes,
+            (center_led[0], center_led[1]),
+            args.na,
+            bf_exposure,
+            LEDExposure(100, args.df_exposure_time),
+        )
+
     return AcquisitionParams(
         mmc,
         images,
         args.base_path,
         args.filename,
         center_led,
+        schedule,
         exposure_time_ms=args.exposure_time,
         gain_db=args.gain,
+        target_intensity=args.target_intensity,
     )
 
 
@@ -231,6 +316,47 @@ def save(images: np.ndarray, metadata: Metadata, base_path: Path, filename: str)
     tifffile.imwrite(save_path, images, metadata=metadata)
 
 
+def snap(ctr: int, exposure: LEDExposure, acq: AcquisitionParams) -> tuple[int, int]:
+    """Illuminates the ctr'th LED of the spiral and acquires an image into acq.images[ctr].
+
+    Returns the (x, y) indexes of the LED.
+
+    """
+    mmc = acq.mmc
+
+    # Clear the LED array
+    serial(cmd_clear(), DEFAULT_COM_PORT, mmc)
+
+    if mmc.getExposure() != exposure.exposure_time_ms:
+        logger.debug("Setting camera exposure to %s ms.", exposure.exposure_time_ms)
+        mmc.setExposure(exposure.exposure_time_ms)
+
+    # Get the LED coordinates to illuminate and illuminate the LED
+    led_x, led_y = spiral(ctr, (acq.center_led[0], acq.center_led[1]))
+    logger.debug("Illuminating LED at (%d, %d) at %d%%.", led_x, led_y, exposure.state)
+    serial(cmd_draw(led_x, led_y, exposure.state), DEFAULT_COM_PORT, mmc)
+
+    # Acquire the image
+    logger.debug("Acquiring image %d", ctr)
+    mmc.snapImage()
+    acq.images[ctr] = mmc.getImage()
+
+    return led_x, led_y
+
+
+def prescan(acq: AcquisitionParams) -> list[LEDExposure]:
+    """Acquires one image per LED and derives the exposure times that reach the target intensity."""
+    logger.info("Starting pre-scan.")
+
+    mean_intensities = []
+    for ctr, exposure in enumerate(acq.schedule):
+        logger.debug("Pre-scanning image %d of %d.", ctr, len(acq.schedule))
+        snap(ctr, exposure, acq)
+        mean_intensities.append(float(np.mean(acq.images[ctr])))
+
+    return intensity_schedule_from_prescan(mean_intensities, acq.schedule, acq.target_intensity)
+
+
 def run(acq: AcquisitionParams):
     """Runs the acquisition."""
     logger.info("Starting acquisition.")
@@ -238,37 +364,26 @@ def run(acq: AcquisitionParams):
     mmc = acq.mmc
     images = acq.images
 
-    logger.debug(
-        "Setting camera exporse to %s ms and gain to %s dB.", acq.exposure_time_ms, acq.gain_db
-    )
-    mmc.setExposure(acq.exposure_time_ms)
+    logger.debug("Setting camera gain to %s dB.", acq.gain_db)
     mmc.setProperty(CAMERA_DEVICE_NAME, "Gain(dB)", acq.gain_db)
 
+    schedule = acq.schedule if acq.target_intensity is None else prescan(acq)
+
     md = {}
     logger.info("Acquisition started.")
     for ctr in range(len(images)):
         logger.debug("Setting up acquisiton of image %d of %d.", ctr, len(images))
-
-        # Clear the LED array
-        serial(cmd_clear(), DEFAULT_COM_PORT, mmc)
-
-        # Get the LED coordinates to illuminate and illuminate the LED
-        led_x, led_y = spiral(ctr, (acq.center_led[0], acq.center_led[1]))
-        logger.debug("Illuminating LED at (%d, %d).", led_x, led_y)
-        serial(cmd_draw(led_x, led_y, 100), DEFAULT_COM_PORT, mmc)
-
-        # Acquire the image
-        logger.debug("Acquiring image %d", ctr)
-        mmc.snapImage()
-        images[ctr] = mmc.getImage()
+        exposure = schedule[ctr]
+        led_x, led_y = snap(ctr, exposure, acq)
 
         # Collect metadata
-        md[f"frame_{ctr}"] = {
-            "led_indexes": (led_x, led_y),
-            "led_center": (acq.center_led[0], acq.center_led[1]),
-            "exposure_time_ms": acq.exposure_time_ms,
-            "gain_db": acq.gain_db,
-        }
+        md[f"frame_{ctr}"] = Metadata(
+            led_indexes=(led_x, led_y),
+            led_center=(acq.center_led[0], acq.center_led[1]),
+            exposure_time_ms=exposure.exposure_time_ms,
+            gain_db=acq.gain_db,
+            led_state=exposure.state,
+        )
 
     logger.info("Acquisition complete; saving data...")
     save(images, md, acq.base_path, acq.filename)
@@ -0,0 +1,103 @@
+"""Runs the self-benchmark of the LED controller firmware and records the results.
+
+The results are appended to one JSON file per firmware build in the output directory. If the
+directory holds results of other builds, the script also prints how much faster or slower each case
+became compared to the most recent of them.
+
+Example
+-------
+
+Run each case 200 times on the controller on port COM5 and record the results in the benchmarks
+directory.
+
+```console
+firmware_benchmark -p COM5 -n 200 -o benchmarks
+```
+
+"""
+import argparse
+import logging
+from pathlib import Path
+import sys
+
+from leb.ptycho.bench import BenchReport, compare, load_reports, run_bench, save_report
+from leb.ptycho.client import LEDController
+
+
+logger = logging.getLogger(__name__)
+
+
+DEFAULT_ITERATIONS = 100
+DEFAULT_OUTPUT = Path("benchmarks")
+
+
+def parse_cli_args(args: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Benchmarks the LED controller firmware.")
+
+    parser.add_argument(
+        "-p",
+        "--port",
+        type=str,
+        required=True,
+        help="The serial port of the LED controller.",
+    )
+
+    parser.add_argument(
+        "-n",
+        "--iterations",
+        type=int,
+        default=DEFAULT_ITERATIONS,
+        help=f"The number of times each case is run. (default: {DEFAULT_ITERATIONS})",
+    )
+
+    parser.add_argument(
+        "-o",
+        "--output",
+        type=Path,
+        default=DEFAULT_OUTPUT,
+        help=f"The directory of the benchmark history. (default: {DEFAULT_OUTPUT})",
+    )
+
+    parser.add_argument(
+        "-d",
+        "--debug",
+        action="store_true",
+        help="Print debug messages.",
+    )
+
+    return parser.parse_args(args)
+
+
+def format_report(report: BenchReport, baseline: BenchReport | None = None) -> str:
+    """Formats the results as a table, with the change relative to a baseline if given."""
+    ratios = compare(baseline, report) if baseline is not None else {}
+
+    rows = [f"{report.firmware.version} {report.firmware.build}"]
+    rows.append(f"{'case':<20} {'r':>3} {'min us':>9} {'mean us':>9} {'max us':>9} {'change':>7}")
+    for r in report.results:
+        ratio = ratios.get((r.case, r.r))
+        change = f"{ratio - 1:+7.1%}" if ratio is not None else ""
+        rows.append(
+            f"{r.case:<20} {r.r:>3} {r.min_us:>9.2f} {r.mean_us:>9.2f} {r.max_us:>9.2f} {change:>7}"
+        )
+    return "\n".join(rows)
+
+
+def main():
+    args = parse_cli_args(sys.argv[1:])
+    logging.basicConfig(level=logging.DEBUG if args.debug else logging.INFO)
+
+    with LEDController(args.port) as ctrl:
+        report = run_bench(ctrl, args.iterations)
+
+    others = [r for r in load_reports(args.output) if r.firmware != report.firmware]
+    baseline = others[-1] if others else None
+
+    path = save_report(report, args.output)
+    logger.info("Saved the results to %s", path)
+
+    print(format_report(report, baseline))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,74 @@
+"""Runs an emulated LED matrix controller on a pseudo-terminal.
+
+Example
+-------
+
+Emulate a controller behind a 115200 baud link that takes 2 ms to render a pattern. The script
+prints the path of the pseudo-terminal to connect to, e.g. with `calibrate_ptycho` or
+`leb.ptycho.client.LEDController`, and runs until it is interrupted.
+
+```console
+led_matrix_emulator -b 115200 -r 2000
+```
+
+"""
+import argparse
+import logging
+import sys
+import time
+
+from leb.ptycho.emulator import Emulator
+
+
+logger = logging.getLogger(__name__)
+
+
+def parse_cli_args(args: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Emulates an LED matrix controller.")
+
+    parser.add_argument(
+        "-b",
+        "--baudrate",
+        type=int,
+        default=None,
+        help="The baud rate of the emulated serial link. (default: no link delay)",
+    )
+
+    parser.add_argument(
+        "-c",
+        "--chain_length",
+        type=int,
+        default=1,
+        help="The number of chained panels. (default: 1)",
+    )
+
+    parser.add_argument(
+        "-r",
+        "--render_time_us",
+        type=int,
+        default=0,
+        help="The time to render and display a pattern in microseconds. (default: 0)",
+    )
+
+    return parser.parse_args(args)
+
+
+def main():
+    args = parse_cli_args(sys.argv[1:])
+    logging.basicConfig(level=logging.INFO)
+
+    with Emulator(
+        baudrate=args.baudrate,
+        render_time_s=args.render_time_us * 1e-6,
+        chain_length=args.chain_length,
+    ) as emulator:
+        print(emulator.port, flush=True)
+        try:
+            while True:
+                time.sleep(1)
+        except KeyboardInterrupt:
+            logger.info("Stopping the emulator.")
+
+
+if __name__ == "__main__":
+    main()
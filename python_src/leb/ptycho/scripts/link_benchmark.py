@@ -0,0 +1,135 @@
+"""Measures the serial link to a board running the link benchmark firmware.
+
+Upload `arduino_src/serial_reader` to the board first. The script prints the round-trip latency
+percentiles and the sustained throughput for every combination of frame size and baud rate.
+
+Example
+-------
+
+Sweep frame sizes from 10 to 128 bytes at 9600 and 115200 baud on port COM5 with 200 pings per
+measurement and save the results to link.json.
+
+```console
+link_benchmark -p COM5 -s 10 24 48 128 -b 9600 115200 -n 200 -o link.json
+```
+
+"""
+import argparse
+from dataclasses import asdict
+import json
+import logging
+from pathlib import Path
+import sys
+
+import serial
+
+from leb.ptycho.linkbench import LinkResult, sweep
+
+
+logger = logging.getLogger(__name__)
+
+
+DEFAULT_BAUDRATE = 9600
+DEFAULT_SIZES = [10, 24, 48, 128]
+DEFAULT_NUM_PINGS = 100
+DEFAULT_WINDOW = 256
+
+
+def parse_cli_args(args: list[str]) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Measures the latency and throughput of a link.")
+
+    parser.add_argument(
+        "-p",
+        "--port",
+        type=str,
+        required=True,
+        help="The serial port of the board.",
+    )
+
+    parser.add_argument(
+        "-s",
+        "--sizes",
+        nargs="+",
+        type=int,
+        default=DEFAULT_SIZES,
+        help=f"The ping frame sizes in bytes. (default: {DEFAULT_SIZES})",
+    )
+
+    parser.add_argument(
+        "-b",
+        "--baudrates",
+        nargs="+",
+        type=int,
+        default=[],
+        help="The baud rates to sweep. (default: only the initial baud rate)",
+    )
+
+    parser.add_argument(
+        "-n",
+        "--num_pings",
+        type=int,
+        default=DEFAULT_NUM_PINGS,
+        help=f"The number of pings per measurement. (default: {DEFAULT_NUM_PINGS})",
+    )
+
+    parser.add_argument(
+        "-w",
+        "--window",
+        type=int,
+        default=DEFAULT_WINDOW,
+        help="The maximum number of unanswered bytes in the throughput measurement. "
+        f"(default: {DEFAULT_WINDOW})",
+    )
+
+    parser.add_argument(
+        "-o",
+        "--output",
+        type=Path,
+        default=None,
+        help="If set, save the results to this JSON file. (default: None)",
+    )
+
+    parser.add_argument(
+        "-d",
+        "--debug",
+        action="store_true",
+        help="Print debug messages.",
+    )
+
+    return parser.parse_args(args)
+
+
+def format_results(results: list[LinkResult]) -> str:
+    """Formats the results as a table."""
+    header = (
+        f"{'baud':>8} {'size':>5} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} {'max ms':>8} "
+        f"{'dev ms':>8} {'frames/s':>9} {'bytes/s':>9}"
+    )
+    rows = [header]
+    for r in results:
+        rows.append(
+            f"{r.baudrate:>8} {r.size:>5} {r.latency_ms.p50:>8.3f} {r.latency_ms.p90:>8.3f} "
+            f"{r.latency_ms.p99:>8.3f} {r.latency_ms.max:>8.3f} {r.device_time_ms.p50:>8.3f} "
+            f"{r.throughput_frames_per_s:>9.1f} {r.throughput_bytes_per_s:>9.0f}"
+        )
+    return "\n".join(rows)
+
+
+def main():
+    args = parse_cli_args(sys.argv[1:])
+    logging.basicConfig(level=logging.DEBUG if args.debug else logging.INFO)
+
+    with serial.Serial(args.port, baudrate=DEFAULT_BAUDRATE, timeout=2) as port:
+        results = sweep(
+            port, args.sizes, baudrates=args.baudrates, n=args.num_pings, window=args.window
+        )
+
+    print(format_results(results))
+
+    if args.output is not None:
+        args.output.write_text(json.dumps([asdict(result) for result in results], indent=2))
+        logger.info("Saved the results to %s", args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,348 @@
+"""Event traces of the LED matrix controller and their alignment with camera frames.
+
+The controller records every displayed pattern in a ring buffer of fixed-size binary events. The
+`trace` command dumps the buffer in bulk, one event per line in hexadecimal, and empties it. This
+module decodes the dump and aligns the events with the time stamps of the acquired camera frames.
+The controller and the camera have independent clocks, so the alignment estimates the offset and
+the drift between them from the data and then pairs each frame with the pattern that was
+displayed for it. Patterns without a frame are dropped frames; frames without a pattern are
+misaligned.
+
+Example
+-------
+
+```python
+with LEDController("/dev/ttyACM0") as ctrl:
+    ctrl.send("trace")  # empty the buffer
+    ...  # acquire
+    trace = read_trace(ctrl)
+
+# Only the single LED patterns were exposed; the clears in between were not.
+events = [event for event in trace.events if event.cmd == "single"]
+alignment = align_frames(events, frame_times_s)
+print(alignment.dropped_events, alignment.unmatched_frames)
+```
+
+"""
+from dataclasses import dataclass
+from enum import IntEnum
+import struct
+from typing import Optional, Sequence
+
+import numpy as np
+
+
+TRACE_SIZE = 512
+"""The number of events that the controller's ring buffer holds."""
+
+EVENT_FORMAT = "<IHBBhhBBBB"
+"""The binary layout of the firmware's TraceEvent struct."""
+
+EVENT_SIZE = struct.calcsize(EVENT_FORMAT)
+
+COMMANDS = (
+    "draw",
+    "fill",
+    "brightfield",
+    "darkfield",
+    "phaseTop",
+    "phaseBottom",
+    "phaseRight",
+    "phaseLeft",
+    "ring",
+    "rings",
+    "single",
+    "recall",
+    "play",
+    "stop",
+    "status",
+    "clearSchedule",
+    "stats",
+    "geometry",
+    "sync",
+    "advance",
+    "skew",
+    "clearPreload",
+    "cyclePreload",
+    "dither",
+    "trace",
+    "bench",
+    "version",
+    "def",
+    "undef",
+    "save",
+    "macros",
+    "boot",
+    "help",
+)
+"""The commands in the order of the firmware's Command enum."""
+
+
+class TraceSource(IntEnum):
+    """What caused a pattern to be displayed."""
+
+    COMMAND = 0
+    SCHEDULE = 1
+    SYNC = 2
+
+
+@dataclass(frozen=True)
+class TraceEvent:
+    """A displayed pattern.
+
+    `seq` and `t_us` are unwrapped, i.e. they keep increasing across the wrap-arounds of the
+    16-bit sequence number and the 32-bit microsecond counter of the controller.
+
+    """
+
+    seq: int
+    t_us: int
+    cmd: str
+    source: TraceSource
+    x: int = 0
+    y: int = 0
+    r: int = 0
+    r_out: int = 0
+    count: int = 0
+    state: int = 0
+
+    def pack(self) -> bytes:
+        """Returns the event in the binary layout of the firmware."""
+        return struct.pack(
+            EVENT_FORMAT,
+            self.t_us % 2**32,
+            self.seq % 2**16,
+            COMMANDS.index(self.cmd),
+            self.source,
+            _int16(self.x),
+            _int16(self.y),
+            self.r & 0xFF,
+            self.r_out & 0xFF,
+            self.count & 0xFF,
+            self.state & 0xFF,
+        )
+
+
+@dataclass(frozen=True)
+class Trace:
+    """The events of one dump of the controller's trace buffer.
+
+    Attributes
+    ----------
+    events : list[TraceEvent]
+        The events, oldest first.
+    lost : int
+        The number of events that were overwritten before the dump because the buffer was full.
+
+    """
+
+    events: list[TraceEvent]
+    lost: int = 0
+
+    @property
+    def times_s(self) -> np.ndarray:
+        """The times of the events in seconds on the controller's clock."""
+        return np.array([event.t_us for event in self.events], dtype=float) * 1e-6
+
+
+@dataclass(frozen=True)
+class FrameAlignment:
+    """The pairing of camera frames with displayed patterns.
+
+    Frame times are modeled as `offset_s + (1 + drift) * event_time_s`.
+
+    Attributes
+    ----------
+    frame_events : np.ndarray
+        For each frame, the index of its event, or -1 if no event matches the frame.
+    residuals_s : np.ndarray
+        For each frame, the difference between its time and the modeled time of its event, or NaN.
+    num_events : int
+        The number of aligned events.
+    offset_s : float
+        The offset of the frame clock from the controller clock.
+    drift : float
+        The relative rate difference of the two clocks.
+    tolerance_s : float
+        The largest residual of a matched frame.
+
+    """
+
+    frame_events: np.ndarray
+    residuals_s: np.ndarray
+    num_events: int
+    offset_s: float
+    drift: float
+    tolerance_s: float
+
+    @property
+    def dropped_events(self) -> np.ndarray:
+        """The indexes of events between the first and last matched event without a frame."""
+        matched = self.frame_events[self.frame_events >= 0]
+        if matched.size == 0:
+            return np.arange(0)
+        expected = np.arange(matched.min(), matched.max() + 1)
+        return np.setdiff1d(expected, matched)
+
+    @property
+    def unmatched_frames(self) -> np.ndarray:
+        """The indexes of frames that do not match any event."""
+        return np.flatnonzero(self.frame_events < 0)
+
+
+def unpack_event(data: bytes) -> tuple[int, int, str, TraceSource, int, int, int, int, int, int]:
+    """Decodes one binary event into (seq, t_us, cmd, source, x, y, r, r_out, count, state).
+
+    The sequence number and the time stamp are returned as recorded, i.e. wrapped.
+
+    """
+    t_us, seq, cmd, source, x, y, r, r_out, count, state = struct.unpack(EVENT_FORMAT, data)
+    return seq, t_us, COMMANDS[cmd], TraceSource(source), x, y, r, r_out, count, state
+
+
+def parse_trace(lines: Sequence[str]) -> Trace:
+    """Parses the output of the `trace` command.
+
+    Raises
+    ------
+    ValueError
+        If the output is malformed or the number of events does not match the header.
+
+    """
+    if not lines or not lines[0].startswith("trace "):
+        raise ValueError("The output does not start with a trace header.")
+
+    _, num_events, lost = lines[0].split()
+    records = [bytes.fromhex(line.strip()) for line in lines[1:] if line.strip()]
+    if len(records) != int(num_events):
+        raise ValueError(f"Expected {num_events} events, got {len(records)}.")
+    if any(len(record) != EVENT_SIZE for record in records):
+        raise ValueError(f"Events must be {EVENT_SIZE} bytes long.")
+
+    events = []
+    seq = t_us = 0
+    for i, record in enumerate(records):
+        raw_seq, raw_t_us, *fields = unpack_event(record)
+        if i == 0:
+            seq, t_us = raw_seq, raw_t_us
+        else:
+            # Unwrap the counters; events are recorded in order.
+            seq += (raw_seq - seq) % 2**16
+            t_us += (raw_t_us - t_us) % 2**32
+        events.append(TraceEvent(seq, t_us, *fields))
+
+    return Trace(events=events, lost=int(lost))
+
+
+def read_trace(ctrl) -> Trace:
+    """Downloads and empties the trace buffer of a controller.
+
+    Parameters
+    ----------
+    ctrl : leb.ptycho.client.LEDController
+        The connection to the controller.
+
+    """
+    return parse_trace(ctrl.send("trace"))
+
+
+def align_frames(
+    events: Sequence[TraceEvent] | np.ndarray,
+    frame_times_s: Sequence[float] | np.ndarray,
+    tolerance_s: Optional[float] = None,
+    num_anchor_frames: int = 8,
+) -> FrameAlignment:
+    """Pairs camera frames with the patterns that were displayed for them.
+
+    The clock offset is found by trying every event as the partner of each of the first
+    `num_anchor_frames` frames and keeping the offset that matches the most frames. The offset and
+    the drift are then refined by a least-squares fit to the matched pairs. A frame matches the
+    nearest event if their modeled times differ by at most `tolerance_s`; every event matches at
+    most one frame.
+
+    Parameters
+    ----------
+    events : Sequence[TraceEvent] | np.ndarray
+        The events that should each have produced one frame, or their times in seconds. Leave out
+        patterns that were not exposed, such as clears between frames.
+    frame_times_s : Sequence[float] | np.ndarray
+        The time stamps of the frames in seconds on the camera's or the host's clock.
+    tolerance_s : float, optional
+        The largest accepted residual. Defaults to a quarter of the median interval between events.
+    num_anchor_frames : int
+        The number of leading frames to derive candidate offsets from.
+
+    """
+    if len(events) and isinstance(events[0], TraceEvent):
+        event_times = np.array([event.t_us for event in events], dtype=float) * 1e-6
+    else:
+        event_times = np.asarray(events, dtype=float)
+    frame_times = np.asarray(frame_times_s, dtype=float)
+
+    if event_times.size == 0 or frame_times.size == 0:
+        raise ValueError("There must be at least one event and one frame.")
+    if tolerance_s is None:
+        if event_times.size < 2:
+            raise ValueError("The tolerance must be given if there is only one event.")
+        tolerance_s = 0.25 * float(np.median(np.diff(event_times)))
+
+    best_score, best_offset = None, 0.0
+    for frame_time in frame_times[:num_anchor_frames]:
+        for offset in frame_time - event_times:
+            frame_events, residuals = _match(event_times + offset, frame_times, tolerance_s)
+            matched = frame_events >= 0
+            score = (int(matched.sum()), -float(np.abs(residuals[matched]).sum()))
+            if best_score is None or score > best_score:
+                best_score, best_offset = score, offset
+
+    offset, slope = best_offset, 1.0
+    for _ in range(2):
+        frame_events, residuals = _match(offset + slope * event_times, frame_times, tolerance_s)
+        matched = frame_events >= 0
+        if matched.sum() >= 2:
+            slope, offset = np.polyfit(event_times[frame_events[matched]], frame_times[matched], 1)
+    frame_events, residuals = _match(offset + slope * event_times, frame_times, tolerance_s)
+
+    return FrameAlignment(
+        frame_events=frame_events,
+        residuals_s=residuals,
+        num_events=event_times.size,
+        offset_s=float(offset),
+        drift=float(slope - 1),
+        tolerance_s=tolerance_s,
+    )
+
+
+def _int16(value: int) -> int:
+    """Wraps a value into the range of int16_t like the firmware's implicit conversion."""
+    return (value + 2**15) % 2**16 - 2**15
+
+
+def _match(
+    event_times: np.ndarray, frame_times: np.ndarray, tolerance_s: float
+) -> tuple[np.ndarray, np.ndarray]:
+    """Pairs each frame with the nearest event within the tolerance, one frame per event."""
+    order = np.argsort(event_times)
+    sorted_times = event_times[order]
+
+    right = np.clip(np.searchsorted(sorted_times, frame_times), 1, sorted_times.size - 1)
+    left = right - 1
+    if sorted_times.size == 1:
+        left = right = np.zeros_like(right)
+    nearest = np.where(
+        np.abs(frame_times - sorted_times[left]) <= np.abs(frame_times - sorted_times[right]),
+        left,
+        right,
+    )
+
+    residuals = frame_times - sorted_times[nearest]
+    frame_events = np.where(np.abs(residuals) <= tolerance_s, order[nearest], -1)
+
+    # Keep only the closest frame of events that match several frames.
+    frames = np.flatnonzero(frame_events >= 0)
+    frames = frames[np.lexsort((np.abs(residuals[frames]), frame_events[frames]))]
+    duplicate = np.r_[False, frame_events[frames][1:] == frame_events[frames][:-1]]
+    frame_events[frames[duplicate]] = -1
+
+    residuals = np.where(frame_events >= 0, residuals, np.nan)
+    return frame_events, residuals
@@ -1,17 +1,20 @@
-"""Module to compute the Zernike polynomials."""
-import numpy as np
-from zernike import RZern
-
+"""Module to compute the Zernike polynomials.
 
-MAX_ZERNIKE_RAD_INDEX = 3
-"""The maximum Zernike radial index that can be used to model a pupil.
+The modes are generated in Noll order by recurrence relations: the radial polynomials of each
+radial degree follow from those of the two lower degrees, and the azimuthal factors cos(m theta)
+and sin(m theta) from those of the lower azimuthal degrees. All modes up to a radial degree are
+produced in one pass over the grid, so there is no limit on the degree. The modes are normalized
+like those of the `zernike` package, which can still be used as a backend if it is installed.
 
-3 degrees corresponds to the first 10 Noll coefficients.
 """
+from enum import Enum
+from typing import Optional
+
+import numpy as np
 
 
 MAX_NUM_ZERNIKE_COEFFS = 10
-"""The maximum number of Zernike coefficients that can be used to model a pupil.
+"""The default number of Zernike coefficients that are used to model a pupil.
 
 10 coefficients will cover all Zernike polynomials up to radial degree 3.
 """
@@ -21,6 +24,84 @@ class ZernikeError(Exception):
     """Raised when an invalid state is reached during Zernike polynomial calculations."""
 
 
+class ZernikeBackend(Enum):
+    """The implementation that evaluates the Zernike modes."""
+
+    NUMPY = "numpy"
+    RZERN = "rzern"  # requires the optional zernike package
+
+
+def num_zernike_modes(radial_degree: int) -> int:
+    """Returns the number of Zernike modes up to and including a radial degree."""
+    return (radial_degree + 1) * (radial_degree + 2) // 2
+
+
+def zernike_modes(rho: np.ndarray, theta: np.ndarray, radial_degree: int) -> np.ndarray:
+    """Evaluates all Zernike modes up to a radial degree in Noll order.
+
+    The radial polynomials are computed with the recurrence
+
+        R_n^m = rho * (R_{n-1}^{|m-1|} + R_{n-1}^{m+1}) - R_{n-2}^m,
+
+    where R_n^n = rho^n and R_n^m = 0 for m > n, which is stable for all degrees. The azimuthal
+    factors use the Chebyshev recurrence cos((m+1) theta) = 2 cos(theta) cos(m theta) -
+    cos((m-1) theta) and its analog for the sine. The modes are normalized to an RMS of 1 over the
+    unit disc.
+
+    Parameters
+    ----------
+    rho : np.ndarray
+        The radial coordinates. Points outside the unit disc are evaluated as well.
+    theta : np.ndarray
+        The azimuthal coordinates in radians, with the same shape as rho.
+    radial_degree : int
+        The largest radial degree.
+
+    Returns
+    -------
+    np.ndarray
+        The modes, with the shape (num_zernike_modes(radial_degree), *rho.shape). Index 0 is Noll
+        index 1.
+
+    """
+    if radial_degree < 0:
+        raise ValueError(f"Expected a non-negative radial degree, got {radial_degree}.")
+    rho = np.asarray(rho, dtype=np.float64)
+    theta = np.asarray(theta, dtype=np.float64)
+
+    # Radial polynomials R_n^m for m >= 0 and n - m even, keyed by (n, m)
+    radial = {(0, 0): np.ones_like(rho)}
+    for n in range(1, radial_degree + 1):
+        for m in range(n % 2, n + 1, 2):
+            if m == n:
+                radial[(n, m)] = rho * radial[(n - 1, m - 1)]
+                continue
+            r = rho * (radial[(n - 1, abs(m - 1))] + radial[(n - 1, m + 1)])
+            if (n - 2, m) in radial:
+                r -= radial[(n - 2, m)]
+            radial[(n, m)] = r
+
+    # cos(m theta) and sin(m theta) for m = 0 ... radial_degree
+    cos_theta, sin_theta = np.cos(theta), np.sin(theta)
+    cos_m = [np.ones_like(theta), cos_theta]
+    sin_m = [np.zeros_like(theta), sin_theta]
+    for m in range(2, radial_degree + 1):
+        cos_m.append(2 * cos_theta * cos_m[m - 1] - cos_m[m - 2])
+        sin_m.append(2 * cos_theta * sin_m[m - 1] - sin_m[m - 2])
+
+    modes = np.empty((num_zernike_modes(radial_degree), *rho.shape))
+    for j in range(len(modes)):
+        n, m = Zernike.noll_to_zernike(j + 1)
+        if m == 0:
+            modes[j] = np.sqrt(n + 1) * radial[(n, 0)]
+        elif m > 0:
+            modes[j] = np.sqrt(2 * (n + 1)) * radial[(n, m)] * cos_m[m]
+        else:
+            modes[j] = np.sqrt(2 * (n + 1)) * radial[(n, -m)] * sin_m[-m]
+
+    return modes
+
+
 class Zernike:
     def __init__(
         self,
@@ -28,26 +109,46 @@ class Zernike:
         y_range: tuple[int, int],
         shape: tuple[int, int],
         radial_degree: int = 3,
+        backend: ZernikeBackend = ZernikeBackend.NUMPY,
     ) -> None:
-        if radial_degree > MAX_ZERNIKE_RAD_INDEX:
-            raise ValueError(
-                f"The maximum radial degree is {MAX_ZERNIKE_RAD_INDEX}. Received: {radial_degree}"
-            )
-        self._z = RZern(radial_degree)
+        if radial_degree < 0:
+            raise ValueError(f"Expected a non-negative radial degree, got {radial_degree}.")
 
         x = np.linspace(x_range[0], x_range[1], shape[0])
         y = np.linspace(y_range[0], y_range[1], shape[1])
         xx, yy = np.meshgrid(x, y)
 
-        self._grid = self._z.make_cart_grid(xx, yy)
+        # Evaluate every mode once. The modes are only defined on the unit disc, so the basis
+        # keeps the disc's pixels as the rows of a (disc pixels x modes) matrix, and a weighted sum
+        # of modes becomes a single matrix-vector product.
+        match backend:
+            case ZernikeBackend.NUMPY:
+                rho = np.hypot(xx, yy)
+                modes = zernike_modes(rho, np.arctan2(yy, xx), radial_degree)
+                disc = rho <= 1
+            case ZernikeBackend.RZERN:
+                from zernike import RZern
+
+                z = RZern(radial_degree)
+                z.make_cart_grid(xx, yy)
+                modes = np.array([z.eval_grid(w, matrix=True) for w in np.eye(z.nk)])
+                disc = ~np.isnan(modes[0])
+
+        self._disc_idx = np.flatnonzero(disc)
+        self._basis = np.ascontiguousarray(modes[:, disc].T)
+        self._values = np.empty(self._disc_idx.size)
+
+        self._unit_modes = np.where(disc, modes, 0)
+        self._unit_modes.flags.writeable = False
 
         # Remeber inputs for __repr__
         self._x_range = x_range
         self._y_range = y_range
         self._shape = shape
-        self._radial_degree = MAX_ZERNIKE_RAD_INDEX
+        self._radial_degree = radial_degree
+        self._backend = backend
 
-    def __call__(self, weights: np.ndarray) -> np.ndarray:
+    def __call__(self, weights: np.ndarray, out: Optional[np.ndarray] = None) -> np.ndarray:
         """Returns the Zernike polynomial evaluated on the grid with the given weights.
 
         Parameters
@@ -56,6 +157,8 @@ class Zernike:
             1D array of Zernike weights. The index of the weight corresponds to the Zernike
             polynomial index following Noll's convention, except that Noll's convention starts at
             1 and this convention starts at 0.
+        out : np.ndarray, optional
+            A float64 array of the grid's shape to write the result into.
 
         Returns
         -------
@@ -67,20 +170,22 @@ class Zernike:
 
         if weights.ndim != 1:
             raise ValueError(f"Expected 1D weights, got {weights.ndim} weights.")
-        if len(weights) > self._z.nk:
-            raise ValueError(f"Expected at most {self._z.nk} weights, got {len(weights)}.")
-        if len(weights) < self._z.nk:
+        if len(weights) > self.num_modes:
+            raise ValueError(f"Expected at most {self.num_modes} weights, got {len(weights)}.")
+        if len(weights) < self.num_modes:
             # Append zeros to weights to match the number of Zernike modes.
-            # This is necessary because the zernike package expects a full set of weights for a
-            # given radial degree.
-            weights = np.pad(weights, (0, self._z.nk - len(weights)), mode="constant")
+            weights = np.pad(weights, (0, self.num_modes - len(weights)), mode="constant")
 
-        z = self._z.eval_grid(weights, matrix=True)
+        np.dot(self._basis, weights.astype(np.float64, copy=False), out=self._values)
 
-        # Set NaNs to zero
-        z[np.isnan(z)] = 0
+        # The polynomial is zero outside the unit disc.
+        if out is None:
+            out = np.zeros(self._unit_modes.shape[1:])
+        else:
+            out.fill(0)
+        np.put(out, self._disc_idx, self._values)
 
-        return z
+        return out
 
     def __repr__(self) -> str:
         return (
@@ -118,7 +223,7 @@ class Zernike:
     @property
     def num_modes(self) -> int:
         """Returns the number of Zernike modes."""
-        return self._z.nk
+        return self._basis.shape[1]
 
     def unit_mode(self, noll_index: int) -> np.ndarray:
         """Returns the Zernike polynomial corresponding to the given Noll index and a weight of 1.
@@ -131,14 +236,18 @@ class Zernike:
         Returns
         -------
         np.ndarray
-            2D array of the Zernike polynomial evaluated on its grid.
+            2D array of the Zernike polynomial evaluated on its grid. It is a read-only view of
+            `unit_modes`.
 
         """
         if noll_index < 0:
             raise ValueError(f"Expected a non-negative Noll index, got {noll_index}.")
-        if noll_index > self.num_modes:
+        if noll_index >= self.num_modes:
             raise ValueError(f"Expected a Noll index less than {self.num_modes}, got {noll_index}.")
 
-        weights = np.zeros(self.num_modes)
-        weights[noll_index] = 1
-        return self(weights)
+        return self._unit_modes[noll_index]
+
+    @property
+    def unit_modes(self) -> np.ndarray:
+        """The read-only stack of all Zernike modes with a weight of 1, in Noll order."""
+        return self._unit_modes
@@ -0,0 +1,285 @@
+/// A minimal stand-in for Micro-Manager's DeviceBase.h.
+///
+/// It provides just enough of the MMDevice API to build the LEBLEDMatrix device adapter on a
+/// Unix-like system and to drive it against the controller emulator. Serial ports are opened by
+/// their path, e.g. the emulator's pseudo-terminal, and answers are read like the serial manager of
+/// Micro-Manager does: up to the terminator, which is removed.
+#ifndef DEVICEBASE_H
+#define DEVICEBASE_H
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define DEVICE_OK                      0
+#define DEVICE_ERR                     1
+#define DEVICE_INVALID_PROPERTY        2
+#define DEVICE_INVALID_PROPERTY_VALUE  3
+#define DEVICE_UNKNOWN_POSITION        11
+#define DEVICE_SERIAL_COMMAND_FAILED   101
+#define DEVICE_SERIAL_TIMEOUT          107
+
+namespace MM {
+
+const char* const g_Keyword_Port = "Port";
+const char* const g_Keyword_State = "State";
+const char* const g_Keyword_Label = "Label";
+
+enum DeviceType {StateDevice};
+enum PropertyType {Undef, String, Float, Integer};
+enum ActionType {
+   NoAction, BeforeGet, AfterSet, IsSequenceable, AfterLoadSequence, StartSequence, StopSequence
+};
+
+class Device {
+public:
+   virtual ~Device() {}
+};
+
+class PropertyBase {
+public:
+   PropertyBase() : maxSequenceLength_(0) {}
+
+   void Set(const char* value) { value_ = value; }
+   void Set(long value) { std::ostringstream s; s << value; value_ = s.str(); }
+   void Get(std::string& value) const { value = value_; }
+   void Get(long& value) const { value = atol(value_.c_str()); }
+
+   void SetSequenceable(long maxLength) { maxSequenceLength_ = maxLength; }
+   long GetMaxSequenceLength() const { return maxSequenceLength_; }
+   void SetSequence(const std::vector<std::string>& sequence) { sequence_ = sequence; }
+   std::vector<std::string> GetSequence() const { return sequence_; }
+
+private:
+   std::string value_;
+   long maxSequenceLength_;
+   std::vector<std::string> sequence_;
+};
+
+template <class T>
+class Action {
+public:
+   typedef int (T::*Handler)(PropertyBase*, ActionType);
+
+   Action(T* obj, Handler handler) : obj_(obj), handler_(handler) {}
+
+   int Execute(PropertyBase* prop, ActionType eAct) { return (obj_->*handler_)(prop, eAct); }
+
+private:
+   T* obj_;
+   Handler handler_;
+};
+
+} // namespace MM
+
+class CDeviceUtils {
+public:
+   static bool CopyLimitedString(char* target, const char* source)
+   {
+      strncpy(target, source, 63);
+      target[63] = '\0';
+      return true;
+   }
+};
+
+/// The base class of state devices. Besides the API that device adapters use, it has methods for
+/// the test driver to set properties and run sequences as the Micro-Manager core would.
+template <class U>
+class CStateDeviceBase : public MM::Device {
+public:
+   typedef MM::Action<U> CPropertyAction;
+   typedef CStateDeviceBase<U> CStateBase;
+
+   virtual ~CStateDeviceBase()
+   {
+      for (typename std::map<std::string, Property>::iterator it = properties_.begin();
+           it != properties_.end(); ++it)
+         delete it->second.action;
+      for (std::map<std::string, int>::iterator it = ports_.begin(); it != ports_.end(); ++it)
+         close(it->second);
+   }
+
+   virtual int Initialize() = 0;
+   virtual int Shutdown() = 0;
+
+   int OnLabel(MM::PropertyBase*, MM::ActionType) { return DEVICE_OK; }
+
+   // Driver API
+   int SetProperty(const char* name, const char* value)
+   {
+      Property* prop = Find(name);
+      if (prop == 0)
+         return DEVICE_INVALID_PROPERTY;
+      prop->base.Set(value);
+      return prop->action ? prop->action->Execute(&prop->base, MM::AfterSet) : DEVICE_OK;
+   }
+
+   int GetProperty(const char* name, std::string& value)
+   {
+      Property* prop = Find(name);
+      if (prop == 0)
+         return DEVICE_INVALID_PROPERTY;
+      int ret = prop->action ? prop->action->Execute(&prop->base, MM::BeforeGet) : DEVICE_OK;
+      prop->base.Get(value);
+      return ret;
+   }
+
+   int LoadPropertySequence(const char* name, const std::vector<std::string>& sequence)
+   {
+      Property* prop = Find(name);
+      if (prop == 0 || prop->action == 0)
+         return DEVICE_INVALID_PROPERTY;
+      prop->action->Execute(&prop->base, MM::IsSequenceable);
+      if ((long)sequence.size() > prop->base.GetMaxSequenceLength())
+         return DEVICE_ERR;
+      prop->base.SetSequence(sequence);
+      return prop->action->Execute(&prop->base, MM::AfterLoadSequence);
+   }
+
+   int StartPropertySequence(const char* name)
+   {
+      Property* prop = Find(name);
+      return prop && prop->action ? prop->action->Execute(&prop->base, MM::StartSequence)
+                                  : DEVICE_INVALID_PROPERTY;
+   }
+
+   int StopPropertySequence(const char* name)
+   {
+      Property* prop = Find(name);
+      return prop && prop->action ? prop->action->Execute(&prop->base, MM::StopSequence)
+                                  : DEVICE_INVALID_PROPERTY;
+   }
+
+   std::string GetErrorText(int code) const
+   {
+      std::map<int, std::string>::const_iterator it = errorTexts_.find(code);
+      return it == errorTexts_.end() ? "" : it->second;
+   }
+
+protected:
+   void InitializeDefaultErrorMessages() {}
+   void SetErrorText(int code, const char* text) { errorTexts_[code] = text; }
+   void LogMessage(const std::string&) {}
+
+   int CreateProperty(const char* name, const char* value, MM::PropertyType, bool,
+                      CPropertyAction* action = 0, bool = false)
+   {
+      Property& prop = properties_[name];
+      prop.base.Set(value);
+      prop.action = action;
+      return DEVICE_OK;
+   }
+
+   int CreateIntegerProperty(const char* name, long value, bool readOnly,
+                             CPropertyAction* action = 0, bool preInit = false)
+   {
+      std::ostringstream s;
+      s << value;
+      return CreateProperty(name, s.str().c_str(), MM::Integer, readOnly, action, preInit);
+   }
+
+   int CreateStringProperty(const char* name, const char* value, bool readOnly,
+                            CPropertyAction* action = 0, bool preInit = false)
+   {
+      return CreateProperty(name, value, MM::String, readOnly, action, preInit);
+   }
+
+   int SetPropertyLimits(const char*, double, double) { return DEVICE_OK; }
+   int AddAllowedValue(const char*, const char*) { return DEVICE_OK; }
+   int SetPositionLabel(long, const char*) { return DEVICE_OK; }
+   int GetGateOpen(bool& open) { open = true; return DEVICE_OK; }
+
+   int PurgeComPort(const char* port)
+   {
+      int fd = Open(port);
+      if (fd < 0)
+         return DEVICE_SERIAL_COMMAND_FAILED;
+      char c;
+      while (Wait(fd, 100) && read(fd, &c, 1) == 1)
+         ;
+      return DEVICE_OK;
+   }
+
+   int SendSerialCommand(const char* port, const char* command, const char* term)
+   {
+      int fd = Open(port);
+      if (fd < 0)
+         return DEVICE_SERIAL_COMMAND_FAILED;
+      std::string line = std::string(command) + term;
+      if (write(fd, line.data(), line.size()) != (ssize_t)line.size())
+         return DEVICE_SERIAL_COMMAND_FAILED;
+      return DEVICE_OK;
+   }
+
+   int GetSerialAnswer(const char* port, const char* term, std::string& answer)
+   {
+      int fd = Open(port);
+      if (fd < 0)
+         return DEVICE_SERIAL_COMMAND_FAILED;
+      answer.clear();
+      size_t termLength = strlen(term);
+      for (;;)
+      {
+         char c;
+         if (!Wait(fd, 2000) || read(fd, &c, 1) != 1)
+            return DEVICE_SERIAL_TIMEOUT;
+         answer += c;
+         if (answer.size() >= termLength &&
+             answer.compare(answer.size() - termLength, termLength, term) == 0)
+         {
+            answer.erase(answer.size() - termLength);
+            return DEVICE_OK;
+         }
+      }
+   }
+
+private:
+   struct Property {
+      Property() : action(0) {}
+      MM::PropertyBase base;
+      CPropertyAction* action;
+   };
+
+   Property* Find(const char* name)
+   {
+      typename std::map<std::string, Property>::iterator it = properties_.find(name);
+      return it == properties_.end() ? 0 : &it->second;
+   }
+
+   int Open(const char* port)
+   {
+      std::map<std::string, int>::iterator it = ports_.find(port);
+      if (it != ports_.end())
+         return it->second;
+
+      int fd = open(port, O_RDWR | O_NOCTTY);
+      if (fd < 0)
+         return fd;
+      termios tio;
+      tcgetattr(fd, &tio);
+      cfmakeraw(&tio);
+      tcsetattr(fd, TCSANOW, &tio);
+      ports_[port] = fd;
+      return fd;
+   }
+
+   static bool Wait(int fd, int timeoutMs)
+   {
+      pollfd pfd = {fd, POLLIN, 0};
+      return poll(&pfd, 1, timeoutMs) > 0;
+   }
+
+   std::map<std::string, Property> properties_;
+   std::map<int, std::string> errorTexts_;
+   std::map<std::string, int> ports_;
+};
+
+#endif // #DEVICEBASE_H
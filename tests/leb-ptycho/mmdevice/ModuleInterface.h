@@ -0,0 +1,11 @@
+/// A minimal stand-in for Micro-Manager's ModuleInterface.h, see DeviceBase.h.
+#ifndef MODULEINTERFACE_H
+#define MODULEINTERFACE_H
+
+#include "DeviceBase.h"
+
+#define MODULE_API
+
+inline void RegisterDevice(const char*, MM::DeviceType, const char*) {}
+
+#endif // #MODULEINTERFACE_H
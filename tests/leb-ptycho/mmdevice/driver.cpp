@@ -0,0 +1,71 @@
+/// Drives the LEBLEDMatrix device adapter like the Micro-Manager core would.
+///
+/// Reads one request per line from stdin and answers each with the return code of the adapter,
+/// followed by the error text if it is not DEVICE_OK:
+///
+///   set <property> <value>            sets a property
+///   get <property>                    reads a property; answers "<code> <value>"
+///   init                              initializes the device
+///   load <property> <value> ...       loads a property sequence
+///   start <property>                  starts a property sequence
+///   stop <property>                   stops a property sequence
+///   shutdown                          shuts the device down
+#include "LEBLEDMatrix.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main()
+{
+   LEBLEDMatrix device;
+
+   std::string line;
+   while (std::getline(std::cin, line))
+   {
+      std::istringstream request(line);
+      std::string verb, name, value;
+      request >> verb >> name;
+
+      int ret = DEVICE_ERR;
+      std::string reply;
+      if (verb == "set")
+      {
+         std::getline(request >> std::ws, value);
+         ret = device.SetProperty(name.c_str(), value.c_str());
+      }
+      else if (verb == "get")
+      {
+         ret = device.GetProperty(name.c_str(), reply);
+      }
+      else if (verb == "init")
+      {
+         ret = device.Initialize();
+      }
+      else if (verb == "load")
+      {
+         std::vector<std::string> sequence;
+         while (request >> value)
+            sequence.push_back(value);
+         ret = device.LoadPropertySequence(name.c_str(), sequence);
+      }
+      else if (verb == "start")
+      {
+         ret = device.StartPropertySequence(name.c_str());
+      }
+      else if (verb == "stop")
+      {
+         ret = device.StopPropertySequence(name.c_str());
+      }
+      else if (verb == "shutdown")
+      {
+         ret = device.Shutdown();
+      }
+
+      if (ret != DEVICE_OK)
+         reply = device.GetErrorText(ret);
+      std::cout << ret << (reply.empty() ? "" : " " + reply) << std::endl;
+   }
+   return 0;
+}
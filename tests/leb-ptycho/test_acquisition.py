@@ -1,6 +1,23 @@
+import numpy as np
+from numpy.testing import assert_almost_equal
 import pytest
 
-from leb.ptycho import Direction, spiral
+from leb.ptycho import (
+    Direction,
+    LEDExposure,
+    MultiRing,
+    Ring,
+    displayed_brightness,
+    intensity_schedule,
+    intensity_schedule_from_prescan,
+    na_to_led_radius,
+    parse_report,
+    macro_commands,
+    schedule_commands,
+    spiral,
+    sync_skew,
+)
+from leb.ptycho.calibration import compute_dir_cos
 
 
 @pytest.mark.parametrize(
@@ -41,3 +58,179 @@ def test_spiral_counterclockwise(index, expected):
 )
 def test_spiral_clockwise(index, expected):
     assert spiral(index, (0, 0), Direction.CLOCKWISE) == expected
+
+
+@pytest.mark.parametrize("na, t_mm", [(0.0, 0.0), (0.1, 0.0), (0.288, 1.0), (0.5, 1.0)])
+def test_na_to_led_radius(na, t_mm):
+    """An LED at the computed radius must illuminate the sample at the requested NA."""
+    pitch_mm = 4.0
+    axial_offset_mm = -50
+
+    radius = na_to_led_radius(na, pitch_mm=pitch_mm, axial_offset_mm=axial_offset_mm, t_mm=t_mm)
+    dir_cos = compute_dir_cos(
+        np.array([[radius * pitch_mm, 0.0]]), axial_offset_mm=axial_offset_mm, t_mm=t_mm
+    )
+
+    assert_almost_equal(np.abs(dir_cos[0, 0]), na, decimal=4)
+
+
+def test_na_to_led_radius_invalid_na():
+    with pytest.raises(ValueError):
+        na_to_led_radius(1.0)
+
+
+def test_ring_from_na():
+    # 50 mm * tan(asin(0.288)) / 4 mm = 3.76 LED pitches
+    ring = Ring.from_na((16, 16), 0.288, width=2, pitch_mm=4.0, axial_offset_mm=-50)
+
+    assert (ring.r_in, ring.r_out) == (2, 3)
+    assert ring.command() == "ring 16 16 2 3 100"
+
+
+def test_ring_invalid_radii():
+    with pytest.raises(ValueError):
+        Ring((16, 16), 4, 3)
+
+
+def test_multi_ring():
+    rings = MultiRing((16, 16), 2, 3, state=50, count=3)
+
+    assert rings.radii() == [(2, 3), (6, 7), (10, 11)]
+    assert rings.command() == "rings 16 16 2 3 3 50"
+
+
+def test_schedule_commands():
+    entries = [(0, "phaseTop 16 16 3 100"), (250000, Ring((16, 16), 2, 3))]
+
+    commands = schedule_commands(entries, period_us=500000, cycles=10)
+
+    assert commands == [
+        "clearSchedule",
+        "at 0 phaseTop 16 16 3 100",
+        "at 250000 ring 16 16 2 3 100",
+        "play 500000 10",
+    ]
+
+
+@pytest.mark.parametrize(
+    "entries, period_us",
+    [
+        ([], 1000),
+        ([(10, "fill 0"), (5, "fill 100")], 1000),
+        ([(0, "fill 0"), (1000, "fill 100")], 1000),
+    ],
+)
+def test_schedule_commands_invalid(entries, period_us):
+    with pytest.raises(ValueError):
+        schedule_commands(entries, period_us)
+
+
+def test_macro_commands():
+    commands = macro_commands(3, ["fill 0", Ring((16, 16), 2, 3)], boot=True)
+
+    assert commands == [
+        "undef 3",
+        "def 3 fill 0",
+        "def 3 ring 16 16 2 3 100",
+        "boot 3",
+        "save",
+    ]
+
+
+@pytest.mark.parametrize(
+    "slot, patterns",
+    [(16, ["fill 0"]), (-1, ["fill 0"]), (0, []), (0, ["fill 0"] * 9), (0, ["@1"])],
+)
+def test_macro_commands_invalid(slot, patterns):
+    with pytest.raises(ValueError):
+        macro_commands(slot, patterns)
+
+
+def test_parse_report():
+    line = "running=1 entries=4 next=2 cycle=17 underruns=0"
+
+    assert parse_report(line) == {
+        "running": 1,
+        "entries": 4,
+        "next": 2,
+        "cycle": 17,
+        "underruns": 0,
+    }
+
+
+def test_parse_report_invalid():
+    with pytest.raises(ValueError):
+        parse_report("running=1 entries")
+
+
+def test_sync_skew():
+    counts = "edges=10 rendered=10 missed=0 empty=0"
+    reports = {
+        "leader": f"{counts} last_us=900 min_us=850 mean_us=880 max_us=990",
+        "follower": f"{counts} last_us=950 min_us=900 mean_us=930 max_us=1010",
+    }
+
+    assert sync_skew(reports) == {"leader": 0.0, "follower": 50.0}
+
+
+def test_sync_skew_nothing_rendered():
+    reports = {
+        "leader": "edges=0 rendered=0 missed=0 empty=0 last_us=0 min_us=0 mean_us=0 max_us=0"
+    }
+
+    with pytest.raises(ValueError):
+        sync_skew(reports)
+
+
+@pytest.mark.parametrize(
+    "state, expected",
+    [
+        (0, 0.0),
+        (50, 7 / 15),
+        (100, 1.0),
+    ],
+)
+def test_displayed_brightness(state, expected):
+    assert_almost_equal(displayed_brightness(state), expected)
+
+
+def test_displayed_brightness_full_bit_depth():
+    assert_almost_equal(displayed_brightness(50, bit_depth=5), 15 / 31)
+
+
+def test_intensity_schedule():
+    bf = LEDExposure(state=25, exposure_time_ms=50)
+    df = LEDExposure(state=100, exposure_time_ms=2000)
+    radius = na_to_led_radius(0.1)
+    led_indexes = [(16, 16), (16 + int(np.floor(radius)), 16), (16 + int(np.ceil(radius)), 16)]
+
+    schedule = intensity_schedule(led_indexes, (16, 16), 0.1, bf, df)
+
+    assert schedule == [bf, bf, df]
+
+
+def test_intensity_schedule_state_displayed_as_off():
+    bf = LEDExposure(state=5, exposure_time_ms=50)
+    df = LEDExposure(state=100, exposure_time_ms=2000)
+
+    with pytest.raises(ValueError, match="bright-field"):
+        intensity_schedule([(16, 16)], (16, 16), 0.1, bf, df)
+
+
+def test_intensity_schedule_from_prescan():
+    prescan = [LEDExposure(100, 10), LEDExposure(100, 10), LEDExposure(100, 10)]
+
+    schedule = intensity_schedule_from_prescan(
+        [500.0, 2.0, 0.0], prescan, target_intensity=1000, max_exposure_time_ms=1000
+    )
+
+    assert schedule == [
+        LEDExposure(100, 20.0),
+        LEDExposure(100, 1000.0),  # clipped
+        LEDExposure(100, 1000.0),  # no signal
+    ]
+
+
+def test_intensity_schedule_from_prescan_length_mismatch():
+    with pytest.raises(ValueError):
+        intensity_schedule_from_prescan([1.0], [], target_intensity=1000)
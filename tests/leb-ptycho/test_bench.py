@@ -0,0 +1,81 @@
+import json
+
+import pytest
+
+from leb.ptycho.bench import (
+    BenchReport,
+    BenchResult,
+    FirmwareBuild,
+    compare,
+    load_reports,
+    parse_bench,
+    parse_version,
+    save_report,
+)
+
+
+def report(build: str, mean_us: float, recorded: str) -> BenchReport:
+    return BenchReport(
+        firmware=FirmwareBuild("3.0.0", build),
+        results=[
+            BenchResult("brightfield", 8, 10, 1.0, mean_us, 3.0),
+            BenchResult("parse.draw", 0, 10, 40.0, 50.0, 60.0),
+        ],
+        recorded=recorded,
+    )
+
+
+def test_parse_version():
+    build = parse_version(["version 3.0.0 Oct 16 2026 12:34:56"])
+
+    assert build == FirmwareBuild("3.0.0", "Oct 16 2026 12:34:56")
+    assert build.key == "3.0.0_Oct_16_2026_12_34_56"
+
+
+def test_parse_version_malformed():
+    with pytest.raises(ValueError):
+        parse_version(["bench draw 0 1 1 1 1"])
+
+
+def test_parse_bench():
+    results = parse_bench(["bench ring 16 100 10.50 12.25 20.00", "bench parse.at 0 100 1 2 3"])
+
+    assert results == [
+        BenchResult("ring", 16, 100, 10.5, 12.25, 20.0),
+        BenchResult("parse.at", 0, 100, 1.0, 2.0, 3.0),
+    ]
+
+
+def test_parse_bench_malformed():
+    with pytest.raises(ValueError, match="Not a benchmark result"):
+        parse_bench(["stats parse 1 2 3 4"])
+
+
+def test_report_result():
+    r = report("a", 2.0, "2026-01-01T00:00:00")
+
+    assert r.result("brightfield", 8).mean_us == 2.0
+    with pytest.raises(KeyError):
+        r.result("brightfield", 4)
+
+
+def test_save_and_load_reports(tmp_path):
+    first = report("Jan 1 2026 00:00:00", 2.0, "2026-01-01T00:00:00")
+    second = report("Jan 1 2026 00:00:00", 2.2, "2026-01-02T00:00:00")
+    newer = report("Feb 1 2026 00:00:00", 1.0, "2026-02-01T00:00:00")
+
+    path = save_report(first, tmp_path)
+    save_report(second, tmp_path)
+    save_report(newer, tmp_path)
+
+    # One file per build with a list of runs
+    assert len(json.loads(path.read_text())) == 2
+    assert len(list(tmp_path.glob("*.json"))) == 2
+    assert load_reports(tmp_path) == [first, second, newer]
+
+
+def test_compare():
+    baseline = report("a", 2.0, "2026-01-01T00:00:00")
+    faster = report("b", 1.0, "2026-02-01T00:00:00")
+
+    assert compare(baseline, faster) == {("brightfield", 8): 0.5, ("parse.draw", 0): 1.0}
@@ -147,3 +147,39 @@ def test_calibrate_rectangular_matrix_sorted_results(sort, expected):
     )
 
     assert list(ks.keys()) == expected
+
+
+def test_calibrate_rectangular_matrix_single_panel_tiling():
+    """A tiling without gaps between the panels is the same as a single large matrix."""
+    indexes = [(x, y) for x in range(28, 37) for y in range(28, 37)]
+    center_led = (32, 32)
+
+    ks = calibrate_rectangular_matrix(indexes, center_led, axial_offset_mm=-50)
+    ks_tiled = calibrate_rectangular_matrix(
+        indexes, center_led, axial_offset_mm=-50, panel_size=32, panel_gap_mm=0.0
+    )
+
+    for idx in indexes:
+        assert_almost_equal(ks[idx], ks_tiled[idx])
+
+
+def test_calibrate_rectangular_matrix_panel_gap():
+    """LEDs across a panel boundary are displaced by the gap between the panels."""
+    indexes = [(31, 10), (32, 10), (33, 10)]
+    center_led = (31, 10)
+    pitch_mm = 4
+    gap_mm = 1.5
+    axial_offset_mm = -50
+
+    ks = calibrate_rectangular_matrix(
+        indexes,
+        center_led,
+        pitch_mm,
+        axial_offset_mm=axial_offset_mm,
+        panel_size=(32, 32),
+        panel_gap_mm=(gap_mm, 0.0),
+    )
+
+    for idx, expected_x_mm in zip(indexes, [0.0, pitch_mm + gap_mm, 2 * pitch_mm + gap_mm]):
+        k_actual = np.array([*ks[idx]])
+        assert_led_position(k_actual, np.array([expected_x_mm, 0.0]), axial_offset_mm, 0.0, 1.515)
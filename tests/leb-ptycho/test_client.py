@@ -0,0 +1,169 @@
+import os
+import sys
+import threading
+import time
+
+import pytest
+
+pytestmark = pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal")
+
+if sys.platform != "win32":
+    import serial
+
+    from leb.ptycho.client import ControllerError, LEDController
+
+
+class StandIn:
+    """Answers commands on the master side of a pseudo-terminal like the controller does."""
+
+    def __init__(self):
+        self.master, slave = os.openpty()
+        self.port = os.ttyname(slave)
+        self.received = []
+        self.max_unacknowledged = 0
+        self._slave = slave
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def _run(self):
+        buffer = b""
+        while True:
+            try:
+                data = os.read(self.master, 1024)
+            except OSError:
+                return
+            buffer += data
+            self.max_unacknowledged = max(self.max_unacknowledged, len(buffer))
+            while b"\n" in buffer:
+                line, buffer = buffer.split(b"\n", 1)
+                cmd = line.decode()
+                self.received.append(cmd)
+                if cmd == "unplug":
+                    # Hang up the pseudo-terminal like a disconnected USB device.
+                    os.close(self.master)
+                    return
+                if cmd == "late":
+                    # Print a line, then acknowledge after the client has given up waiting.
+                    os.write(self.master, b"late output\n")
+                    time.sleep(0.5)
+                os.write(self.master, self._reply(cmd))
+
+    @staticmethod
+    def _reply(cmd: str) -> bytes:
+        if cmd == "hang":
+            return b""
+        if cmd == "status":
+            return b"running=0 entries=0 next=0 cycle=0 underruns=0\n0\n"
+        if cmd.startswith(("fill", "draw", "single", "late")):
+            return b"0\n"
+        return f"Unrecognized command: {cmd}\nAvailable commands:\n1\n".encode()
+
+    def close(self):
+        if "unplug" not in self.received:
+            os.close(self.master)
+        os.close(self._slave)
+
+
+@pytest.fixture
+def stand_in():
+    device = StandIn()
+    yield device
+    device.close()
+
+
+@pytest.fixture
+def ctrl(stand_in):
+    with LEDController(serial.Serial(stand_in.port, timeout=0.05), timeout=2.0) as client:
+        yield client
+
+
+def test_send(ctrl, stand_in):
+    assert ctrl.send("fill 0") == []
+    assert stand_in.received == ["fill 0"]
+
+
+def test_send_returns_output(ctrl):
+    assert ctrl.send("status") == ["running=0 entries=0 next=0 cycle=0 underruns=0"]
+
+
+def test_send_error(ctrl):
+    with pytest.raises(ControllerError, match="Unrecognized command: foo"):
+        ctrl.send("foo")
+
+    # The connection is still usable after an error.
+    assert ctrl.send("fill 0") == []
+
+
+def test_send_async(ctrl):
+    future = ctrl.send_async("status")
+
+    assert future.result(2.0) == ["running=0 entries=0 next=0 cycle=0 underruns=0"]
+
+
+def test_send_batch_keeps_order(ctrl, stand_in):
+    cmds = [f"single {x} 16 100" for x in range(100)] + ["status"]
+
+    futures = ctrl.send_batch(cmds)
+    ctrl.wait()
+
+    assert stand_in.received == cmds
+    assert all(future.result() == [] for future in futures[:-1])
+    assert futures[-1].result() == ["running=0 entries=0 next=0 cycle=0 underruns=0"]
+    assert ctrl.pending == 0
+
+
+def test_send_batch_respects_window(stand_in):
+    with LEDController(serial.Serial(stand_in.port, timeout=0.05), window=64) as ctrl:
+        ctrl.send_batch([f"single {x} 16 100" for x in range(50)])
+        ctrl.wait(2.0)
+
+    assert stand_in.max_unacknowledged <= 64
+
+
+def test_send_too_long(ctrl):
+    with pytest.raises(ValueError):
+        ctrl.send("draw " + "1" * 100)
+
+
+def test_send_after_close(stand_in):
+    ctrl = LEDController(serial.Serial(stand_in.port, timeout=0.05))
+    ctrl.close()
+
+    with pytest.raises(ConnectionError):
+        ctrl.send_async("fill 0")
+
+
+def test_send_times_out(stand_in):
+    with LEDController(serial.Serial(stand_in.port, timeout=0.05), timeout=0.2) as ctrl:
+        with pytest.raises(TimeoutError):
+            ctrl.send("hang")
+
+
+def test_late_acknowledgement_is_not_taken_for_the_next_command(stand_in):
+    with LEDController(serial.Serial(stand_in.port, timeout=0.05), timeout=0.2) as ctrl:
+        with pytest.raises(TimeoutError):
+            ctrl.send("late")
+
+        ctrl.timeout = 2.0
+        assert ctrl.send("status") == ["running=0 entries=0 next=0 cycle=0 underruns=0"]
+        with pytest.raises(ControllerError):
+            ctrl.send("foo")
+        assert ctrl.send("fill 0") == []
+
+
+def test_send_while_commands_are_pending(ctrl, stand_in):
+    futures = ctrl.send_batch([f"single {x} 16 100" for x in range(50)])
+
+    assert ctrl.send("status") == ["running=0 entries=0 next=0 cycle=0 underruns=0"]
+    assert all(future.result(2.0) == [] for future in futures)
+    assert stand_in.received[-1] == "status"
+
+
+def test_port_failure_fails_pending_commands(ctrl, stand_in):
+    futures = ctrl.send_batch(["hang", "unplug"])
+
+    for future in futures:
+        with pytest.raises(ConnectionError):
+            future.result(2.0)
+    with pytest.raises(ConnectionError):
+        ctrl.send_async("fill 0")
@@ -1,8 +1,10 @@
+import json
+
 import pytest
 import numpy as np
 from numpy.testing import assert_array_almost_equal
 
-from leb.ptycho.datasets import FPDataset, hdr_combine, hdr_stack
+from leb.ptycho.datasets import FPDataset, hdr_combine, hdr_stack, parse_freeze_metadata
 
 
 @pytest.fixture
@@ -339,3 +341,114 @@ def test_hdr_stack_creation(fake_stack_hdr_data):
     )
 
     assert_array_almost_equal(hdr_dataset.images, expected_dataset.images)
+
+
+def test_ptychodataset_normalized(fake_data):
+    images, wavevectors, led_indexes = fake_data
+    images = np.ones_like(images)
+    intensity_scale = np.linspace(1, 10, images.shape[0])
+    dataset = FPDataset(images, wavevectors, led_indexes, intensity_scale)
+
+    normalized = dataset.normalized()
+
+    assert normalized.intensity_scale is None
+    assert_array_almost_equal(normalized.images[:, 0, 0], 1 / intensity_scale)
+
+
+def test_ptychodataset_normalized_without_scale(fake_data):
+    dataset = FPDataset(*fake_data)
+
+    assert dataset.normalized() is dataset
+
+
+def test_ptychodataset_slicing_keeps_intensity_scale(fake_data):
+    intensity_scale = np.arange(1, 11, dtype=float)
+    dataset = FPDataset(*fake_data, intensity_scale)
+
+    assert_array_almost_equal(dataset[2:5].intensity_scale, [3, 4, 5])
+    assert_array_almost_equal(dataset[2].intensity_scale, [3])
+
+
+def test_ptychodataset_intensity_scale_wrong_length(fake_data):
+    with pytest.raises(ValueError):
+        FPDataset(*fake_data, np.ones(3))
+
+
+def test_ptychodataset_intensity_scale_not_positive(fake_data):
+    with pytest.raises(ValueError):
+        FPDataset(*fake_data, np.zeros(10))
+
+
+def test_parse_freeze_metadata_intensity_scale():
+    frames = {
+        "frame_0": {
+            "led_indexes": [16, 16],
+            "led_center": [16, 16],
+            "exposure_time_ms": 50,
+            "gain_db": 10,
+            "led_state": 100,
+        },
+        "frame_1": {
+            "led_indexes": [24, 16],
+            "led_center": [16, 16],
+            "exposure_time_ms": 2000,
+            "gain_db": 10,
+            "led_state": 100,
+        },
+    }
+    description = json.dumps({"shape": [2, 64, 64], **frames})
+    metadata = {"Info": f"ImageDescription: {description}\n"}
+
+    parsed = parse_freeze_metadata(metadata)
+
+    assert parsed.led_indexes == [(16, 16), (24, 16)]
+    assert parsed.intensity_scale == [1.0, 40.0]
+
+
+def test_parse_freeze_metadata_without_exposure():
+    frames = {"frame_0": {"led_indexes": [16, 16], "led_center": [16, 16]}}
+    description = json.dumps({"shape": [1, 64, 64], **frames})
+    metadata = {"Info": f"ImageDescription: {description}\n"}
+
+    assert parse_freeze_metadata(metadata).intensity_scale is None
+
+
+def test_parse_freeze_metadata_equal_doses():
+    frames = {
+        f"frame_{i}": {"led_indexes": [16 + i, 16], "led_center": [16, 16], "exposure_time_ms": 50}
+        for i in range(2)
+    }
+    description = json.dumps({"shape": [2, 64, 64], **frames})
+    metadata = {"Info": f"ImageDescription: {description}\n"}
+
+    assert parse_freeze_metadata(metadata).intensity_scale is None
+
+
+def test_parse_freeze_metadata_zero_dose():
+    frames = {
+        "frame_0": {"led_indexes": [16, 16], "led_center": [16, 16], "exposure_time_ms": 50},
+        "frame_1": {
+            "led_indexes": [24, 16],
+            "led_center": [16, 16],
+            "exposure_time_ms": 50,
+            "led_state": 5,
+        },
+    }
+    description = json.dumps({"shape": [2, 64, 64], **frames})
+    metadata = {"Info": f"ImageDescription: {description}\n"}
+
+    with pytest.raises(ValueError, match="frame_1"):
+        parse_freeze_metadata(metadata)
+
+
+def test_parse_freeze_metadata_zero_dose_after_frame_without_exposure():
+    frames = {
+        "frame_0": {"led_indexes": [16, 16], "led_center": [16, 16]},
+        "frame_1": {"led_indexes": [20, 16], "led_center": [16, 16], "exposure_time_ms": 50},
+        "frame_2": {"led_indexes": [24, 16], "led_center": [16, 16], "exposure_time_ms": 0},
+    }
+    description = json.dumps({"shape": [3, 64, 64], **frames})
+    metadata = {"Info": f"ImageDescription: {description}\n"}
+
+    with pytest.raises(ValueError, match="frame_2"):
+        parse_freeze_metadata(metadata)
@@ -0,0 +1,185 @@
+"""Runs the Micro-Manager device adapter against the controller emulator.
+
+The adapter is built with the minimal MMDevice stand-in in `mmdevice` and driven line by line, like
+the Micro-Manager core would, while the emulator plays the controller.
+"""
+from pathlib import Path
+import shutil
+import subprocess
+import sys
+import time
+
+import numpy as np
+import pytest
+
+from leb.ptycho import spiral
+
+pytestmark = [
+    pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal"),
+    pytest.mark.skipif(shutil.which("g++") is None, reason="requires a C++ compiler"),
+]
+
+if sys.platform != "win32":
+    from leb.ptycho.emulator import Emulator
+
+
+ROOT = Path(__file__).parents[2]
+ADAPTER = ROOT / "umanager" / "LEBLEDMatrix"
+STUB = Path(__file__).parent / "mmdevice"
+CENTER = (16, 16)
+
+
+@pytest.fixture(scope="module")
+def driver(tmp_path_factory):
+    executable = tmp_path_factory.mktemp("adapter") / "driver"
+    subprocess.run(
+        [
+            "g++",
+            "-std=c++11",
+            "-Wall",
+            f"-I{STUB}",
+            f"-I{ADAPTER}",
+            str(ADAPTER / "LEBLEDMatrix.cpp"),
+            str(STUB / "driver.cpp"),
+            "-o",
+            str(executable),
+        ],
+        check=True,
+    )
+    return executable
+
+
+class Adapter:
+    def __init__(self, process: subprocess.Popen):
+        self._process = process
+
+    def request(self, line: str) -> str:
+        self._process.stdin.write(line + "\n")
+        self._process.stdin.flush()
+        return self._process.stdout.readline().strip()
+
+    def __call__(self, line: str) -> None:
+        reply = self.request(line)
+        assert reply == "0", f"{line}: {reply}"
+
+
+@pytest.fixture
+def emulator():
+    with Emulator() as emu:
+        yield emu
+
+
+@pytest.fixture
+def adapter(driver, emulator):
+    with subprocess.Popen(
+        [str(driver)], stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True
+    ) as process:
+        device = Adapter(process)
+        device(f"set Port {emulator.port}")
+        device(f"set CenterLEDX {CENTER[0]}")
+        device(f"set CenterLEDY {CENTER[1]}")
+        device("init")
+        yield device
+        device("shutdown")
+        process.stdin.close()
+
+
+def lit_led(emulator) -> tuple[int, int]:
+    """Returns the (x, y) indexes of the only LED that is on."""
+    time.sleep(0.05)
+    (y, x), *others = np.argwhere(emulator.framebuffer())
+    assert not others
+    return int(x), int(y)
+
+
+def test_state_switches_on_one_led(adapter, emulator):
+    adapter("set State 5")
+
+    assert lit_led(emulator) == spiral(5, CENTER)
+    assert adapter.request("get State") == "0 5"
+
+
+def test_sequence_repeats(adapter, emulator):
+    sequence = [3, 1, 4]
+    adapter("load State " + " ".join(map(str, sequence)))
+    adapter("start State")
+
+    lit = []
+    for _ in range(7):
+        emulator.sync_edge()
+        lit.append(lit_led(emulator))
+
+    assert lit == [spiral(sequence[i % 3], CENTER) for i in range(7)]
+
+
+def test_sequence_can_be_restarted(adapter, emulator):
+    adapter("load State 2 7")
+    for _ in range(2):
+        adapter("start State")
+        emulator.sync_edge()
+        assert lit_led(emulator) == spiral(2, CENTER)
+        emulator.sync_edge()
+        assert lit_led(emulator) == spiral(7, CENTER)
+        adapter("stop State")
+
+
+def test_sequence_uses_the_brightness_at_the_start(adapter, emulator):
+    adapter("load State 0")
+    adapter("set Brightness 50")
+    adapter("start State")
+    emulator.sync_edge()
+
+    time.sleep(0.05)
+    assert emulator.framebuffer()[CENTER[1], CENTER[0]] == pytest.approx(7 / 15)
+
+
+def test_sequence_too_long(adapter):
+    reply = adapter.request("load State " + " ".join(["0"] * 65))
+
+    assert reply != "0"
+
+
+def test_controller_error_is_reported(adapter):
+    reply = adapter.request("set Command foo")
+
+    assert reply.startswith("10001 foo: Unrecognized command: foo")
+
+
+def test_pattern_is_centered_on_the_position(adapter, emulator):
+    adapter("set Pattern Brightfield")
+    adapter("set Radius 2")
+    adapter("set State 3")
+    adapter("set State 5")
+
+    time.sleep(0.05)
+    lit = np.argwhere(emulator.framebuffer())
+    assert len(lit) > 1
+    assert tuple(lit.mean(axis=0)[::-1]) == spiral(5, CENTER)
+    assert np.abs(lit - spiral(5, CENTER)[::-1]).max() == 2
+
+
+def test_darkfield_sequence(adapter, emulator):
+    adapter("set Pattern Darkfield")
+    adapter("set Radius 2")
+    adapter("load State 0 8")
+    adapter("start State")
+
+    for position in (0, 8):
+        emulator.sync_edge()
+        time.sleep(0.05)
+        frame = emulator.framebuffer()
+        x, y = spiral(position, CENTER)
+        assert frame[y, x] == 0
+        assert frame[0, 0] > 0
+
+
+@pytest.mark.parametrize("pattern", ["Brightfield", "PhaseTop", "Ring"])
+def test_pattern_that_draws_over_the_previous_one_is_not_sequenceable(adapter, pattern):
+    adapter(f"set Pattern {pattern}")
+
+    assert adapter.request("load State 0 1") != "0"
+
+
+def test_unknown_pattern(adapter):
+    assert adapter.request("set Pattern Foo").startswith("3")
+    assert adapter.request("get Pattern") == "0 Single"
@@ -0,0 +1,130 @@
+import numpy as np
+from numpy.fft import fft2, fftshift, ifft2, ifftshift
+import pytest
+
+from leb.ptycho.dpc import (
+    DPCConfig,
+    DPCError,
+    DPCSolver,
+    HalfCircle,
+    config_transfer_functions,
+    dpc_recover,
+    source,
+    transfer_functions,
+)
+
+
+NUM_PX = 64
+
+
+@pytest.fixture
+def config() -> DPCConfig:
+    # A pupil radius of 7 px and LEDs about 3 px apart in the Fourier plane
+    return DPCConfig(num_px=NUM_PX, na=0.1, axial_offset_mm=-100, center_led=(16, 16), radius=2)
+
+
+def weak_object(seed: int, cutoff_px: int = 10) -> np.ndarray:
+    """Returns a smooth, band limited random pattern with a standard deviation of 0.1."""
+    rng = np.random.default_rng(seed)
+    y, x = np.ogrid[-NUM_PX // 2 : NUM_PX // 2, -NUM_PX // 2 : NUM_PX // 2]
+    spectrum = fftshift(fft2(rng.normal(size=(NUM_PX, NUM_PX)))) * (
+        x**2 + y**2 < cutoff_px**2
+    )
+    pattern = np.real(ifft2(ifftshift(spectrum)))
+    return 0.1 * pattern / pattern.std()
+
+
+def simulate(obj: np.ndarray, config: DPCConfig) -> np.ndarray:
+    """Images an object with each half-circle as the incoherent sum of its LEDs."""
+    pupil = config.pupil()
+    obj_fft = fftshift(fft2(obj))
+
+    images = []
+    for half_circle in config.half_circles:
+        image = np.zeros((NUM_PX, NUM_PX))
+        for wavevector in config.calibration(half_circle).values():
+            kx_px, ky_px = np.round(np.array(wavevector[:2]) / pupil.dk).astype(int)
+            shifted = np.roll(obj_fft, (-ky_px, -kx_px), axis=(0, 1))
+            image += np.abs(ifft2(ifftshift(shifted * pupil.p))) ** 2
+        images.append(image)
+    return np.array(images)
+
+
+def test_half_circle_led_indexes():
+    center = (10, 20)
+
+    assert HalfCircle.TOP.led_indexes(center, 1) == [(10, 19)]
+    assert HalfCircle.BOTTOM.led_indexes(center, 1) == [(10, 21)]
+    assert HalfCircle.RIGHT.led_indexes(center, 1) == [(11, 20)]
+    assert HalfCircle.LEFT.led_indexes(center, 1) == [(9, 20)]
+
+    top, bottom = HalfCircle.TOP.led_indexes(center, 3), HalfCircle.BOTTOM.led_indexes(center, 3)
+    assert len(top) == len(bottom) == 11
+    assert all(y < 20 for _, y in top)
+    assert sorted((x, 40 - y) for x, y in top) == sorted(bottom)
+
+
+def test_half_circle_command():
+    assert HalfCircle.LEFT.command((12, 16), 3) == "phaseLeft 12 16 3 100"
+
+
+def test_transfer_functions_at_zero_frequency(config):
+    wotf = config_transfer_functions(config)
+
+    assert wotf.absorption.shape == wotf.phase.shape == (4, NUM_PX, NUM_PX)
+    np.testing.assert_allclose(wotf.absorption[:, 0, 0], -2)
+    np.testing.assert_allclose(wotf.phase[:, 0, 0], 0, atol=1e-12)
+
+
+def test_opposite_half_circles_cancel_phase_transfer(config):
+    wotf = config_transfer_functions(config)
+
+    # A symmetric source does not transfer the phase of an unaberrated system.
+    np.testing.assert_allclose(wotf.phase[0] + wotf.phase[1], 0, atol=1e-12)
+    np.testing.assert_allclose(wotf.phase[2] + wotf.phase[3], 0, atol=1e-12)
+    assert np.abs(wotf.phase[0]).max() > 0.1
+
+
+def test_transfer_functions_dark_field_source(config):
+    pupil = config.pupil()
+    dark_field = {(0, 0): (3.0, 0.0, 1.0)}  # far outside the pupil
+
+    with pytest.raises(DPCError):
+        transfer_functions(pupil, [source(pupil, dark_field)])
+
+
+def test_dpc_recover_phase(config):
+    phase = weak_object(seed=0)
+
+    result = dpc_recover(simulate(np.exp(1j * phase), config), config, 1e-3, 1e-3)
+
+    assert np.corrcoef(result.phase.ravel(), phase.ravel())[0, 1] > 0.99
+    assert result.phase.std() == pytest.approx(phase.std(), rel=0.05)
+    assert np.abs(result.absorption).max() < 0.2 * np.abs(phase).max()
+
+
+def test_dpc_recover_absorption_and_phase(config):
+    absorption, phase = weak_object(seed=1), weak_object(seed=2)
+
+    result = dpc_recover(simulate(np.exp(-absorption + 1j * phase), config), config, 1e-3, 1e-3)
+
+    assert np.corrcoef(result.absorption.ravel(), absorption.ravel())[0, 1] > 0.95
+    assert np.corrcoef(result.phase.ravel(), phase.ravel())[0, 1] > 0.95
+
+
+def test_solver_is_cached_per_config(config):
+    solver = DPCSolver.from_config(config)
+
+    assert DPCSolver.from_config(config) is solver
+    assert DPCSolver.from_config(DPCConfig(**{**config.__dict__, "radius": 1})) is not solver
+    assert DPCSolver.from_config(config, reg_phase=1.0) is not solver
+
+
+def test_solver_rejects_wrong_number_of_images(config):
+    with pytest.raises(DPCError, match="shape"):
+        DPCSolver.from_config(config).solve(np.ones((3, NUM_PX, NUM_PX)))
+
+
+def test_solver_rejects_nonpositive_regularization(config):
+    with pytest.raises(DPCError):
+        DPCSolver(config_transfer_functions(config), reg_absorption=0)
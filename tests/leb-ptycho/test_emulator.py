@@ -0,0 +1,388 @@
+from pathlib import Path
+import re
+import sys
+import time
+
+import numpy as np
+import pytest
+
+pytestmark = pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal")
+
+if sys.platform != "win32":
+    import serial
+
+    from leb.ptycho import macro_commands
+    from leb.ptycho.bench import run_bench
+    from leb.ptycho.client import ControllerError, LEDController
+    from leb.ptycho.emulator import HELP, Emulator
+    from leb.ptycho.trace import TRACE_SIZE, TraceSource, read_trace
+
+
+FIRMWARE = Path(__file__).parents[2] / "arduino_src" / "led_matrix_controller"
+
+
+@pytest.fixture
+def emulator():
+    with Emulator() as emu:
+        yield emu
+
+
+@pytest.fixture
+def ctrl(emulator):
+    with LEDController(serial.Serial(emulator.port, timeout=0.05), timeout=2.0) as client:
+        yield client
+
+
+def test_help_matches_firmware():
+    source = (FIRMWARE / "led_matrix_controller.ino").read_text()
+    body = source.split("void printHelp() {")[1].split("\n}")[0]
+    lines = re.findall(r'Serial\.println\((?:F\()?"(.*)"\)', body)
+
+    # The C string literals escape the backslashes.
+    assert [line.replace("\\\\", "\\") for line in lines] == HELP
+
+
+def test_unrecognized_command(emulator):
+    with serial.Serial(emulator.port, timeout=1) as port:
+        port.reset_input_buffer()
+        port.write(b"foo 1 2\n")
+        reply = [port.readline() for _ in range(len(HELP) + 3)]
+
+    assert reply[0] == b"Unrecognized command: foo 1 2\n"
+    assert reply[1] == b"\r\n"
+    assert reply[2] == b"Available commands:\r\n"
+    assert reply[-1] == b"1\n"
+
+
+def test_line_too_long(emulator):
+    with serial.Serial(emulator.port, timeout=1) as port:
+        port.reset_input_buffer()
+        port.write(b"draw " + b"1" * 60 + b"\n")
+
+        assert port.readline() == b"No line terminator found\r\n"
+
+
+def test_draw(ctrl, emulator):
+    ctrl.send("draw 10 17 100")
+    ctrl.send("draw 11 17 50")
+
+    fb = emulator.framebuffer()
+    assert fb.shape == (32, 32)
+    assert fb[17, 10] == 1.0
+    assert fb[17, 11] == pytest.approx(7 / 15)
+    assert fb.sum() == pytest.approx(1 + 7 / 15)
+
+
+def test_single_clears_other_leds(ctrl, emulator):
+    ctrl.send("fill 100")
+    ctrl.send("single 3 4 100")
+
+    fb = emulator.framebuffer()
+    assert fb[4, 3] == 1.0
+    assert fb.sum() == 1.0
+
+
+def test_brightfield_is_a_symmetric_disc(ctrl, emulator):
+    ctrl.send("brightfield 16 16 3 100")
+
+    fb = emulator.framebuffer()
+    disc = fb[13:20, 13:20]
+    assert disc[3].sum() == 7  # the center row spans the diameter
+    assert np.array_equal(disc, disc.T)
+    assert np.array_equal(disc, disc[::-1])
+    assert fb.sum() == disc.sum()
+
+
+def test_ring(ctrl, emulator):
+    ctrl.send("ring 16 16 2 3 100")
+
+    fb = emulator.framebuffer()
+    assert fb[16, 16] == 0
+    assert fb[16, 18] == 1.0
+    assert fb[16, 19] == 1.0
+    assert fb[16, 20] == 0
+
+
+def test_dither_extends_the_bit_depth(ctrl, emulator):
+    ctrl.send("dither 2")
+    ctrl.send("fill 50")
+
+    assert emulator.framebuffer()[0, 0] == pytest.approx(0.5)
+
+    with pytest.raises(ControllerError, match="Cannot dither"):
+        ctrl.send("dither 5")
+
+
+@pytest.mark.parametrize("extra_bits", [5, 256, 260])
+def test_dither_rejects_too_many_extra_bits(ctrl, emulator, extra_bits):
+    ctrl.send("dither 2")
+
+    with pytest.raises(ControllerError, match="more than 4 extra bits"):
+        ctrl.send(f"dither {extra_bits}")
+    ctrl.send("fill 50")
+
+    assert emulator.framebuffer()[0, 0] == pytest.approx(0.5)
+
+
+def test_dither_subframe_period(ctrl, emulator):
+    ctrl.send("dither 2 4000")
+    ctrl.send("fill 50")
+
+    assert emulator.framebuffer()[0, 0] == pytest.approx(0.5)
+    assert ctrl.send("stats")[3].startswith("stats dither 1 ")
+
+    with pytest.raises(ControllerError, match="too short subframes"):
+        ctrl.send("dither 2 500")
+
+
+def test_geometry_exceeds_chain(ctrl):
+    with pytest.raises(ControllerError, match="needs more panels"):
+        ctrl.send("geometry 2 1 0")
+
+
+def test_preload_and_advance(ctrl, emulator):
+    ctrl.send("sync leader")
+    ctrl.send("preload single 1 1 100")
+    ctrl.send("preload single 2 2 100")
+
+    ctrl.send("advance")
+    time.sleep(0.05)
+    assert emulator.framebuffer()[1, 1] == 1.0
+
+    ctrl.send("advance")
+    time.sleep(0.05)
+    assert emulator.framebuffer()[2, 2] == 1.0
+    assert emulator.framebuffer().sum() == 1.0
+
+    report = ctrl.send("skew")[0]
+    assert report.startswith("edges=2 rendered=2 missed=0 empty=0")
+
+
+def test_follower_renders_on_sync_edges(ctrl, emulator):
+    ctrl.send("sync follower")
+    ctrl.send("preload fill 100")
+
+    emulator.sync_edge()
+    time.sleep(0.05)
+
+    assert emulator.framebuffer().min() == 1.0
+    with pytest.raises(ControllerError, match="Only the sync leader can advance"):
+        ctrl.send("advance")
+
+
+def test_cycle_preload_repeats_the_queue(ctrl, emulator):
+    ctrl.send("sync leader")
+    ctrl.send("preload single 1 1 100")
+    ctrl.send("cyclePreload on")
+    ctrl.send("preload single 2 2 100")
+
+    lit = []
+    for _ in range(5):
+        ctrl.send("advance")
+        time.sleep(0.05)
+        lit.append(tuple(np.argwhere(emulator.framebuffer())[0]))
+
+    assert lit == [(1, 1), (2, 2), (1, 1), (2, 2), (1, 1)]
+    assert ctrl.send("skew")[0].startswith("edges=5 rendered=5 missed=0 empty=0")
+
+
+def test_cycle_preload_off_frees_the_latched_patterns(ctrl, emulator):
+    ctrl.send("sync leader")
+    ctrl.send("preload single 1 1 100")
+    ctrl.send("preload single 2 2 100")
+    ctrl.send("cyclePreload on")
+    ctrl.send("advance")
+    ctrl.send("cyclePreload off")
+
+    ctrl.send("advance")
+    ctrl.send("advance")
+    time.sleep(0.05)
+
+    assert emulator.framebuffer()[2, 2] == 1.0
+    assert ctrl.send("skew")[0].startswith("edges=3 rendered=2 missed=0 empty=1")
+
+
+def test_cycling_queue_keeps_its_patterns(ctrl):
+    ctrl.send("sync leader")
+    ctrl.send("cyclePreload on")
+    futures = ctrl.send_batch(["preload fill 0"] * 64 + ["advance", "preload fill 0"])
+    ctrl.wait()
+
+    assert isinstance(futures[-1].exception(), ControllerError)
+
+
+def test_preload_holds_preload_size_patterns(ctrl):
+    futures = ctrl.send_batch(["preload fill 0"] * 65)
+    ctrl.wait()
+
+    assert all(future.exception() is None for future in futures[:64])
+    assert isinstance(futures[64].exception(), ControllerError)
+
+
+def test_deferring_non_drawing_command(ctrl):
+    with pytest.raises(ControllerError, match="Only drawing commands can be deferred"):
+        ctrl.send("preload status")
+
+
+def test_schedule_playback(ctrl, emulator):
+    ctrl.send("clearSchedule")
+    ctrl.send("at 0 single 5 5 100")
+    ctrl.send("at 20000 single 6 6 100")
+    ctrl.send("play 40000 1")
+
+    time.sleep(0.2)
+
+    assert emulator.framebuffer()[6, 6] == 1.0
+    assert ctrl.send("status") == ["running=0 entries=2 next=2 cycle=1 underruns=0"]
+
+
+def test_link_and_render_time_are_modeled():
+    with Emulator(baudrate=9600, render_time_s=0.02) as emulator:
+        with LEDController(serial.Serial(emulator.port, timeout=0.05)) as ctrl:
+            start = time.perf_counter()
+            ctrl.send("fill 0")
+            elapsed = time.perf_counter() - start
+
+    # 7 bytes in, 2 bytes out at about 1 ms per byte, plus the render time
+    assert elapsed >= 0.029
+
+
+def test_rx_buffer_holds_back_input_without_flow_control():
+    with Emulator(render_time_s=0.01) as emulator:
+        with serial.Serial(emulator.port, timeout=1) as port:
+            port.write(b"fill 0\n" * 100)
+
+            # Wait until the emulator has worked through all commands.
+            time.sleep(2.5)
+            port.reset_input_buffer()
+            port.write(b"stats\n")
+            stats = [port.readline().decode() for _ in range(5)]
+
+    # No command was lost, although the ring buffer was full while the emulator rendered.
+    assert stats[0].startswith("stats parse 101 ")
+    assert stats[4].startswith("rx_bytes=")
+    assert "rx_overflows=0 " not in stats[4]
+
+
+def test_rx_buffer_does_not_overflow_with_flow_control(emulator):
+    with LEDController(serial.Serial(emulator.port, timeout=0.05)) as ctrl:
+        ctrl.send_batch(["fill 0"] * 200)
+        ctrl.wait()
+        stats = ctrl.send("stats")
+
+    assert stats[0].startswith("stats parse 201 ")
+    assert [line.split()[1] for line in stats[:4]] == ["parse", "render", "show", "dither"]
+    assert "rx_overflows=0 " in stats[4]
+
+
+def test_trace_records_displayed_patterns(ctrl):
+    ctrl.send("trace")
+    ctrl.send("single 3 4 100")
+    ctrl.send("sync leader")
+    ctrl.send("preload ring 16 16 2 3 50")
+    ctrl.send("advance")
+    time.sleep(0.05)
+
+    trace = read_trace(ctrl)
+
+    assert trace.lost == 0
+    assert [(e.cmd, e.source) for e in trace.events] == [
+        ("single", TraceSource.COMMAND),
+        ("ring", TraceSource.SYNC),
+    ]
+    assert (trace.events[1].x, trace.events[1].r_out, trace.events[1].state) == (16, 3, 50)
+    assert trace.events[1].seq == trace.events[0].seq + 1
+    assert trace.events[1].t_us > trace.events[0].t_us
+    assert read_trace(ctrl).events == []
+
+
+def test_trace_keeps_the_latest_events(ctrl):
+    ctrl.send("trace")
+    ctrl.send_batch([f"single {i % 32} 0 100" for i in range(TRACE_SIZE + 5)])
+    ctrl.wait()
+
+    trace = read_trace(ctrl)
+
+    assert trace.lost == 5
+    assert len(trace.events) == TRACE_SIZE
+    assert trace.events[0].x == 5
+
+
+def test_bench(ctrl):
+    report = run_bench(ctrl, iterations=2)
+
+    assert report.firmware.version == "3.0.0"
+    cases = {(result.case, result.r) for result in report.results}
+    assert ("draw", 0) in cases
+    assert {("rings", r) for r in (1, 4, 8, 16)} <= cases
+    assert ("parse.preload", 0) in cases
+    assert all(r.min_us <= r.mean_us <= r.max_us for r in report.results)
+
+
+def test_bench_iterations_out_of_range(ctrl):
+    with pytest.raises(ControllerError):
+        ctrl.send("bench 0")
+
+
+def test_macro_recall(ctrl, emulator):
+    ctrl.send_batch(macro_commands(2, ["fill 0", "draw 1 1 100", "draw 2 2 100"], save=False))
+    ctrl.wait()
+    ctrl.send("fill 100")
+
+    ctrl.send("@2")
+
+    fb = emulator.framebuffer()
+    assert fb.sum() == 2
+    assert fb[1, 1] == fb[2, 2] == 1.0
+    assert ctrl.send("macros") == ["boot -1", "macro 2 3"]
+
+
+def test_macro_can_be_preloaded(ctrl, emulator):
+    ctrl.send_batch(macro_commands(0, ["single 5 6 100"], save=False))
+    ctrl.send("sync leader")
+    ctrl.send("preload @0")
+    ctrl.send("advance")
+    time.sleep(0.05)
+
+    assert emulator.framebuffer()[6, 5] == 1.0
+    assert [(e.cmd, e.count) for e in read_trace(ctrl).events] == [("recall", 0)]
+
+
+@pytest.mark.parametrize(
+    "cmd, error",
+    [
+        ("@3", "The macro is empty"),
+        ("def 0 @1", "the command is a recall"),
+        ("def 0 status", "Only drawing commands can be deferred"),
+    ],
+)
+def test_macro_errors(ctrl, cmd, error):
+    with pytest.raises(ControllerError, match=error):
+        ctrl.send(cmd)
+
+
+def test_macro_slot_out_of_range(ctrl):
+    for cmd in ("@16", "undef -1", "boot 16"):
+        with pytest.raises(ControllerError):
+            ctrl.send(cmd)
+
+
+def test_macro_is_full(ctrl):
+    futures = ctrl.send_batch([f"def 1 draw {i} 0 100" for i in range(9)])
+    ctrl.wait()
+
+    assert all(future.exception() is None for future in futures[:8])
+    with pytest.raises(ControllerError, match="the macro is full"):
+        futures[8].result()
+
+
+def test_saved_macros_survive_a_power_cycle(ctrl, emulator):
+    ctrl.send_batch(macro_commands(4, ["brightfield 16 16 2 100"], boot=True))
+    ctrl.send_batch(macro_commands(5, ["fill 100"], save=False))
+    ctrl.wait()
+
+    with Emulator(flash=emulator.flash) as rebooted:
+        # The boot macro is displayed without a host.
+        assert rebooted.framebuffer()[16, 16] == 1.0
+        with LEDController(serial.Serial(rebooted.port, timeout=0.05), timeout=2.0) as client:
+            assert client.send("macros") == ["boot 4", "macro 4 1"]
@@ -1,8 +1,30 @@
 import numpy as np
+from numpy.fft import fft2, fftshift, ifft2, ifftshift
 import pytest
+from skimage.transform import rescale
 
+import leb.ptycho.fp
 from leb.ptycho.datasets import FPDataset
-from leb.ptycho.fp import fp_recover, FPRecoveryError, PupilRecoveryMethod, Pupil
+from leb.ptycho.fp import (
+    FPResults,
+    fp_recover,
+    fp_recover_multiresolution,
+    FPRecoveryError,
+    IterationMetrics,
+    LEDOrder,
+    ObjectUpdateMethod,
+    PupilRecoveryMethod,
+    Pupil,
+    StopReason,
+    _builtin_schedule,
+    _Momentum,
+    _fitting_images,
+    _pad_spectrum,
+    _unshifted_index,
+    slice_fft,
+    zernike_gradients,
+)
+from leb.ptycho.simulation import fp_simulation
 
 
 NUM_PX = (64, 64)
@@ -79,3 +101,475 @@ def test_pupil_set_p_wrong_dtype(fake_pupil):
 
     with pytest.raises(ValueError):
         fake_pupil.set_p(new_pupil_data)
+
+
+def test_pupil_support_bbox(fake_pupil):
+    rows, cols = fake_pupil.support_bbox
+    radius = fake_pupil.pupil_radius_px
+
+    assert rows.stop - rows.start == cols.stop - cols.start == 2 * radius + 1
+    assert fake_pupil.support[rows, cols].sum() == fake_pupil.support.sum()
+    assert np.all(fake_pupil.p[~fake_pupil.support] == 0)
+
+
+def full_grid_rpie(dataset, pupil, num_iterations, alpha_O, alpha_P):
+    """The rPIE object and pupil updates computed on the full grid of each slice."""
+    num_px = dataset.images.shape[1]
+    target_fft = fftshift(fft2(rescale(np.mean(dataset.images, axis=0), 2)))
+    p = pupil.p.copy()
+
+    for _ in range(num_iterations):
+        for image, wavevector, _ in dataset:
+            kx_ky_px = np.round(wavevector[0:2] / pupil.dk).astype(int)
+            current_slice_fft = slice_fft(target_fft, kx_ky_px, num_px)
+
+            low_res_img_fft = current_slice_fft * p
+            low_res_img = ifft2(ifftshift(low_res_img_fft))
+            low_res_img = np.abs(image) * np.exp(1j * np.angle(low_res_img))
+            diff = fftshift(fft2(low_res_img)) - low_res_img_fft
+
+            current_slice_fft += (
+                np.conj(p) / ((1 - alpha_O) * abs(p) ** 2 + alpha_O * np.max(np.abs(p) ** 2)) * diff
+            )
+            p = (
+                p
+                + np.conj(current_slice_fft)
+                / (
+                    (1 - alpha_P) * abs(current_slice_fft) ** 2
+                    + alpha_P * np.max(np.abs(current_slice_fft) ** 2)
+                )
+                * diff
+            )
+            p[~pupil.support] = 0
+
+    return ifft2(ifftshift(target_fft)), p
+
+
+def test_fp_recover_matches_full_grid_updates(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=2,
+        pupil_recovery_method=PupilRecoveryMethod.rPIE,
+        upsampling_factor=2,
+        alpha_O=0.5,
+        alpha_P=0.5,
+    )
+    obj, p = full_grid_rpie(dataset, pupil, num_iterations=2, alpha_O=0.5, alpha_P=0.5)
+
+    np.testing.assert_allclose(results.object, obj, rtol=1e-10, atol=1e-10)
+    np.testing.assert_allclose(results.pupil.p, p, rtol=1e-10, atol=1e-10)
+
+
+def test_zernike_gradients_match_one_fft_per_mode(fake_pupil):
+    rng = np.random.default_rng(0)
+    num_px = NUM_PX[0]
+    bbox = fake_pupil.support_bbox
+    fft_idx = _unshifted_index(bbox, num_px)
+    modes = np.array([fake_pupil.zernike.unit_mode(j) for j in range(6)])[(slice(None), *bbox)]
+
+    spectrum = np.zeros(NUM_PX, dtype=np.complex128)
+    spectrum[bbox] = rng.normal(size=modes.shape[1:]) + 1j * rng.normal(size=modes.shape[1:])
+    low_res_img = ifft2(ifftshift(spectrum))
+    img_diff = rng.normal(size=NUM_PX)
+
+    expected = [
+        2
+        * np.sum(img_diff * np.imag(np.conj(low_res_img) * ifft2(ifftshift(spectrum * np.pi * m))))
+        for m in np.array([fake_pupil.zernike.unit_mode(j) for j in range(6)])
+    ]
+
+    gradients = zernike_gradients(spectrum[bbox], low_res_img, img_diff, modes, fft_idx)
+
+    np.testing.assert_allclose(gradients, expected, rtol=1e-9, atol=1e-12)
+
+
+@pytest.fixture(scope="module")
+def simulated():
+    dataset, pupil, _, _ = fp_simulation(num_leds=(5, 5), center_led=(2, 2))
+    return dataset, pupil
+
+
+def test_fp_recover_records_decreasing_error(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(dataset, pupil, num_iterations=5, upsampling_factor=2)
+
+    assert [m.iteration for m in results.history] == list(range(5))
+    assert results.errors[-1] < results.errors[0]
+    elapsed = [m.elapsed_s for m in results.history]
+    assert elapsed == sorted(elapsed)
+    assert results.stop_reason is StopReason.MAX_ITERATIONS
+
+
+def test_fp_recover_stops_on_plateau(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(dataset, pupil, num_iterations=50, upsampling_factor=2, rel_tol=0.05)
+
+    assert results.stop_reason is StopReason.PLATEAU
+    assert len(results.history) < 50
+    previous, last = results.errors[-2:]
+    assert previous - last < 0.05 * previous
+
+
+def test_fp_recover_stops_on_time_budget(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(dataset, pupil, num_iterations=50, upsampling_factor=2, time_budget_s=0)
+
+    assert results.stop_reason is StopReason.TIME_BUDGET
+    assert len(results.history) == 1
+
+
+def test_fp_recover_callback(simulated):
+    dataset, pupil = simulated
+    seen = []
+
+    def callback(metrics: IterationMetrics) -> bool:
+        seen.append(metrics)
+        return metrics.iteration == 2
+
+    results = fp_recover(dataset, pupil, num_iterations=10, upsampling_factor=2, callback=callback)
+
+    assert seen == results.history
+    assert len(seen) == 3
+    assert results.stop_reason is StopReason.CALLBACK
+
+
+def test_fp_recover_stops_at_target_error(simulated):
+    dataset, pupil = simulated
+
+    reference = fp_recover(dataset, pupil, num_iterations=10, upsampling_factor=2).errors
+    # Aim halfway between the error of an iteration that improves on all previous ones and the
+    # lowest error before it, so the target does not depend on the simulation's exact errors.
+    stop = next(i for i in range(3, len(reference)) if reference[i] < min(reference[:i]))
+    target_error = (min(reference[:stop]) + reference[stop]) / 2
+
+    results = fp_recover(
+        dataset, pupil, num_iterations=10, upsampling_factor=2, target_error=target_error
+    )
+
+    assert results.stop_reason is StopReason.TARGET_ERROR
+    assert len(results.errors) == stop + 1
+    assert results.errors[-1] < target_error <= min(results.errors[:-1])
+
+
+@pytest.fixture(scope="module")
+def simulated_aberrated():
+    dataset, pupil, _, _ = fp_simulation(
+        num_leds=(5, 5), center_led=(2, 2), zernike_coeffs=[0, 0, 0, 0.3, 0.2, -0.2, 0.1]
+    )
+    return dataset, pupil
+
+
+def test_mpie_converges_faster_than_rpie(simulated_aberrated):
+    dataset, pupil = simulated_aberrated
+    kwargs = dict(
+        num_iterations=20, upsampling_factor=2, pupil_recovery_method=PupilRecoveryMethod.rPIE
+    )
+
+    rpie = fp_recover(dataset, pupil, **kwargs)
+    mpie = fp_recover(dataset, pupil, object_update_method=ObjectUpdateMethod.mPIE, **kwargs)
+
+    assert mpie.errors[-1] < rpie.errors[-1]
+
+
+def test_mpie_without_pupil_recovery(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=5,
+        upsampling_factor=2,
+        object_update_method=ObjectUpdateMethod.mPIE,
+    )
+
+    assert results.errors[-1] < results.errors[0]
+    np.testing.assert_array_equal(results.pupil.p, pupil.p)
+
+
+def test_momentum_restarts_when_change_reverses(fake_pupil):
+    target = np.zeros(4, dtype=np.complex128)
+    momentum = _Momentum(target, fake_pupil, momentum=0.5, with_pupil=False)
+
+    target += 1
+    momentum.step(target, fake_pupil)
+    np.testing.assert_allclose(target, 1.5)
+
+    target += 1  # the velocity accumulates
+    momentum.step(target, fake_pupil)
+    np.testing.assert_allclose(target, 2.5 + 0.5 * 1.5)
+
+    target -= 1  # the change opposes the velocity
+    momentum.step(target, fake_pupil)
+    np.testing.assert_allclose(target, 2.25 - 0.5)
+
+
+def test_adam_pupil_recovery(simulated_aberrated):
+    dataset, pupil = simulated_aberrated
+
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=5,
+        upsampling_factor=2,
+        pupil_recovery_method=PupilRecoveryMethod.ADAM,
+        learning_rate=1e-3,
+    )
+
+    assert results.errors[-1] < results.errors[0]
+    # The recovered aberrations have the signs of the simulated ones
+    np.testing.assert_array_equal(np.sign(results.zernike_coeffs[-1][3:7]), [1, 1, -1, 1])
+
+
+def test_custom_led_schedule(simulated):
+    dataset, pupil = simulated
+    calls = []
+
+    def reverse(iteration, dataset, errors):
+        calls.append((iteration, errors))
+        return range(len(dataset) - 1, -1, -1)
+
+    results = fp_recover(dataset, pupil, num_iterations=3, upsampling_factor=2, led_order=reverse)
+    reversed_dataset = FPDataset(
+        images=dataset.images[::-1],
+        wavevectors=dataset.wavevectors[::-1],
+        led_indexes=dataset.led_indexes[::-1],
+    )
+    expected = fp_recover(reversed_dataset, pupil, num_iterations=3, upsampling_factor=2)
+
+    np.testing.assert_allclose(results.object, expected.object)
+    assert [iteration for iteration, _ in calls] == [0, 1, 2]
+    assert np.all(np.isnan(calls[0][1]))
+    assert np.all(np.isfinite(calls[1][1]))
+    assert np.sum(calls[1][1]) / np.sum(dataset.images**2) == pytest.approx(results.errors[0])
+
+
+def test_angle_led_order(simulated):
+    dataset, _ = simulated
+    schedule = _builtin_schedule(LEDOrder.ANGLE, seed=None)
+
+    order = schedule(0, dataset, np.full(len(dataset), np.nan))
+
+    assert sorted(order) == list(range(len(dataset)))
+    k = np.hypot(*dataset.wavevectors[order, 0:2].T)
+    assert np.all(np.diff(k) >= 0)
+
+
+def test_residual_led_order(simulated):
+    dataset, _ = simulated
+    schedule = _builtin_schedule(LEDOrder.RESIDUAL, seed=None)
+    errors = np.arange(len(dataset), dtype=float)
+
+    np.testing.assert_array_equal(
+        schedule(0, dataset, np.full(len(dataset), np.nan)),
+        _builtin_schedule(LEDOrder.ANGLE, seed=None)(0, dataset, errors),
+    )
+    np.testing.assert_array_equal(schedule(1, dataset, errors), np.arange(len(dataset))[::-1])
+
+
+def test_random_led_order_is_seeded(simulated):
+    dataset, pupil = simulated
+    kwargs = dict(num_iterations=2, upsampling_factor=2, led_order=LEDOrder.RANDOM)
+
+    first = fp_recover(dataset, pupil, seed=1, **kwargs)
+    second = fp_recover(dataset, pupil, seed=1, **kwargs)
+    other = fp_recover(dataset, pupil, seed=2, **kwargs)
+
+    np.testing.assert_array_equal(first.object, second.object)
+    assert not np.array_equal(first.object, other.object)
+
+
+def test_initial_object_must_have_upsampled_size(simulated):
+    dataset, pupil = simulated
+
+    with pytest.raises(FPRecoveryError):
+        fp_recover(dataset, pupil, upsampling_factor=2, initial_object=dataset.images[0])
+
+
+def test_pad_spectrum_interpolates_object():
+    x = np.arange(16) / 16
+    obj = np.exp(2j * np.pi * 3 * x)[None, :] * np.ones((16, 1))
+
+    padded = _pad_spectrum(fftshift(fft2(obj)), 32)
+    upsampled = ifft2(ifftshift(padded)) * 4
+
+    np.testing.assert_allclose(upsampled[::2, ::2], obj, atol=1e-12)
+
+
+def test_fitting_images(simulated):
+    dataset, pupil = simulated
+    num_px = dataset.images.shape[1]
+
+    coarse = _fitting_images(dataset, pupil.dk, num_px * 1)
+    fine = _fitting_images(dataset, pupil.dk, num_px * 2)
+
+    np.testing.assert_array_equal(np.round(coarse.wavevectors[:, 0:2] / pupil.dk), 0)
+    assert len(fine) == len(dataset)
+
+
+def test_fp_recover_multiresolution(simulated):
+    dataset, pupil = simulated
+
+    single = fp_recover(dataset, pupil, num_iterations=3, upsampling_factor=2)
+    multi = fp_recover_multiresolution(
+        dataset, pupil, upsampling_factors=(1, 2), num_iterations=[5, 3]
+    )
+
+    assert multi.object.shape == single.object.shape
+    assert [m.iteration for m in multi.history] == list(range(8))
+    elapsed = [m.elapsed_s for m in multi.history]
+    assert elapsed == sorted(elapsed)
+    assert multi.errors[-1] < multi.errors[5]
+
+
+def test_fp_recover_initial_zernike_coeffs(simulated):
+    dataset, pupil = simulated
+
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=1,
+        upsampling_factor=2,
+        pupil_recovery_method=PupilRecoveryMethod.GD,
+        learning_rate=0,
+        num_zernike_coeffs=4,
+        initial_zernike_coeffs=[0.1, 0.2, 0.3, 0.4, 0.5],
+    )
+
+    assert results.zernike_coeffs[-1] == [0.1, 0.2, 0.3, 0.4]
+
+
+def test_fp_recover_multiresolution_seeds_levels(simulated, monkeypatch):
+    dataset, pupil = simulated
+    calls = []
+
+    def recover(dataset, pupil, **kwargs):
+        results = fp_recover(dataset, pupil, **kwargs)
+        calls.append((len(dataset), kwargs, results))
+        return results
+
+    monkeypatch.setattr(leb.ptycho.fp, "fp_recover", recover)
+    fp_recover_multiresolution(
+        dataset,
+        pupil,
+        upsampling_factors=(1, 2),
+        num_iterations=2,
+        pupil_recovery_method=PupilRecoveryMethod.GD,
+    )
+
+    (num_coarse, coarse_kwargs, coarse), (num_fine, fine_kwargs, _) = calls
+    assert (num_coarse, num_fine) == (1, len(dataset))
+    assert coarse_kwargs["initial_object"] is None
+    assert fine_kwargs["initial_object"].shape == (2 * 64, 2 * 64)
+    assert fine_kwargs["initial_zernike_coeffs"] == coarse.zernike_coeffs[-1]
+
+
+def test_fp_recover_multiresolution_wrong_levels(simulated):
+    dataset, pupil = simulated
+
+    with pytest.raises(ValueError):
+        fp_recover_multiresolution(dataset, pupil, upsampling_factors=(2, 1))
+    with pytest.raises(ValueError):
+        fp_recover_multiresolution(dataset, pupil, (1, 2), num_iterations=[1])
+
+
+def test_fp_results_save_and_load(simulated, tmp_path):
+    dataset, pupil = simulated
+    results = fp_recover(
+        dataset,
+        pupil,
+        num_iterations=2,
+        upsampling_factor=2,
+        pupil_recovery_method=PupilRecoveryMethod.GD,
+    )
+
+    results.save(tmp_path / "checkpoint.npz")
+    loaded = FPResults.load(tmp_path / "checkpoint.npz", pupil)
+
+    np.testing.assert_array_equal(loaded.object, results.object)
+    np.testing.assert_array_equal(loaded.pupil.p, results.pupil.p)
+    assert loaded.zernike_coeffs == [results.zernike_coeffs[-1]]
+    assert loaded.history == results.history
+    assert results.zernike_coeffs[0] != results.zernike_coeffs[-1]
+
+
+def test_fp_recover_resumes_from_checkpoint(simulated, tmp_path):
+    dataset, pupil = simulated
+    path = tmp_path / "checkpoint.npz"
+    kwargs = dict(
+        num_iterations=4, upsampling_factor=2, pupil_recovery_method=PupilRecoveryMethod.rPIE
+    )
+
+    uninterrupted = fp_recover(dataset, pupil, **kwargs)
+
+    # Interrupt the reconstruction after the first checkpoint
+    def interrupt(metrics):
+        if metrics.iteration == 2:
+            raise KeyboardInterrupt
+
+    with pytest.raises(KeyboardInterrupt):
+        fp_recover(
+            dataset,
+            pupil,
+            checkpoint_path=path,
+            checkpoint_interval=2,
+            callback=interrupt,
+            **kwargs,
+        )
+    assert len(FPResults.load(path, pupil).history) == 2
+    resumed = fp_recover(
+        dataset, pupil, warm_start=FPResults.load(path, pupil), resume=True, **kwargs
+    )
+
+    assert [m.iteration for m in resumed.history] == [0, 1, 2, 3]
+    np.testing.assert_allclose(resumed.errors, uninterrupted.errors)
+    np.testing.assert_allclose(resumed.object, uninterrupted.object, atol=1e-9)
+    np.testing.assert_allclose(resumed.pupil.p, uninterrupted.pupil.p, atol=1e-9)
+
+
+def test_fp_recover_warm_start(simulated):
+    dataset, pupil = simulated
+
+    previous = fp_recover(dataset, pupil, num_iterations=3, upsampling_factor=2)
+    warm = fp_recover(dataset, pupil, num_iterations=1, upsampling_factor=2, warm_start=previous)
+
+    assert [m.iteration for m in warm.history] == [0]
+    assert warm.errors[0] < previous.errors[0]
+
+
+def test_fp_recover_resume_requires_warm_start(simulated):
+    dataset, pupil = simulated
+
+    with pytest.raises(FPRecoveryError):
+        fp_recover(dataset, pupil, upsampling_factor=2, resume=True)
+
+
+@pytest.mark.parametrize("checkpoint_interval", [0, -1])
+def test_fp_recover_rejects_invalid_checkpoint_interval(simulated, tmp_path, checkpoint_interval):
+    dataset, pupil = simulated
+
+    with pytest.raises(FPRecoveryError, match="checkpoint interval"):
+        fp_recover(
+            dataset,
+            pupil,
+            upsampling_factor=2,
+            checkpoint_path=tmp_path / "results.h5",
+            checkpoint_interval=checkpoint_interval,
+        )
+
+
+@pytest.mark.parametrize("initial", ["initial_object", "initial_zernike_coeffs"])
+def test_fp_recover_warm_start_excludes_initial_estimates(simulated, initial):
+    dataset, pupil = simulated
+    previous = fp_recover(dataset, pupil, num_iterations=1, upsampling_factor=2)
+    values = {"initial_object": previous.object, "initial_zernike_coeffs": [0.0] * 10}
+
+    with pytest.raises(FPRecoveryError, match="warm start"):
+        fp_recover(
+            dataset, pupil, upsampling_factor=2, warm_start=previous, **{initial: values[initial]}
+        )
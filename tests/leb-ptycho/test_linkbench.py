@@ -0,0 +1,148 @@
+import os
+import sys
+import threading
+import time
+
+import pytest
+
+from leb.ptycho.linkbench import (
+    MIN_FRAME_SIZE,
+    latency_stats,
+    parse_pong,
+    ping_frame,
+)
+
+if sys.platform != "win32":
+    import serial
+
+    from leb.ptycho.linkbench import measure_throughput, set_baudrate, sweep
+
+
+class PingResponder:
+    """Answers ping frames on the master side of a pseudo-terminal like the benchmark firmware."""
+
+    def __init__(self):
+        self.master, slave = os.openpty()
+        self.port = os.ttyname(slave)
+        self.baudrates = []
+        self.max_unanswered = 0
+        self._slave = slave
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def _run(self):
+        buffer = b""
+        while True:
+            try:
+                data = os.read(self.master, 1024)
+            except OSError:
+                return
+            rx_us = int(time.perf_counter() * 1e6) % 2**32
+            buffer += data
+            self.max_unanswered = max(self.max_unanswered, len(buffer))
+            while b"\n" in buffer:
+                line, buffer = buffer.split(b"\n", 1)
+                os.write(self.master, self._reply(line.decode(), rx_us))
+
+    def _reply(self, frame: str, rx_us: int) -> bytes:
+        if frame.startswith("P "):
+            seq, _, payload = frame[2:].partition(" ")
+            tx_us = int(time.perf_counter() * 1e6) % 2**32
+            return f"p {int(seq)} {rx_us} {tx_us} {payload}\n".encode()
+        if frame.startswith("B "):
+            self.baudrates.append(int(frame[2:]))
+            return f"b {frame[2:]}\n".encode()
+        return b"e unknown frame\r\n"
+
+    def close(self):
+        os.close(self.master)
+        os.close(self._slave)
+
+
+@pytest.fixture
+def responder():
+    device = PingResponder()
+    yield device
+    device.close()
+
+
+@pytest.fixture
+def port(responder):
+    with serial.Serial(responder.port, timeout=1) as p:
+        yield p
+
+
+def test_ping_frame_has_exact_size():
+    assert ping_frame(7, 32) == b"P 000007 " + b"x" * (32 - MIN_FRAME_SIZE) + b"\n"
+    assert len(ping_frame(1234567, MIN_FRAME_SIZE)) == MIN_FRAME_SIZE
+
+
+@pytest.mark.parametrize("size", [MIN_FRAME_SIZE - 1, 257])
+def test_ping_frame_size_out_of_range(size):
+    with pytest.raises(ValueError):
+        ping_frame(0, size)
+
+
+def test_parse_pong():
+    pong = parse_pong(b"p 12 4294967290 10 xxx\r\n")
+
+    assert (pong.seq, pong.rx_us, pong.tx_us, pong.payload) == (12, 4294967290, 10, "xxx")
+    assert pong.device_time_us == 16  # the time stamps wrapped around
+
+
+def test_parse_pong_without_payload():
+    assert parse_pong("p 0 1 2 ").payload == ""
+
+
+def test_parse_pong_error():
+    with pytest.raises(ValueError, match="frame too long"):
+        parse_pong(b"e frame too long\r\n")
+
+
+def test_latency_stats():
+    stats = latency_stats(list(range(1, 101)))
+
+    assert stats.n == 100
+    assert stats.mean == pytest.approx(50.5)
+    assert (stats.min, stats.max) == (1, 100)
+    assert stats.p50 == pytest.approx(50.5)
+    assert stats.p90 == pytest.approx(90.1)
+    assert stats.p99 == pytest.approx(99.01)
+
+
+def test_latency_stats_without_samples():
+    with pytest.raises(ValueError):
+        latency_stats([])
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal")
+def test_sweep(port, responder):
+    results = sweep(port, sizes=[MIN_FRAME_SIZE, 48], baudrates=[9600, 115200], n=20)
+
+    assert [(r.baudrate, r.size) for r in results] == [
+        (9600, MIN_FRAME_SIZE),
+        (9600, 48),
+        (115200, MIN_FRAME_SIZE),
+        (115200, 48),
+    ]
+    assert responder.baudrates == [9600, 115200]
+    assert port.baudrate == 115200
+    for r in results:
+        assert r.latency_ms.n == 20
+        assert 0 < r.latency_ms.p50 <= r.latency_ms.p90 <= r.latency_ms.p99 <= r.latency_ms.max
+        assert r.throughput_bytes_per_s == pytest.approx(r.throughput_frames_per_s * r.size)
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal")
+def test_throughput_respects_window(port, responder):
+    measure_throughput(port, 48, n=50, window=96)
+
+    assert responder.max_unanswered <= 96
+
+
+@pytest.mark.skipif(sys.platform == "win32", reason="requires a pseudo-terminal")
+def test_set_baudrate_rejected(port):
+    port.write = lambda data: serial.Serial.write(port, b"X\n")
+
+    with pytest.raises(RuntimeError, match="unknown frame"):
+        set_baudrate(port, 9600)
@@ -0,0 +1,102 @@
+import numpy as np
+import pytest
+
+from leb.ptycho.trace import (
+    EVENT_SIZE,
+    TraceEvent,
+    TraceSource,
+    align_frames,
+    parse_trace,
+    unpack_event,
+)
+
+
+def dump(events, lost=0):
+    return [f"trace {len(events)} {lost}"] + [event.pack().hex() for event in events]
+
+
+def test_event_round_trip():
+    event = TraceEvent(7, 123456, "ring", TraceSource.SYNC, x=-3, y=40, r=2, r_out=5, state=100)
+
+    data = event.pack()
+
+    assert len(data) == EVENT_SIZE == 16
+    assert unpack_event(data) == (7, 123456, "ring", TraceSource.SYNC, -3, 40, 2, 5, 0, 100)
+
+
+def test_parse_trace_unwraps_counters():
+    events = [
+        TraceEvent(2**16 - 1, 2**32 - 10, "single", TraceSource.COMMAND, 1, 1, state=100),
+        TraceEvent(2**16, 2**32 + 5, "single", TraceSource.SCHEDULE, 2, 1, state=100),
+    ]
+
+    trace = parse_trace(dump(events, lost=3))
+
+    assert trace.lost == 3
+    assert [event.seq for event in trace.events] == [2**16 - 1, 2**16]
+    assert [event.t_us for event in trace.events] == [2**32 - 10, 2**32 + 5]
+    assert trace.events[1].source == TraceSource.SCHEDULE
+    assert trace.times_s == pytest.approx([(2**32 - 10) * 1e-6, (2**32 + 5) * 1e-6])
+
+
+def test_parse_trace_empty():
+    trace = parse_trace(["trace 0 0"])
+
+    assert trace.events == []
+    assert trace.lost == 0
+
+
+@pytest.mark.parametrize("lines", [[], ["stats parse 0"], ["trace 2 0", "00" * EVENT_SIZE]])
+def test_parse_trace_malformed(lines):
+    with pytest.raises(ValueError):
+        parse_trace(lines)
+
+
+@pytest.fixture
+def acquisition():
+    """Patterns every 50 ms and the frames of a camera whose clock is offset and drifts."""
+    rng = np.random.default_rng(42)
+    event_times = 3.0 + 0.05 * np.arange(100) + rng.normal(0, 1e-4, 100)
+    frame_times = 1234.5 + (1 + 50e-6) * event_times + 0.002 + rng.normal(0, 2e-4, 100)
+    return event_times, frame_times
+
+
+def test_align_frames(acquisition):
+    event_times, frame_times = acquisition
+
+    alignment = align_frames(event_times, frame_times)
+
+    assert np.array_equal(alignment.frame_events, np.arange(100))
+    assert alignment.dropped_events.size == 0
+    assert alignment.unmatched_frames.size == 0
+    assert alignment.drift == pytest.approx(50e-6, abs=3e-5)
+    assert np.nanmax(np.abs(alignment.residuals_s)) < 2e-3
+
+
+def test_align_frames_detects_dropped_and_spurious_frames(acquisition):
+    event_times, frame_times = acquisition
+    frames = np.delete(frame_times, [0, 10, 57])
+    frames = np.sort(np.append(frames, frame_times[30] + 0.025))  # halfway between two patterns
+
+    alignment = align_frames(event_times, frames)
+
+    assert alignment.dropped_events.tolist() == [10, 57]
+    assert alignment.unmatched_frames.tolist() == [29]
+    assert alignment.frame_events[0] == 1
+
+
+def test_align_frames_with_trace_events():
+    events = [TraceEvent(i, 1000 + 20000 * i, "single", TraceSource.SYNC) for i in range(10)]
+    frames = 5.0 + 0.02 * np.arange(10)
+
+    alignment = align_frames(events, frames)
+
+    assert np.array_equal(alignment.frame_events, np.arange(10))
+    assert alignment.offset_s == pytest.approx(5.0 - 1e-3)
+
+
+def test_align_frames_needs_tolerance_for_single_event():
+    with pytest.raises(ValueError):
+        align_frames([1.0], [2.0])
+
+    assert align_frames([1.0], [2.0], tolerance_s=0.1).frame_events.tolist() == [0]
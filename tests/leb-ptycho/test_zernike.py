@@ -1,7 +1,7 @@
 import numpy as np
 import pytest
 
-from leb.ptycho.zernike import MAX_ZERNIKE_RAD_INDEX, Zernike
+from leb.ptycho.zernike import Zernike, ZernikeBackend, num_zernike_modes, zernike_modes
 
 
 @pytest.fixture
@@ -45,11 +45,51 @@ def test_zernike_noll_to_zernike(noll_index, degrees):
     assert Zernike.noll_to_zernike(noll_index) == degrees
 
 
-def test_zernike_rad_degree_too_high():
-    radial_degree = MAX_ZERNIKE_RAD_INDEX + 1
-
+def test_zernike_negative_rad_degree():
     with pytest.raises(ValueError):
-        Zernike((-1, 1), (-1, 1), (256, 256), radial_degree)
+        Zernike((-1, 1), (-1, 1), (256, 256), -1)
+
+
+def test_zernike_high_rad_degree():
+    zernike = Zernike((-1, 1), (-1, 1), (64, 64), 12)
+
+    assert zernike.num_modes == num_zernike_modes(12) == 91
+    assert zernike(np.ones(91)).shape == (64, 64)
+
+
+@pytest.mark.parametrize(
+    "noll_index, expected",
+    [
+        (1, lambda rho, theta: np.ones_like(rho)),
+        (4, lambda rho, theta: np.sqrt(3) * (2 * rho**2 - 1)),
+        (7, lambda rho, theta: np.sqrt(8) * (3 * rho**3 - 2 * rho) * np.sin(theta)),
+        (10, lambda rho, theta: np.sqrt(8) * rho**3 * np.cos(3 * theta)),
+        (11, lambda rho, theta: np.sqrt(5) * (6 * rho**4 - 6 * rho**2 + 1)),
+        (22, lambda rho, theta: np.sqrt(7) * (20 * rho**6 - 30 * rho**4 + 12 * rho**2 - 1)),
+    ],
+)
+def test_zernike_modes_closed_forms(noll_index, expected):
+    rng = np.random.default_rng(0)
+    rho, theta = rng.random(100), rng.uniform(-np.pi, np.pi, 100)
+
+    modes = zernike_modes(rho, theta, 6)
+
+    np.testing.assert_allclose(modes[noll_index - 1], expected(rho, theta), atol=1e-12)
+
+
+def test_zernike_modes_are_orthonormal():
+    # Gauss-Legendre quadrature in rho and the trapezoidal rule in theta are exact here.
+    nodes, weights = np.polynomial.legendre.leggauss(16)
+    rho, rho_weights = (nodes + 1) / 2, weights / 2
+    num_theta = 64
+    theta = 2 * np.pi * np.arange(num_theta) / num_theta
+    rho, theta = np.meshgrid(rho, theta)
+    area = rho * np.tile(rho_weights, (num_theta, 1)) * 2 / num_theta
+
+    modes = zernike_modes(rho, theta, 10).reshape(num_zernike_modes(10), -1)
+    gram = (modes * area.ravel()) @ modes.T
+
+    np.testing.assert_allclose(gram, np.eye(len(gram)), atol=1e-12)
 
 
 def test_zernike_unit_mode(zernike):
@@ -61,3 +101,43 @@ def test_zernike_unit_mode(zernike):
 
     assert mode.shape == zernike._shape
     assert np.allclose(mode, zernike(weights))
+
+
+def test_zernike_backends_agree():
+    pytest.importorskip("zernike")
+    weights = np.linspace(-1, 1, num_zernike_modes(4))
+
+    numpy = Zernike((-1.2, 1.2), (-1, 1), (96, 80), 4, backend=ZernikeBackend.NUMPY)
+    rzern = Zernike((-1.2, 1.2), (-1, 1), (96, 80), 4, backend=ZernikeBackend.RZERN)
+
+    np.testing.assert_allclose(numpy(weights), rzern(weights), atol=1e-12)
+
+
+def test_zernike_fewer_weights(zernike):
+    weights = [0.5, 0.2, -0.3]
+
+    np.testing.assert_allclose(
+        zernike(weights), zernike(np.pad(weights, (0, zernike.num_modes - len(weights))))
+    )
+
+
+def test_zernike_out(zernike):
+    out = np.full(zernike._shape, np.nan)
+
+    result = zernike(np.ones(zernike.num_modes), out=out)
+
+    assert result is out
+    np.testing.assert_array_equal(out, zernike(np.ones(zernike.num_modes)))
+
+
+def test_zernike_unit_modes_are_read_only(zernike):
+    assert zernike.unit_modes.shape == (zernike.num_modes, *zernike._shape)
+    assert not np.isnan(zernike.unit_modes).any()
+
+    with pytest.raises(ValueError):
+        zernike.unit_mode(2)[0, 0] = 1
+
+
+def test_zernike_unit_mode_out_of_range(zernike):
+    with pytest.raises(ValueError):
+        zernike.unit_mode(zernike.num_modes)
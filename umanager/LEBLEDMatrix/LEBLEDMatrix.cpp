@@ -0,0 +1,492 @@
+#include "LEBLEDMatrix.h"
+
+#include "ModuleInterface.h"
+
+#include <sstream>
+
+const char* g_DeviceName = "LEBLEDMatrix";
+const char* g_PropCenterX = "CenterLEDX";
+const char* g_PropCenterY = "CenterLEDY";
+const char* g_PropNumLEDs = "NumberOfLEDs";
+const char* g_PropBrightness = "Brightness";
+const char* g_PropCommand = "Command";
+const char* g_PropPattern = "Pattern";
+const char* g_PropRadius = "Radius";
+
+// The values of the Pattern property and the drawing commands that display them
+const char* g_Patterns[][2] = {
+   {"Single", "single"},
+   {"Brightfield", "brightfield"},
+   {"Darkfield", "darkfield"},
+   {"PhaseTop", "phaseTop"},
+   {"PhaseBottom", "phaseBottom"},
+   {"PhaseLeft", "phaseLeft"},
+   {"PhaseRight", "phaseRight"},
+   {"Ring", "ring"},
+};
+const size_t g_NumPatterns = sizeof(g_Patterns) / sizeof(g_Patterns[0]);
+
+const char* g_Ok = "0";
+const char* g_Error = "1";
+const char* g_Terminator = "\n";
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////////////////////////
+MODULE_API void InitializeModuleData()
+{
+   RegisterDevice(g_DeviceName, MM::StateDevice, "LEB LED matrix controller");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName)
+{
+   if (deviceName == 0)
+      return 0;
+
+   if (strcmp(deviceName, g_DeviceName) == 0)
+      return new LEBLEDMatrix();
+
+   return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice)
+{
+   delete pDevice;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// LEBLEDMatrix
+///////////////////////////////////////////////////////////////////////////////////////////////////
+LEBLEDMatrix::LEBLEDMatrix() :
+   initialized_(false),
+   port_("Undefined"),
+   centerX_(16),
+   centerY_(16),
+   numLEDs_(15 * 15),
+   position_(0),
+   brightness_(100),
+   pattern_("Single"),
+   radius_(0)
+{
+   InitializeDefaultErrorMessages();
+   SetErrorText(ERR_CONTROLLER_ERROR, "The LED controller returned an error");
+   SetErrorText(ERR_SEQUENCE_TOO_LONG, "The sequence does not fit into the controller's preload queue");
+   SetErrorText(ERR_PORT_CHANGE, "The port cannot be changed after initialization");
+   SetErrorText(ERR_NOT_SEQUENCEABLE, "Only the Single and Darkfield patterns can be sequenced");
+
+   CPropertyAction* pAct = new CPropertyAction(this, &LEBLEDMatrix::OnPort);
+   CreateProperty(MM::g_Keyword_Port, "Undefined", MM::String, false, pAct, true);
+
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnCenterX);
+   CreateIntegerProperty(g_PropCenterX, centerX_, false, pAct, true);
+
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnCenterY);
+   CreateIntegerProperty(g_PropCenterY, centerY_, false, pAct, true);
+
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnNumLEDs);
+   CreateIntegerProperty(g_PropNumLEDs, numLEDs_, false, pAct, true);
+}
+
+LEBLEDMatrix::~LEBLEDMatrix()
+{
+   Shutdown();
+}
+
+void LEBLEDMatrix::GetName(char* name) const
+{
+   CDeviceUtils::CopyLimitedString(name, g_DeviceName);
+}
+
+int LEBLEDMatrix::Initialize()
+{
+   if (initialized_)
+      return DEVICE_OK;
+
+   // Discard the start-up messages of the controller.
+   PurgeComPort(port_.c_str());
+
+   // Start from a known state.
+   int ret = SendCommand("sync off");
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = SendCommand("cyclePreload off");
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = SendCommand("clearPreload");
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = SendCommand("fill 0");
+   if (ret != DEVICE_OK)
+      return ret;
+
+   for (long i = 0; i < numLEDs_; i++)
+   {
+      long x, y;
+      SpiralLED(i, x, y);
+      std::ostringstream label;
+      label << "LED " << x << "," << y;
+      SetPositionLabel(i, label.str().c_str());
+   }
+
+   CPropertyAction* pAct = new CPropertyAction(this, &LEBLEDMatrix::OnState);
+   CreateIntegerProperty(MM::g_Keyword_State, 0, false, pAct);
+   SetPropertyLimits(MM::g_Keyword_State, 0, numLEDs_ - 1);
+
+   pAct = new CPropertyAction(this, &CStateBase::OnLabel);
+   CreateStringProperty(MM::g_Keyword_Label, "", false, pAct);
+
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnBrightness);
+   CreateIntegerProperty(g_PropBrightness, brightness_, false, pAct);
+   SetPropertyLimits(g_PropBrightness, 0, 100);
+
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnPattern);
+   CreateStringProperty(g_PropPattern, pattern_.c_str(), false, pAct);
+   for (size_t i = 0; i < g_NumPatterns; i++)
+      AddAllowedValue(g_PropPattern, g_Patterns[i][0]);
+
+   // The radius of the brightfield, darkfield and phase patterns and of the ring, in LEDs
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnRadius);
+   CreateIntegerProperty(g_PropRadius, radius_, false, pAct);
+
+   // Sends any command, e.g. "status", and shows the controller's reply.
+   pAct = new CPropertyAction(this, &LEBLEDMatrix::OnCommand);
+   CreateStringProperty(g_PropCommand, "", false, pAct);
+
+   initialized_ = true;
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::Shutdown()
+{
+   if (initialized_)
+   {
+      SendCommand("sync off");
+      SendCommand("fill 0");
+      initialized_ = false;
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::SendCommand(const std::string& cmd, std::vector<std::string>* output)
+{
+   int ret = SendSerialCommand(port_.c_str(), cmd.c_str(), g_Terminator);
+   if (ret != DEVICE_OK)
+      return ret;
+
+   std::vector<std::string> lines;
+   std::string answer;
+   for (;;)
+   {
+      ret = GetSerialAnswer(port_.c_str(), g_Terminator, answer);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      if (answer == g_Ok)
+         break;
+
+      if (answer == g_Error)
+      {
+         // The first line holds the reason, the remaining ones the help text.
+         std::string reason = lines.empty() ? "The LED controller returned an error" : lines[0];
+         SetErrorText(ERR_CONTROLLER_ERROR, (cmd + ": " + reason).c_str());
+         LogMessage("Command failed: " + cmd + ": " + reason);
+         return ERR_CONTROLLER_ERROR;
+      }
+      lines.push_back(answer);
+   }
+
+   if (output != 0)
+      output->insert(output->end(), lines.begin(), lines.end());
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::UploadSequence()
+{
+   int ret = SendCommand("cyclePreload off");
+   if (ret != DEVICE_OK)
+      return ret;
+   ret = SendCommand("clearPreload");
+   if (ret != DEVICE_OK)
+      return ret;
+   for (size_t i = 0; i < sequence_.size(); i++)
+   {
+      ret = SendCommand("preload " + PatternCommand(sequence_[i]));
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   return SendCommand("cyclePreload on");
+}
+
+int LEBLEDMatrix::ShowPosition(long position)
+{
+   bool gateOpen;
+   GetGateOpen(gateOpen);
+   if (!gateOpen)
+      return SendCommand("fill 0");
+
+   if (!PatternClearsMatrix())
+   {
+      int ret = SendCommand("fill 0");
+      if (ret != DEVICE_OK)
+         return ret;
+   }
+   return SendCommand(PatternCommand(position));
+}
+
+std::string LEBLEDMatrix::PatternCommand(long position) const
+{
+   long x, y;
+   SpiralLED(position, x, y);
+   const char* command = "single";
+   for (size_t i = 0; i < g_NumPatterns; i++)
+   {
+      if (pattern_ == g_Patterns[i][0])
+         command = g_Patterns[i][1];
+   }
+
+   std::ostringstream cmd;
+   cmd << command << " " << x << " " << y << " ";
+   // A ring is one LED wide, so its inner and outer radius are both the radius.
+   if (pattern_ == "Ring")
+      cmd << radius_ << " " << radius_ << " ";
+   else if (pattern_ != "Single")
+      cmd << radius_ << " ";
+   cmd << brightness_;
+   return cmd.str();
+}
+
+bool LEBLEDMatrix::PatternClearsMatrix() const
+{
+   return pattern_ == "Single" || pattern_ == "Darkfield";
+}
+
+void LEBLEDMatrix::SpiralLED(long position, long& x, long& y) const
+{
+   // Counterclockwise steps, as leb.ptycho.Direction.COUNTERCLOCKWISE
+   static const long dx[] = {0, 1, 0, -1};
+   static const long dy[] = {1, 0, -1, 0};
+
+   x = centerX_;
+   y = centerY_;
+   long step = 1;
+   long stepsTaken = 0;
+   int direction = 0;
+   while (stepsTaken < position)
+   {
+      for (long i = 0; i < step && stepsTaken < position; i++)
+      {
+         x += dx[direction];
+         y += dy[direction];
+         stepsTaken++;
+      }
+      direction = (direction + 1) % 4;
+      if (direction % 2 == 0)
+         step++;
+   }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Action handlers
+///////////////////////////////////////////////////////////////////////////////////////////////////
+int LEBLEDMatrix::OnPort(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(port_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      if (initialized_)
+      {
+         pProp->Set(port_.c_str());
+         return ERR_PORT_CHANGE;
+      }
+      pProp->Get(port_);
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnCenterX(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(centerX_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(centerX_);
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnCenterY(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+      pProp->Set(centerY_);
+   else if (eAct == MM::AfterSet)
+      pProp->Get(centerY_);
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnNumLEDs(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(numLEDs_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long numLEDs;
+      pProp->Get(numLEDs);
+      if (numLEDs < 1)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      numLEDs_ = numLEDs;
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnState(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(position_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long position;
+      pProp->Get(position);
+      if (position < 0 || position >= numLEDs_)
+         return DEVICE_UNKNOWN_POSITION;
+
+      int ret = ShowPosition(position);
+      if (ret != DEVICE_OK)
+         return ret;
+      position_ = position;
+   }
+   else if (eAct == MM::IsSequenceable)
+   {
+      // A maximum length of 0 tells Micro-Manager to set the positions one by one instead.
+      pProp->SetSequenceable(PatternClearsMatrix() ? PRELOAD_SIZE : 0);
+   }
+   else if (eAct == MM::AfterLoadSequence)
+   {
+      std::vector<std::string> sequence = pProp->GetSequence();
+      if ((long)sequence.size() > PRELOAD_SIZE)
+         return ERR_SEQUENCE_TOO_LONG;
+
+      std::vector<long> positions;
+      for (size_t i = 0; i < sequence.size(); i++)
+      {
+         long position = atol(sequence[i].c_str());
+         if (position < 0 || position >= numLEDs_)
+            return DEVICE_UNKNOWN_POSITION;
+         positions.push_back(position);
+      }
+      sequence_ = positions;
+   }
+   else if (eAct == MM::StartSequence)
+   {
+      // The pattern may have changed since the sequence was loaded.
+      if (!PatternClearsMatrix())
+         return ERR_NOT_SEQUENCEABLE;
+
+      // The sequence is uploaded at every start, because stopping it clears the queue and a
+      // sequence may be started several times.
+      int ret = UploadSequence();
+      if (ret != DEVICE_OK)
+         return ret;
+
+      // Every edge on the sync line, e.g. from the camera's exposure output, displays the next
+      // preloaded LED.
+      return SendCommand("sync follower");
+   }
+   else if (eAct == MM::StopSequence)
+   {
+      int ret = SendCommand("sync off");
+      if (ret != DEVICE_OK)
+         return ret;
+      ret = SendCommand("cyclePreload off");
+      if (ret != DEVICE_OK)
+         return ret;
+      return SendCommand("clearPreload");
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnBrightness(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(brightness_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      pProp->Get(brightness_);
+
+      // Redraw the current position with the new brightness.
+      return ShowPosition(position_);
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnPattern(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(pattern_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string pattern;
+      pProp->Get(pattern);
+      bool known = false;
+      for (size_t i = 0; i < g_NumPatterns; i++)
+         known = known || pattern == g_Patterns[i][0];
+      if (!known)
+      {
+         pProp->Set(pattern_.c_str());
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      }
+      pattern_ = pattern;
+      return ShowPosition(position_);
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnRadius(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(radius_);
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      long radius;
+      pProp->Get(radius);
+      if (radius < 0)
+         return DEVICE_INVALID_PROPERTY_VALUE;
+      radius_ = radius;
+      return ShowPosition(position_);
+   }
+   return DEVICE_OK;
+}
+
+int LEBLEDMatrix::OnCommand(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+   if (eAct == MM::BeforeGet)
+   {
+      pProp->Set(lastOutput_.c_str());
+   }
+   else if (eAct == MM::AfterSet)
+   {
+      std::string cmd;
+      pProp->Get(cmd);
+
+      std::vector<std::string> output;
+      int ret = SendCommand(cmd, &output);
+      if (ret != DEVICE_OK)
+         return ret;
+
+      lastOutput_.clear();
+      for (size_t i = 0; i < output.size(); i++)
+         lastOutput_ += (i > 0 ? " | " : "") + output[i];
+      pProp->Set(lastOutput_.c_str());
+   }
+   return DEVICE_OK;
+}
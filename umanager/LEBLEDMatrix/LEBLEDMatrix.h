@@ -0,0 +1,91 @@
+/// Micro-Manager device adapter for the LEB LED matrix controller.
+///
+/// The controller is exposed as a state device whose positions are the LEDs of a spiral around the
+/// center LED, in the same order as `leb.ptycho.spiral`. The Pattern property selects what a
+/// position displays: the single LED, or a brightfield, darkfield, phase or ring pattern of the
+/// given Radius centered on that LED. The State property is sequenceable for the Single and
+/// Darkfield patterns, which redraw the whole matrix: at the start of a sequence acquisition the
+/// sequence is uploaded to the controller's preload queue, which repeats it, and the controller
+/// runs as sync follower so that every edge of the camera's exposure output on the sync line
+/// displays the next position without any serial traffic. The other patterns only draw over the
+/// previous one, so the adapter clears the matrix before it draws them, which a preloaded pattern
+/// cannot do.
+#ifndef LEBLEDMATRIX_H
+#define LEBLEDMATRIX_H
+
+#include "DeviceBase.h"
+
+#include <string>
+#include <vector>
+
+#define ERR_CONTROLLER_ERROR   10001
+#define ERR_SEQUENCE_TOO_LONG  10002
+#define ERR_PORT_CHANGE        10003
+#define ERR_NOT_SEQUENCEABLE   10004
+
+// The maximum number of preloaded patterns. Must match PRELOAD_SIZE in the firmware's sync.h.
+const long PRELOAD_SIZE = 64;
+
+class LEBLEDMatrix : public CStateDeviceBase<LEBLEDMatrix>
+{
+public:
+   LEBLEDMatrix();
+   ~LEBLEDMatrix();
+
+   // MMDevice API
+   int Initialize();
+   int Shutdown();
+   void GetName(char* name) const;
+   bool Busy() { return false; }
+   unsigned long GetNumberOfPositions() const { return numLEDs_; }
+
+   // Action handlers
+   int OnPort(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCenterX(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCenterY(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnNumLEDs(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnState(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnBrightness(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnPattern(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnRadius(MM::PropertyBase* pProp, MM::ActionType eAct);
+   int OnCommand(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+private:
+   // Sends a command and waits for the controller's acknowledgement.
+   //
+   // Lines that the controller prints before the acknowledgement are appended to output. If the
+   // controller answers with an error, its first line becomes the text of ERR_CONTROLLER_ERROR.
+   int SendCommand(const std::string& cmd, std::vector<std::string>* output = 0);
+
+   // Uploads the loaded sequence to the preload queue and lets the queue repeat it, so that the
+   // sequence starts over after its last position as Micro-Manager expects.
+   int UploadSequence();
+
+   // Displays a position with the current pattern and brightness, or switches all LEDs off while
+   // the shutter is closed.
+   int ShowPosition(long position);
+
+   // The drawing command that displays a position with the current pattern and brightness.
+   std::string PatternCommand(long position) const;
+
+   // Whether the drawing command of the current pattern switches off all other LEDs, so that it
+   // can be preloaded.
+   bool PatternClearsMatrix() const;
+
+   // The (x, y) indexes of the LED at a position of the spiral.
+   void SpiralLED(long position, long& x, long& y) const;
+
+   bool initialized_;
+   std::string port_;
+   long centerX_;
+   long centerY_;
+   long numLEDs_;
+   long position_;
+   long brightness_;
+   std::string pattern_;
+   long radius_;
+   std::vector<long> sequence_;
+   std::string lastOutput_;
+};
+
+#endif // #LEBLEDMATRIX_H